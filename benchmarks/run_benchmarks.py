@@ -0,0 +1,263 @@
+"""Latency and throughput benchmarks for zmq_interface.
+
+Measures put_data on the server, and peek_data/pop_data from 1 or more concurrent clients, over a matrix of payload
+sizes, block counts and transports. Results are written as JSON so that runs can be compared across commits:
+
+    cmake --build build --target benchmark
+    python benchmarks/run_benchmarks.py --quick --output results.json
+"""
+
+import argparse
+import json
+import os
+import platform
+import socket
+import subprocess
+import sys
+import threading
+import time
+
+import zmq_interface as zi
+
+DEFAULT_SIZES = [64, 1024, 64 * 1024, 1024**2, 16 * 1024**2, 100 * 1024**2]
+DEFAULT_NS = [1, 10, -1]
+DEFAULT_TRANSPORTS = ["ipc", "tcp", "inproc"]
+DEFAULT_CLIENTS = [1, 4, 16, 64]
+# Blocks stored per topic, so that n = 10 and n = -1 (all) return several blocks
+STORED_BLOCKS = 10
+
+_name_counter = 0
+
+
+def unique_name(prefix: str) -> str:
+    # Loggers are registered by name, so every server and client needs its own
+    global _name_counter
+    _name_counter += 1
+    return f"{prefix}_{os.getpid()}_{_name_counter}"
+
+
+def free_tcp_port() -> int:
+    with socket.socket() as sock:
+        sock.bind(("127.0.0.1", 0))
+        return sock.getsockname()[1]
+
+
+def endpoint_for(transport: str) -> str:
+    if transport == "ipc":
+        return f"ipc:///tmp/zmq_interface_benchmark/{os.getpid()}_{_name_counter}"
+    if transport == "tcp":
+        return f"tcp://127.0.0.1:{free_tcp_port()}"
+    if transport == "inproc":
+        # Clients attach to the server in this process and read its topics without a socket
+        return f"inproc://zmq_interface_benchmark_{_name_counter}"
+    raise ValueError(f"Unknown transport: {transport}")
+
+
+def latency_stats(latencies_s: list[float]) -> dict:
+    latencies = sorted(latencies_s)
+
+    def percentile(p: float) -> float:
+        return latencies[min(len(latencies) - 1, int(p * len(latencies)))] * 1e6
+
+    return {
+        "samples": len(latencies),
+        "mean_us": sum(latencies) / len(latencies) * 1e6,
+        "p50_us": percentile(0.5),
+        "p99_us": percentile(0.99),
+        "p999_us": percentile(0.999),
+        "max_us": latencies[-1] * 1e6,
+    }
+
+
+def stored_blocks(size: int, max_topic_bytes: int) -> int:
+    return max(1, min(STORED_BLOCKS, max_topic_bytes // size))
+
+
+def bench_put(size: int, args) -> dict:
+    server = zi.ZMQServer(unique_name("bench_server"), endpoint_for("ipc"))
+    topic = "put"
+    server.add_topic(topic, 1e9, max_count=stored_blocks(size, args.max_topic_bytes))
+    payload = os.urandom(size)
+    latencies = []
+    start_time = time.perf_counter()
+    while len(latencies) < args.min_iterations or time.perf_counter() - start_time < args.duration:
+        op_start = time.perf_counter()
+        server.put_data(topic, payload)
+        latencies.append(time.perf_counter() - op_start)
+    elapsed = time.perf_counter() - start_time
+    del server
+    result = {"op": "put_data", "transport": "local", "payload_bytes": size, "n": 1, "clients": 1}
+    result.update(latency_stats(latencies))
+    result["ops_per_s"] = len(latencies) / elapsed
+    result["mb_per_s"] = len(latencies) * size / elapsed / 1e6
+    return result
+
+
+def run_clients(
+    server, endpoint: str, op: str, size: int, n: int, clients: int, blocks: int, args
+) -> tuple[list[float], int, float]:
+    payload = os.urandom(size)
+    topics = []
+    for i in range(clients):
+        # Every client pops from its own topic, which it refills after each timed pop
+        topic = "peek" if op == "peek_data" else f"pop_{i}"
+        if op == "pop_data":
+            server.add_topic(topic, 1e9)
+            server.pop_data(topic, "latest", -1)
+            for _ in range(blocks):
+                server.put_data(topic, payload)
+        topics.append(topic)
+
+    zmq_clients = [zi.ZMQClient(unique_name("bench_client"), endpoint, args.zero_copy) for _ in range(clients)]
+    latencies = [[] for _ in range(clients)]
+    received_bytes = [0] * clients
+    errors = []
+    barrier = threading.Barrier(clients + 1)
+
+    def client_loop(i: int):
+        client = zmq_clients[i]
+        request = getattr(client, op)
+        try:
+            barrier.wait()
+            start_time = time.perf_counter()
+            while len(latencies[i]) < args.min_iterations or time.perf_counter() - start_time < args.duration:
+                op_start = time.perf_counter()
+                data, _ = request(topics[i], "latest", n)
+                latencies[i].append(time.perf_counter() - op_start)
+                received_bytes[i] += sum(len(block) for block in data)
+                del data
+                if op == "pop_data":
+                    while server.get_topic_status()[topics[i]] < blocks:
+                        server.put_data(topics[i], payload)
+        except Exception as e:  # Reported in the results instead of killing the whole run
+            errors.append(repr(e))
+
+    threads = [threading.Thread(target=client_loop, args=(i,)) for i in range(clients)]
+    for thread in threads:
+        thread.start()
+    barrier.wait()
+    start_time = time.perf_counter()
+    for thread in threads:
+        thread.join()
+    elapsed = time.perf_counter() - start_time
+    del zmq_clients
+    if errors:
+        raise RuntimeError(errors[0])
+    return [latency for client_latencies in latencies for latency in client_latencies], sum(received_bytes), elapsed
+
+
+def bench_transport(transport: str, args, results: list, skipped: list):
+    try:
+        endpoint = endpoint_for(transport)
+        server = zi.ZMQServer(unique_name("bench_server"), endpoint, num_workers=args.num_workers)
+    except Exception as e:
+        skipped.append({"transport": transport, "reason": repr(e)})
+        print(f"Skipping {transport}: {e}")
+        return
+
+    server.add_topic("peek", 1e9)
+    for size in args.sizes:
+        blocks = stored_blocks(size, args.max_topic_bytes)
+        payload = os.urandom(size)
+        for _ in range(blocks):
+            server.put_data("peek", payload)
+        del payload
+        for op in args.ops:
+            for n in args.ns:
+                returned_blocks = blocks if n < 0 else min(n, blocks)
+                for clients in args.clients:
+                    case = {"op": op, "transport": transport, "payload_bytes": size, "n": n, "clients": clients}
+                    in_flight = clients * returned_blocks * size
+                    if in_flight > args.max_in_flight_bytes:
+                        skipped.append(dict(case, reason=f"{in_flight} bytes in flight exceed --max-in-flight-bytes"))
+                        continue
+                    try:
+                        latencies, received, elapsed = run_clients(
+                            server, endpoint, op, size, n, clients, blocks, args
+                        )
+                    except Exception as e:
+                        skipped.append(dict(case, reason=repr(e)))
+                        print(f"Failed {case}: {e}")
+                        continue
+                    case["blocks_per_request"] = returned_blocks
+                    case.update(latency_stats(latencies))
+                    case["ops_per_s"] = len(latencies) / elapsed
+                    case["mb_per_s"] = received / elapsed / 1e6
+                    results.append(case)
+                    print(
+                        f"{op:9s} {transport:6s} {size:>10d}B n={n:<3d} clients={clients:<3d} "
+                        f"p50={case['p50_us']:10.1f}us p99={case['p99_us']:10.1f}us {case['mb_per_s']:10.1f}MB/s"
+                    )
+        # Drop the stored blocks of this size before the next one
+        server.reset_start_time(zi.system_clock_us())
+    del server
+
+
+def git_commit() -> str:
+    try:
+        repo_dir = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+        return subprocess.check_output(["git", "rev-parse", "HEAD"], cwd=repo_dir, text=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return ""
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--output", default="benchmark_results.json", help="Path of the JSON results")
+    parser.add_argument("--sizes", type=int, nargs="+", default=DEFAULT_SIZES, help="Payload sizes in bytes")
+    parser.add_argument("--ns", type=int, nargs="+", default=DEFAULT_NS, help="Blocks per request, -1 for all")
+    parser.add_argument("--transports", nargs="+", default=DEFAULT_TRANSPORTS, choices=DEFAULT_TRANSPORTS)
+    parser.add_argument("--clients", type=int, nargs="+", default=DEFAULT_CLIENTS, help="Concurrent clients")
+    parser.add_argument("--ops", nargs="+", default=["put_data", "peek_data", "pop_data"])
+    parser.add_argument("--duration", type=float, default=0.5, help="Seconds per case")
+    parser.add_argument("--min-iterations", type=int, default=5, help="Requests per client and case at least")
+    parser.add_argument("--num-workers", type=int, default=0, help="Worker threads of the server")
+    parser.add_argument("--zero-copy", action="store_true", help="Clients return memoryviews instead of bytes")
+    parser.add_argument("--max-topic-bytes", type=int, default=512 * 1024**2, help="Stored bytes per topic at most")
+    parser.add_argument(
+        "--max-in-flight-bytes", type=int, default=2 * 1024**3, help="Skip cases that would receive more at once"
+    )
+    parser.add_argument("--quick", action="store_true", help="Small matrix for a fast smoke run")
+    args = parser.parse_args()
+    if args.quick:
+        args.sizes = [64, 64 * 1024, 1024**2]
+        args.ns = [1, -1]
+        args.clients = [1, 4]
+        args.duration = 0.2
+    return args
+
+
+def main():
+    args = parse_args()
+    results = []
+    skipped = []
+    if "put_data" in args.ops:
+        for size in args.sizes:
+            results.append(bench_put(size, args))
+            print(f"put_data  local  {size:>10d}B p50={results[-1]['p50_us']:10.1f}us")
+    args.ops = [op for op in args.ops if op != "put_data"]
+    if args.ops:
+        for transport in args.transports:
+            bench_transport(transport, args, results, skipped)
+
+    report = {
+        "metadata": {
+            "time": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+            "git_commit": git_commit(),
+            "host": platform.node(),
+            "platform": platform.platform(),
+            "python": sys.version.split()[0],
+            "cpu_count": os.cpu_count(),
+            "zmq_interface_version": zi.__version__,
+            "args": {key: value for key, value in vars(args).items() if key != "output"},
+        },
+        "results": results,
+        "skipped": skipped,
+    }
+    with open(args.output, "w") as f:
+        json.dump(report, f, indent=2)
+    print(f"Wrote {len(results)} results ({len(skipped)} skipped) to {args.output}")
+
+
+if __name__ == "__main__":
+    main()
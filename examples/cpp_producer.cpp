@@ -0,0 +1,30 @@
+// Publishes and reads data through the native library, without Python. Build with -DBUILD_CPP_EXAMPLES=ON.
+#include "zmq_client.h"
+#include "zmq_server.h"
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+int main()
+{
+    ZMQServer server("cpp_server", "ipc:///tmp/feeds/cpp", 0, "", 2);
+    ZMQClient client("cpp_client", "ipc:///tmp/feeds/cpp");
+    server.add_topic("pose", 1.0);
+
+    std::vector<double> pose(7);
+    for (int i = 0; i < 10; i++)
+    {
+        pose[0] = i;
+        server.put_data("pose", SharedBytes(reinterpret_cast<const char *>(pose.data()), pose.size() * sizeof(double)));
+
+        auto start_time = std::chrono::steady_clock::now();
+        std::vector<TimedPtr> ptrs = client.peek_data("pose", EndType::LATEST, 1);
+        double latency_us =
+            std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start_time).count();
+        const double *received = reinterpret_cast<const double *>(std::get<0>(ptrs[0]).data());
+        std::printf("Pose %.0f at %.3fs, round trip %.1fus\n", received[0], std::get<1>(ptrs[0]), latency_us);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return 0;
+}
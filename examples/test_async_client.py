@@ -0,0 +1,33 @@
+from zmq_interface import ZMQAsyncClient
+import asyncio
+import time
+import numpy as np
+
+
+async def test_async_client():
+    # Requests are pipelined over one connection, so peeking several topics costs about one round trip
+    client = ZMQAsyncClient("test_zmq_async_client", "tcp://localhost:5555", zero_copy=True)
+    print("Async client created")
+
+    while True:
+        start_time = time.time()
+        try:
+            results = await asyncio.gather(
+                *[client.apeek_data("test", "latest", 1, timeout=1.0) for _ in range(4)]
+            )
+        except TimeoutError:
+            print("Request timed out")
+            continue
+        end_peeking_time = time.time()
+
+        for raw_data_list, timestamps in results:
+            if raw_data_list:
+                data = np.frombuffer(raw_data_list[0], dtype=np.float64)
+                print(
+                    f"Received data: shape: {data.shape}, size: {data.nbytes / 1024**2:.3f}MB, peeking time: {end_peeking_time - start_time:.3f}s"
+                )
+        await asyncio.sleep(0.1)
+
+
+if __name__ == "__main__":
+    asyncio.run(test_async_client())
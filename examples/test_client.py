@@ -5,7 +5,8 @@ import numpy.typing as npt
 
 
 def test_client():
-    client = ZMQClient("test_zmq_client", "tcp://localhost:5555")
+    # zero_copy: received blocks are returned as memoryviews, so np.frombuffer does not copy them
+    client = ZMQClient("test_zmq_client", "tcp://localhost:5555", zero_copy=True)
     print("Client created")
 
     while True:
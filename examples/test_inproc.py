@@ -0,0 +1,30 @@
+import zmq_interface as zi
+import threading
+import time
+import numpy as np
+
+
+def test_inproc():
+    # Clients on an inproc:// endpoint read the server's topics directly instead of through a socket
+    server = zi.ZMQServer("test_zmq_server", "inproc://feeds")
+    server.add_topic("image", 1.0)
+    client = zi.ZMQClient("test_zmq_client", "inproc://feeds", zero_copy=True)
+
+    def produce():
+        for _ in range(100):
+            server.put_array("image", np.random.rand(1080, 1920))
+            time.sleep(0.01)
+
+    producer = threading.Thread(target=produce)
+    producer.start()
+    for i in range(10):
+        start_time = time.time()
+        images, timestamps = client.peek_arrays("image", "latest", 1)
+        if images:
+            print(f"Image {images[0].shape} at {timestamps[0]:.3f}s in {(time.time() - start_time) * 1e6:.1f}us")
+        time.sleep(0.1)
+    producer.join()
+
+
+if __name__ == "__main__":
+    test_inproc()
@@ -0,0 +1,33 @@
+import zmq_interface as zi
+import threading
+import time
+
+
+def test_mirror():
+    # peek_data of a mirrored topic is answered from a local copy that a background thread keeps up to date
+    server = zi.ZMQServer("test_zmq_server", "ipc:///tmp/feeds/mirror")
+    server.add_topic("pose", 1.0)
+    client = zi.ZMQClient("test_zmq_client", "ipc:///tmp/feeds/mirror")
+    client.mirror_topic("pose", 1.0, interval=0.005)
+
+    def produce():
+        for i in range(200):
+            server.put_data("pose", str(i).encode())
+            time.sleep(0.005)
+
+    producer = threading.Thread(target=produce)
+    producer.start()
+    for _ in range(10):
+        start_time = time.time()
+        data, timestamps = client.peek_data("pose", "latest", 1)
+        latency_us = (time.time() - start_time) * 1e6
+        if data:
+            staleness_ms = client.get_mirror_staleness("pose") * 1e3
+            print(f"Pose {data[0].decode()} at {timestamps[0]:.3f}s in {latency_us:.1f}us, {staleness_ms:.1f}ms stale")
+        time.sleep(0.1)
+    producer.join()
+    client.unmirror_topic("pose")
+
+
+if __name__ == "__main__":
+    test_mirror()
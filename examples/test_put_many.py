@@ -0,0 +1,24 @@
+import zmq_interface as zi
+import struct
+
+
+def test_put_many():
+    # A burst of hardware-timestamped IMU samples is stored with one lock acquisition
+    server = zi.ZMQServer("test_zmq_server", "ipc:///tmp/feeds/put_many")
+    server.add_topic("imu", 10.0)
+    server.add_topic("gps", 10.0)
+    start_time = server.get_timestamp()
+    samples = [struct.pack("6d", i, 0, 9.81, 0, 0, 0) for i in range(100)]
+    server.put_many("imu", samples, [start_time + i * 0.001 for i in range(100)])
+
+    # A sample that arrives late is placed at its timestamp
+    server.put_many("imu", [struct.pack("6d", -1, 0, 9.81, 0, 0, 0)], [start_time + 0.0505])
+    data, timestamps = server.peek_range("imu", start_time + 0.05, start_time + 0.052)
+    print([struct.unpack("6d", d)[0] for d in data], timestamps)
+
+    server.put_many_topics([("imu", samples[:10], None), ("gps", [b"fix"], [start_time])])
+    print(server.peek_data("gps", "latest", 1))
+
+
+if __name__ == "__main__":
+    test_put_many()
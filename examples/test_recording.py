@@ -0,0 +1,31 @@
+import zmq_interface as zi
+import time
+import numpy as np
+
+
+def test_recording():
+    server = zi.ZMQServer("test_zmq_server", "ipc:///tmp/feeds/1")
+    server.add_topic("pose", 10.0)
+    server.start_recording("/tmp/recordings/session", ["pose"])
+    for i in range(100):
+        server.put_data("pose", np.full(7, i, dtype=np.float64).tobytes())
+        time.sleep(0.01)
+    server.stop_recording()
+
+    reader = zi.RecordingReader("/tmp/recordings/session")
+    print(f"Recorded {reader.count('pose')} blocks from {reader.start_time():.3f}s to {reader.end_time():.3f}s")
+
+    # Replay into a fresh server at twice the recorded pace
+    replay_server = zi.ZMQServer("test_replay_server", "ipc:///tmp/feeds/2")
+    client = zi.ZMQClient("test_zmq_client", "ipc:///tmp/feeds/2")
+    replay_server.add_topic("pose", 10.0)
+    replay_server.replay("/tmp/recordings/session", speed=2.0)
+    while replay_server.is_replaying():
+        data, timestamps = client.peek_data("pose", "latest", 1)
+        if data:
+            print(f"Pose {np.frombuffer(data[0])[0]:.0f} recorded at {timestamps[0]:.3f}s")
+        time.sleep(0.05)
+
+
+if __name__ == "__main__":
+    test_recording()
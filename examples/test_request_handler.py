@@ -0,0 +1,31 @@
+import zmq_interface as zi
+import time
+import numpy as np
+
+
+def test_request_handler():
+    server = zi.ZMQServer("test_zmq_server", "ipc:///tmp/feeds/1", num_workers=2)
+    client = zi.ZMQClient("test_zmq_client", "ipc:///tmp/feeds/1")
+    server.add_topic("image", 1.0)
+
+    # Only the maximum of the requested rows is sent back instead of the whole image
+    def row_max(request: bytes) -> bytes:
+        start, end = np.frombuffer(request, dtype=np.int32)
+        images, _ = server.peek_arrays("image", "latest", 1)
+        if not images:
+            raise RuntimeError("No image available")
+        return images[0][start:end].max(axis=1).tobytes()
+
+    server.set_request_handler("image", row_max)
+
+    for i in range(10):
+        server.put_array("image", np.random.rand(1080, 1920))
+        start_time = time.time()
+        reply = client.request_with_data("image", np.array([100, 110], dtype=np.int32).tobytes())
+        row_maxima = np.frombuffer(reply, dtype=np.float64)
+        print(f"Request {i}: {row_maxima.shape[0]} row maxima in {(time.time() - start_time) * 1e3:.3f}ms")
+        time.sleep(0.1)
+
+
+if __name__ == "__main__":
+    test_request_handler()
@@ -0,0 +1,36 @@
+import zmq_interface as zi
+import time
+import numpy as np
+
+
+def test_subscriber():
+    server = zi.ZMQServer(
+        "test_zmq_server", "ipc:///tmp/feeds/0", publish_endpoint="ipc:///tmp/feeds/0_pub"
+    )
+    subscriber = zi.ZMQSubscriber("test_zmq_subscriber", "ipc:///tmp/feeds/0_pub")
+    print("Server and subscriber created")
+
+    server.add_topic("test", 10)
+    subscriber.subscribe("test", queue_size=100)
+    subscriber.subscribe("test_latest", conflate=True)
+
+    receive_times: list[float] = []
+    subscriber.set_callback("test", lambda data, timestamp: receive_times.append(time.time()))
+    time.sleep(0.1)  # Wait for the subscription to reach the publisher
+
+    send_times: list[float] = []
+    for k in range(10):
+        rand_data = np.random.rand(1000)
+        send_times.append(time.time())
+        server.put_data("test", rand_data.tobytes())
+        time.sleep(0.01)
+
+    data, timestamps = subscriber.pop_data("test", -1, timeout=1.0)
+    latencies = [(r - s) * 1e6 for s, r in zip(send_times, receive_times)]
+    print(
+        f"Received {len(data)} blocks, timestamps: {timestamps}, mean callback latency: {np.mean(latencies):.1f}us"
+    )
+
+
+if __name__ == "__main__":
+    test_subscriber()
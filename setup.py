@@ -28,6 +28,7 @@ class CMakeBuild(build_ext):
             f"-DCMAKE_LIBRARY_OUTPUT_DIRECTORY={extdir}",
             f"-DPYTHON_EXECUTABLE={sys.executable}",
             "-DCMAKE_POSITION_INDEPENDENT_CODE=ON",
+            "-DBUILD_TESTS=OFF",
         ]
 
         # # Detect platform-specific settings
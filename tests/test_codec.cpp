@@ -0,0 +1,51 @@
+#include "codec.h"
+#include "test_util.h"
+#include <string>
+#include <vector>
+
+static void check_round_trip(const std::string &raw, Codec codec, uint8_t element_size)
+{
+    SharedBytes encoded = encode_block(SharedBytes(raw), codec, element_size);
+    CHECK(decode_block(encoded).str() == raw);
+    Codec stored_codec;
+    SharedBytes stripped = strip_block(encoded, stored_codec);
+    CHECK(stored_codec == encoded_block_codec(encoded));
+    if (stored_codec == Codec::NONE)
+    {
+        CHECK(stripped.str() == raw);
+    }
+}
+
+int main()
+{
+    std::string compressible(100000, 'a');
+    std::vector<float> ramp(25000);
+    for (size_t i = 0; i < ramp.size(); i++)
+    {
+        ramp[i] = static_cast<float>(i) * 0.5f;
+    }
+    std::string floats(reinterpret_cast<const char *>(ramp.data()), ramp.size() * sizeof(float));
+    std::string noise(4096, '\0');
+    uint32_t state = 12345;
+    for (char &c : noise)
+    {
+        state = state * 1664525 + 1013904223;
+        c = static_cast<char>(state >> 24);
+    }
+
+    for (Codec codec : {Codec::NONE, Codec::LZ4, Codec::SHUFFLE_LZ4})
+    {
+        for (const std::string *raw : {&compressible, &floats, &noise})
+        {
+            check_round_trip(*raw, codec, 4);
+        }
+        check_round_trip("", codec, 4);
+        // A size that is not a multiple of the element size keeps its trailing bytes
+        check_round_trip(floats.substr(0, 1001), codec, 4);
+    }
+    CHECK(encoded_block_codec(encode_block(SharedBytes(compressible), Codec::LZ4, 1)) == Codec::LZ4);
+    // Blocks that do not get smaller are stored uncompressed
+    CHECK(encoded_block_codec(encode_block(SharedBytes(noise), Codec::LZ4, 1)) == Codec::NONE);
+    CHECK(str_to_codec(codec_to_str(Codec::SHUFFLE_LZ4)) == Codec::SHUFFLE_LZ4);
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include "data_topic.h"
+#include "test_util.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+static SharedBytes block(const std::string &data)
+{
+    return SharedBytes(data.data(), data.size());
+}
+
+static std::string joined(const std::vector<TimedPtr> &ptrs)
+{
+    std::string result;
+    for (const TimedPtr &ptr : ptrs)
+    {
+        result += std::get<0>(ptr).str();
+    }
+    return result;
+}
+
+static void check_out_of_order(size_t capacity)
+{
+    DataTopic topic("topic", 100.0, capacity);
+    topic.add_data_ptrs({TimedPtr(block("a"), 1), TimedPtr(block("c"), 3), TimedPtr(block("e"), 5)});
+    SinceResult first = topic.peek_since_ptrs(0, -1);
+    CHECK(joined(first.ptrs) == "ace" && first.cursor == 3);
+
+    // Late blocks are placed at their timestamps and get new sequence numbers
+    topic.add_data_ptrs({TimedPtr(block("d"), 4), TimedPtr(block("b"), 2)});
+    topic.add_data_ptr(block("f"), 6);
+    CHECK(joined(topic.peek_data_ptrs(EndType::EARLIEST, -1)) == "abcdef");
+    CHECK(joined(topic.peek_range_ptrs(2, 4)) == "bcd");
+    CHECK(joined(topic.peek_nearest_ptrs(3.9, 1)) == "d");
+
+    // A poller that had read up to "e" gets the late blocks, in timestamp order, one call at a time
+    SinceResult late = topic.peek_since_ptrs(first.cursor, 1);
+    CHECK(joined(late.ptrs) == "d" && late.sequences[0] == 4 && late.cursor == 4 && !late.evicted);
+    late = topic.peek_since_ptrs(late.cursor, -1);
+    CHECK(joined(late.ptrs) == "bf" && late.cursor == 6 && !late.evicted);
+    CHECK(topic.peek_since_ptrs(late.cursor, -1).ptrs.empty());
+    SinceResult all = topic.peek_since_ptrs(0, -1);
+    CHECK(joined(all.ptrs) == "abcdef" && all.cursor == 6);
+
+    // Evicting past the late blocks makes the sequence numbers ordered again
+    topic.add_data_ptr(block("z"), 104.5);
+    CHECK(joined(topic.peek_data_ptrs(EndType::EARLIEST, -1)) == "efz");
+    SinceResult after = topic.peek_since_ptrs(4, -1);
+    CHECK(joined(after.ptrs) == "fz" && after.cursor == 7);
+    SinceResult evicted = topic.peek_since_ptrs(1, -1);
+    CHECK(evicted.evicted);
+}
+
+static void check_full_ring()
+{
+    DataTopic topic("ring", 100.0, 2);
+    topic.add_data_ptrs({TimedPtr(block("x"), 5), TimedPtr(block("y"), 6)});
+    // Older than every block of a full ring: dropped right away
+    topic.add_data_ptr(block("w"), 1);
+    CHECK(joined(topic.peek_data_ptrs(EndType::EARLIEST, -1)) == "xy");
+    // Evicts the oldest block to make room
+    topic.add_data_ptr(block("v"), 5.5);
+    CHECK(joined(topic.peek_data_ptrs(EndType::EARLIEST, -1)) == "vy");
+}
+
+static void check_concurrent_ring_peeks()
+{
+    DataTopic topic("ring", 1e9, 64);
+    std::atomic<bool> running{true};
+    std::atomic<bool> consistent{true};
+    std::thread reader([&] {
+        while (running)
+        {
+            std::vector<TimedPtr> ptrs = topic.peek_data_ptrs(EndType::LATEST, -1);
+            for (size_t i = 1; i < ptrs.size(); i++)
+            {
+                // Lock-free peeks must never see a block twice or out of order while late blocks are inserted
+                if (std::get<1>(ptrs[i - 1]) >= std::get<1>(ptrs[i]))
+                {
+                    consistent = false;
+                }
+            }
+        }
+    });
+    for (int i = 0; i < 20000; i++)
+    {
+        double timestamp = i % 3 == 0 ? i - 1.5 : i;
+        topic.add_data_ptr(block(std::to_string(i)), timestamp);
+    }
+    running = false;
+    reader.join();
+    CHECK(consistent);
+}
+
+static void check_foreign_clock_expiry(size_t capacity)
+{
+    // Timestamps far from the server's clock expire relative to the newest block
+    DataTopic topic("imu", 0.05, capacity);
+    topic.add_data_ptrs({TimedPtr(block("a"), 1e9), TimedPtr(block("b"), 1e9 + 0.04)});
+    topic.expire_data();
+    CHECK(topic.size() == 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    topic.expire_data();
+    CHECK(joined(topic.peek_data_ptrs(EndType::EARLIEST, -1)) == "b");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    topic.expire_data();
+    CHECK(topic.size() == 0);
+}
+
+int main()
+{
+    check_out_of_order(0);
+    check_out_of_order(16);
+    check_full_ring();
+    check_concurrent_ring_peeks();
+    check_foreign_clock_expiry(0);
+    check_foreign_clock_expiry(16);
+    return 0;
+}
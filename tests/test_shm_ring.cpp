@@ -0,0 +1,65 @@
+#include "shm_ring.h"
+#include "test_util.h"
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+static bool read_throws(const ShmRing &ring, const ShmDescriptor &descriptor, bool copy)
+{
+    try
+    {
+        ring.read(descriptor, copy);
+    }
+    catch (const std::runtime_error &)
+    {
+        return true;
+    }
+    return false;
+}
+
+int main()
+{
+    std::string name = "/zmq_interface_test_" + std::to_string(getpid());
+    auto writer = std::make_unique<ShmRing>(name, 3 * ShmRing::MIN_BLOCK_SIZE + 1);
+    // Rounded up to the block alignment
+    CHECK(writer->capacity() == 3 * ShmRing::MIN_BLOCK_SIZE + 64);
+    std::shared_ptr<ShmRing> reader = std::make_shared<ShmRing>(name);
+    CHECK(reader->segment_id() == writer->segment_id());
+
+    std::string first(ShmRing::MIN_BLOCK_SIZE, 'a');
+    std::optional<ShmDescriptor> first_descriptor = writer->write(first.data(), first.size());
+    CHECK(first_descriptor.has_value() && first_descriptor->position == 0);
+    CHECK(reader->read(*first_descriptor, true).str() == first);
+
+    {
+        // A view leases the block: a write that would overwrite it is refused until the view is released
+        SharedBytes view = reader->read(*first_descriptor, false);
+        CHECK(view.str() == first);
+        for (char c : std::string("bc"))
+        {
+            std::string block(ShmRing::MIN_BLOCK_SIZE, c);
+            CHECK(writer->write(block.data(), block.size()).has_value());
+        }
+        std::string block(ShmRing::MIN_BLOCK_SIZE, 'd');
+        CHECK(!writer->write(block.data(), block.size()).has_value());
+        CHECK(view.str() == first);
+    }
+    std::string fourth(ShmRing::MIN_BLOCK_SIZE, 'd');
+    std::optional<ShmDescriptor> fourth_descriptor = writer->write(fourth.data(), fourth.size());
+    CHECK(fourth_descriptor.has_value());
+    CHECK(reader->read(*fourth_descriptor, false).str() == fourth);
+    // The first block was overwritten, which copies and views both detect
+    CHECK(read_throws(*reader, *first_descriptor, true));
+    CHECK(read_throws(*reader, *first_descriptor, false));
+
+    // A restarted server creates a new segment under the same name, which the client maps for its descriptors
+    writer.reset();
+    writer = std::make_unique<ShmRing>(name, ShmRing::MIN_BLOCK_SIZE);
+    std::string restarted(ShmRing::MIN_BLOCK_SIZE, 'r');
+    std::optional<ShmDescriptor> restarted_descriptor = writer->write(restarted.data(), restarted.size());
+    CHECK(restarted_descriptor.has_value() && restarted_descriptor->segment_id != fourth_descriptor->segment_id);
+    CHECK(reader->read(*restarted_descriptor, false).str() == restarted);
+    return 0;
+}
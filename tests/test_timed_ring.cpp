@@ -0,0 +1,49 @@
+#include "test_util.h"
+#include "timed_ring.h"
+#include <string>
+
+static std::string block_str(const TimedPtr &ptr)
+{
+    return std::get<0>(ptr).str();
+}
+
+int main()
+{
+    TimedRing ring(4);
+    // Wraps around the slots several times, keeping the newest 4 blocks
+    for (int i = 0; i < 10; i++)
+    {
+        ring.push_back(SharedBytes(std::to_string(i)), i);
+    }
+    CHECK(ring.size() == 4);
+    CHECK(ring.capacity() == 4);
+    for (size_t i = 0; i < 4; i++)
+    {
+        CHECK(block_str(ring.at(i)) == std::to_string(6 + i));
+        CHECK(ring.timestamp_at(i) == 6 + i);
+        CHECK(ring.data_size_at(i) == 1);
+    }
+
+    std::vector<TimedPtr> latest = ring.peek(EndType::LATEST, 2);
+    CHECK(latest.size() == 2 && block_str(latest[0]) == "8" && block_str(latest[1]) == "9");
+    std::vector<TimedPtr> earliest = ring.peek(EndType::EARLIEST, 1);
+    CHECK(earliest.size() == 1 && block_str(earliest[0]) == "6");
+    CHECK(ring.peek(EndType::LATEST, -1).size() == 4);
+    CHECK(ring.peek(EndType::LATEST, 100).size() == 4);
+
+    ring.pop_front();
+    ring.pop_back();
+    CHECK(ring.size() == 2 && block_str(ring.at(0)) == "7" && block_str(ring.at(1)) == "8");
+    // Slots freed at both ends are reused in order
+    ring.push_back(SharedBytes(std::string("10")), 10);
+    ring.push_back(SharedBytes(std::string("11")), 11);
+    ring.push_back(SharedBytes(std::string("12")), 12);
+    std::vector<TimedPtr> all = ring.peek(EndType::EARLIEST, -1);
+    CHECK(all.size() == 4);
+    CHECK(block_str(all[0]) == "8" && block_str(all[3]) == "12");
+    CHECK(std::get<1>(all[1]) == 10);
+
+    ring.clear();
+    CHECK(ring.size() == 0 && ring.peek(EndType::LATEST, 1).empty());
+    return 0;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+
+// Stops the test with the failed condition and its location. Unlike assert, it is kept in release builds.
+#define CHECK(condition)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(condition))                                                                                              \
+        {                                                                                                              \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);                        \
+            std::exit(1);                                                                                              \
+        }                                                                                                              \
+    } while (false)
@@ -0,0 +1,115 @@
+#include "test_util.h"
+#include "zmq_message.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+static std::vector<TimedPtr> make_blocks()
+{
+    return {TimedPtr(SharedBytes(std::string("first")), 1.5), TimedPtr(SharedBytes(std::string(1000, 'x')), 2.5),
+            TimedPtr(SharedBytes(std::string()), 3.5)};
+}
+
+static void check_blocks(const std::vector<TimedPtr> &ptrs)
+{
+    std::vector<TimedPtr> expected = make_blocks();
+    CHECK(ptrs.size() == expected.size());
+    for (size_t i = 0; i < ptrs.size(); i++)
+    {
+        CHECK(std::get<0>(ptrs[i]).str() == std::get<0>(expected[i]).str());
+        CHECK(std::get<1>(ptrs[i]) == std::get<1>(expected[i]));
+    }
+}
+
+static void check_round_trip(uint8_t version, uint32_t topic_handle)
+{
+    ZMQMessage message("topic", CmdType::PEEK_DATA, EndType::LATEST, 42.0, make_blocks());
+    message.set_protocol(version, topic_handle, 7);
+    std::string serialized = message.serialize();
+
+    CmdType cmd;
+    std::string topic;
+    uint32_t peeked_handle;
+    CHECK(peek_message_header(serialized.data(), serialized.size(), cmd, topic, peeked_handle));
+    CHECK(cmd == CmdType::PEEK_DATA);
+    CHECK(peeked_handle == topic_handle);
+    // A handle replaces the topic name on the wire
+    CHECK(topic == (topic_handle != 0 ? "" : "topic"));
+    CHECK(!peek_message_header(serialized.data(), 1, cmd, topic, peeked_handle));
+
+    ZMQMessage decoded(serialized);
+    CHECK(decoded.protocol_version() == version);
+    CHECK(decoded.cmd() == CmdType::PEEK_DATA);
+    CHECK(decoded.end_type() == EndType::LATEST);
+    CHECK(decoded.timestamp() == 42.0);
+    CHECK(decoded.topic_handle() == topic_handle);
+    CHECK(decoded.topic() == (topic_handle != 0 ? "" : "topic"));
+    if (version == PROTOCOL_V2)
+    {
+        CHECK(decoded.session() == 7);
+    }
+    check_blocks(decoded.data_ptrs());
+
+    // A received single frame is decoded into views that keep the alignment of the blocks within the frame
+    std::vector<zmq::message_t> single_frame;
+    single_frame.emplace_back(serialized.data(), serialized.size());
+    const char *frame_data = single_frame[0].data<char>();
+    ZMQMessage frame_decoded(single_frame);
+    std::vector<TimedPtr> frame_ptrs = frame_decoded.data_ptrs();
+    check_blocks(frame_ptrs);
+    for (const TimedPtr &ptr : frame_ptrs)
+    {
+        const SharedBytes &block = std::get<0>(ptr);
+        if (block.size() == 0)
+        {
+            continue;
+        }
+        CHECK(block.data() > frame_data && block.data() < frame_data + serialized.size());
+        if (version == PROTOCOL_V2)
+        {
+            CHECK((block.data() - frame_data) % PROTOCOL_V2_ALIGNMENT == 0);
+        }
+    }
+
+    ZMQMessage multipart_message("topic", CmdType::PEEK_DATA, EndType::LATEST, 42.0, make_blocks());
+    multipart_message.set_protocol(version, topic_handle, 7);
+    std::vector<zmq::message_t> frames = multipart_message.serialize_multipart();
+    CHECK(frames.size() == 4);
+    ZMQMessage multipart_decoded(frames);
+    CHECK(multipart_decoded.protocol_version() == version);
+    CHECK(multipart_decoded.timestamp() == 42.0);
+    check_blocks(multipart_decoded.data_ptrs());
+}
+
+int main()
+{
+    check_round_trip(PROTOCOL_V1, 0);
+    check_round_trip(PROTOCOL_V2, 0);
+    check_round_trip(PROTOCOL_V2, 3);
+
+    // Version 2 blocks of a single-frame message start at the protocol's alignment
+    ZMQMessage message("topic", CmdType::PEEK_DATA, EndType::LATEST, 0, make_blocks());
+    message.set_protocol(PROTOCOL_V2);
+    std::string serialized = message.serialize();
+    size_t offset = serialized.find("first");
+    CHECK(offset != std::string::npos && offset % PROTOCOL_V2_ALIGNMENT == 0);
+
+    ZMQMessage text_message("", CmdType::HANDSHAKE, EndType::NONE, 1.0, std::string(1, '\2'));
+    text_message.set_protocol(PROTOCOL_V2);
+    ZMQMessage text_decoded(text_message.serialize());
+    CHECK(text_decoded.cmd() == CmdType::HANDSHAKE);
+    CHECK(text_decoded.data_str() == std::string(1, '\2'));
+
+    bool threw = false;
+    try
+    {
+        ZMQMessage truncated(serialized.substr(0, 10));
+        truncated.data_ptrs();
+    }
+    catch (const std::exception &)
+    {
+        threw = true;
+    }
+    CHECK(threw);
+    return 0;
+}
@@ -1,6 +1,8 @@
 from .core.zmq_interface import (
+    ZMQAsyncClient,
     ZMQClient,
     ZMQServer,
+    ZMQSubscriber,
     steady_clock_us,
     system_clock_us,
 )
@@ -8,8 +10,10 @@ from .core.zmq_interface import (
 __version__ = "0.1.0"
 
 __all__ = [
+    "ZMQAsyncClient",
     "ZMQClient",
     "ZMQServer",
+    "ZMQSubscriber",
     "steady_clock_us",
     "system_clock_us",
 ]
\ No newline at end of file
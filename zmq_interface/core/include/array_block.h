@@ -0,0 +1,17 @@
+#pragma once
+#include "py_common.h"
+#include <vector>
+
+// Blocks written by put_array describe the array they contain:
+// [u8[4] magic][u8 ndim][u8 dtype length][u16 data offset][dtype][i64 shape * ndim][i64 strides * ndim]
+// The dtype is numpy's dtype.str (e.g. "<f8"), and the data start at the next multiple of 64 bytes.
+
+// Copies the array into a new block. C- and Fortran-contiguous arrays keep their layout, other arrays are
+// gathered into C order. Throws std::invalid_argument for object and structured dtypes. Requires the GIL.
+SharedBytes encode_array_block(const pybind11::object &array);
+bool is_array_block(const SharedBytes &block);
+// Returns a read-only ndarray whose memory is the block itself. Throws std::invalid_argument if the block was not
+// written by encode_array_block.
+pybind11::object array_block_to_ndarray(const SharedBytes &block);
+// Same as ptrs_to_tuple, but with ndarrays instead of bytes
+pybind11::tuple array_ptrs_to_tuple(const std::vector<TimedPtr> &ptrs);
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+// Maps a local clock onto a remote one from NTP-style exchanges. Every exchange gives an offset estimate that is off
+// by at most half of its round-trip time, so only the fastest exchanges of every round are used. The offsets of the
+// last rounds are fitted with a line to correct for the drift between the two clocks.
+// All times are in seconds. Not thread-safe.
+class ClockSync
+{
+  public:
+    explicit ClockSync(size_t history_size = 32);
+
+    // t0: request sent and t3: reply received on the local clock, t1: request received and t2: reply sent on the
+    // remote clock
+    void add_sample(double t0, double t1, double t2, double t3);
+    // Combines the samples added since the last update into one offset estimate and refits the drift. Returns
+    // false if there were no samples.
+    bool update();
+    void reset();
+
+    bool synchronized() const;
+    // Remote time minus local time at local_time
+    double offset(double local_time) const;
+    double to_remote(double local_time) const;
+    // Bound on the error of the offset of the last update
+    double uncertainty() const;
+    // Rate of the remote clock relative to the local one, minus 1
+    double drift() const;
+
+  private:
+    struct Sample
+    {
+        double local_time;
+        double offset;
+        double delay;
+    };
+
+    // The drift is only fitted once the rounds span this long, since the offset noise dominates over short spans
+    static constexpr double MIN_DRIFT_SPAN = 10.0;
+
+    const size_t history_size_;
+    std::vector<Sample> samples_;
+    // (local time, offset) of the last rounds
+    std::deque<std::pair<double, double>> history_;
+    bool synchronized_;
+    double reference_time_;
+    double reference_offset_;
+    double drift_;
+    double uncertainty_;
+};
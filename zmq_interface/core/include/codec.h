@@ -0,0 +1,23 @@
+#pragma once
+#include "common.h"
+#include <string>
+
+enum class Codec : uint8_t
+{
+    NONE = 0,
+    LZ4 = 1,
+    SHUFFLE_LZ4 = 2, // Byte shuffle by element size before LZ4, for arrays of numbers
+};
+
+Codec str_to_codec(const std::string &codec);
+std::string codec_to_str(Codec codec);
+
+// Encoded blocks are self-describing: [u8 codec][u8 element_size][u64 raw_size] followed by the payload. Blocks that
+// do not get smaller are stored with Codec::NONE and their raw payload.
+SharedBytes encode_block(const SharedBytes &data, Codec codec, uint8_t element_size);
+Codec encoded_block_codec(const SharedBytes &encoded);
+// Returns the raw data. Codec::NONE blocks are returned as a view into the encoded block without copying.
+SharedBytes decode_block(const SharedBytes &encoded);
+// Returns the block as it should be sent to a client that understands codecs: the encoded block if it is
+// compressed, otherwise a view of its raw payload
+SharedBytes strip_block(const SharedBytes &encoded, Codec &codec);
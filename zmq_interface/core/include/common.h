@@ -1,17 +1,51 @@
 #pragma once
 #include <chrono>
+#include <cstdint>
 #include <memory>
-#include <pybind11/pybind11.h>
+#include <stdexcept>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include <iomanip>
 #include <sstream>
-using PyBytes = pybind11::bytes;
-using PyBytesPtr = std::shared_ptr<pybind11::bytes>;
 
-using TimedPtr = std::tuple<PyBytesPtr, double>;
+// Immutable, reference-counted byte buffer that does not depend on the Python interpreter. Copies share the same
+// memory, which stays alive as long as any copy (or the owner it was viewed from) exists.
+class SharedBytes
+{
+  public:
+    SharedBytes();
+    explicit SharedBytes(std::string data);
+    SharedBytes(const char *data, size_t size);
+    // View into memory that is kept alive by `owner`. Does not copy.
+    SharedBytes(std::shared_ptr<const void> owner, const char *data, size_t size);
+
+    const char *data() const;
+    size_t size() const;
+    bool empty() const;
+    std::string str() const;
+    const std::shared_ptr<const void> &owner() const;
+
+  private:
+    std::shared_ptr<const void> owner_;
+    const char *data_;
+    size_t size_;
+};
+
+using TimedPtr = std::tuple<SharedBytes, double>;
+
+// Blocks newer than a cursor, see DataTopic::peek_since_ptrs
+struct SinceResult
+{
+    std::vector<TimedPtr> ptrs;
+    // Per-topic sequence number of every block
+    std::vector<uint64_t> sequences;
+    // The cursor to pass with the next request
+    uint64_t cursor = 0;
+    // Whether blocks newer than the requested cursor were dropped before they could be returned
+    bool evicted = false;
+};
 int64_t steady_clock_us();
 int64_t system_clock_us();
 
@@ -22,6 +56,8 @@ enum class EndType : int8_t
     LATEST = 2,
 };
 
+std::string uint64_to_bytes(uint64_t value);
+uint64_t bytes_to_uint64(const std::string &bytes);
 std::string uint32_to_bytes(uint32_t value);
 uint32_t bytes_to_uint32(const std::string &bytes);
 std::string int32_to_bytes(int32_t value);
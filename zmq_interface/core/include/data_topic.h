@@ -1,23 +1,113 @@
 #pragma once
+#include "codec.h"
 #include "common.h"
+#include "stats.h"
+#include "timed_ring.h"
+#include <atomic>
 #include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
+
+// All public methods are thread-safe. Each topic has its own lock, so different topics never contend.
+// With capacity > 0 the blocks are kept in a preallocated ring of that many slots (the oldest block is dropped when
+// it is full), and peek_data_ptrs does not take the lock at all.
+// max_bytes and max_count (0 means unlimited) bound the topic further; the oldest blocks are evicted first, but the
+// newest block is always kept.
+// Blocks are kept in timestamp order; a block older than the latest one is inserted at its place.
+// Every block gets a per-topic sequence number, starting at 1 and increasing with every added block, which
+// polling readers use as a cursor (peek_since_ptrs).
+// With a codec other than Codec::NONE, blocks are compressed once when they are added and stored in encoded form
+// (see codec.h); pass the blocks read from the topic through decode_blocks before using them.
 class DataTopic
 {
   public:
-    DataTopic(const std::string &topic_name, double max_remaining_time);
+    DataTopic(const std::string &topic_name, double max_remaining_time, size_t capacity = 0, size_t max_bytes = 0,
+              size_t max_count = 0, Codec codec = Codec::NONE, uint8_t element_size = 1);
 
-    void add_data_ptr(const PyBytesPtr data_ptr, double timestamp);
+    void add_data_ptr(const SharedBytes data_ptr, double timestamp);
+    // Adds the blocks under one lock acquisition, evicting once after the last one
+    void add_data_ptrs(const std::vector<TimedPtr> &ptrs);
 
     std::vector<TimedPtr> peek_data_ptrs(EndType end_type, int32_t n);
     std::vector<TimedPtr> pop_data_ptrs(EndType end_type, int32_t n);
+    // Blocks with start_time <= timestamp <= end_time
+    std::vector<TimedPtr> peek_range_ptrs(double start_time, double end_time);
+    // The k blocks closest to timestamp, in chronological order
+    std::vector<TimedPtr> peek_nearest_ptrs(double timestamp, int32_t k);
+    // The oldest n blocks (n < 0 returns all) with a sequence number > cursor. Cursor 0 reads from the oldest stored
+    // block and never reports evicted blocks.
+    SinceResult peek_since_ptrs(uint64_t cursor, int32_t n);
+    // The block closest to timestamp of every topic (none for empty topics). All topics are locked at once, so the
+    // result is one consistent snapshot.
+    static std::vector<std::vector<TimedPtr>> peek_nearest_aligned(
+        const std::vector<std::shared_ptr<DataTopic>> &topics, double timestamp);
 
     void clear_data();
+    // Drops the blocks that are older than max_remaining_time on the topic's own clock: the timestamp of its newest
+    // block, advanced by the time since that block was added. Blocks stamped on another clock than the server's,
+    // e.g. by hardware or from a recording, thus expire when they should.
+    void expire_data();
+    // Drops the oldest block if its timestamp is still `timestamp`. Returns whether a block was dropped.
+    bool evict_oldest(double timestamp);
+    // Returns false if the topic is empty
+    bool oldest_timestamp(double &timestamp) const;
+    // Decodes blocks read from this topic in place. If codecs is given, compressed blocks are kept as they are and
+    // the codec of every block is appended to it instead.
+    void decode_blocks(std::vector<TimedPtr> &ptrs, std::vector<Codec> *codecs = nullptr) const;
+    Codec codec() const;
     int size() const;
+    // Total payload size of the stored blocks. Does not take the lock.
+    size_t bytes() const;
+    // Counters and lock wait times as a JSON object. Evictions count the blocks dropped by the time, count and byte
+    // limits and by the server's memory limit, pops those removed by pop_data_ptrs.
+    std::string stats_json() const;
+    const std::string &name() const;
 
   private:
+    // Storage primitives shared by the deque and ring backends. The caller holds mutex_.
+    size_t count_() const;
+    TimedPtr at_(size_t i) const;
+    double timestamp_at_(size_t i) const;
+    void push_back_(const SharedBytes &data_ptr, double timestamp);
+    // evicted is false when the block is popped by a reader
+    void pop_front_(bool evicted = true);
+    void pop_back_();
+    size_t data_size_at_(size_t i) const;
+    // Appends the block, or inserts it after the blocks with a timestamp <= its own
+    void insert_ordered_(const SharedBytes &data_ptr, double timestamp);
+    // Applies the time, count and byte limits, the time limit relative to the latest block
+    void evict_();
+    // peek_since_ptrs by scanning every block, for when sequences_ is not sorted
+    void peek_since_unsorted_(uint64_t cursor, int32_t n, SinceResult &result) const;
+    std::vector<TimedPtr> nearest_ptrs_(double timestamp, int32_t k) const;
+    // Binary searches over the (monotonic) timestamps: index of the first block with a timestamp >= / > timestamp
+    size_t lower_bound_(double timestamp) const;
+    size_t upper_bound_(double timestamp) const;
+    // Locks mutex_ and records how long a contended acquisition waited
+    std::unique_lock<std::mutex> lock_() const;
+
     std::string topic_name_;
     double max_remaining_time_;
+    const size_t max_bytes_;
+    const size_t max_count_;
+    const Codec codec_;
+    const uint8_t element_size_;
+    std::atomic<size_t> bytes_;
+    mutable std::mutex mutex_;
+    mutable LatencyHistogram lock_waits_;
+    std::atomic<uint64_t> puts_{0};
+    std::atomic<uint64_t> put_bytes_{0};
+    std::atomic<uint64_t> pops_{0};
+    std::atomic<uint64_t> evictions_{0};
+    uint64_t next_sequence_;
+    // steady_clock_us() when the newest block was appended
+    int64_t latest_added_us_ = 0;
+    // Sequence numbers of the stored blocks of either backend, in storage order. Sorted except for the first
+    // unsorted_prefix_ blocks, since a block inserted out of order has a higher number than the blocks after it.
+    std::deque<uint64_t> sequences_;
+    size_t unsorted_prefix_ = 0;
     std::deque<TimedPtr> data_;
-};
\ No newline at end of file
+    std::unique_ptr<TimedRing> ring_;
+};
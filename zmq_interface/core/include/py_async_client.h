@@ -0,0 +1,36 @@
+#pragma once
+
+#include "py_common.h"
+#include "zmq_async_client.h"
+#include <string>
+#include <vector>
+
+// The ZMQAsyncClient exposed to Python, whose requests return concurrent.futures.Future objects
+class PyZMQAsyncClient : public ZMQAsyncClient
+{
+  public:
+    using ZMQAsyncClient::ZMQAsyncClient;
+    ~PyZMQAsyncClient() override;
+
+    // Resolve to the same tuples as ZMQClient.peek_data/pop_data
+    pybind11::object peek_data(const std::string &topic, std::string end_type, int32_t n, double timeout);
+    pybind11::object pop_data(const std::string &topic, std::string end_type, int32_t n, double timeout);
+    pybind11::object peek_range(const std::string &topic, double start_time, double end_time, double timeout);
+    pybind11::object peek_nearest(const std::string &topic, double timestamp, int32_t k, double timeout);
+    pybind11::object peek_since(const std::string &topic, uint64_t cursor, int32_t n, double timeout);
+    // Resolve to lists with one (data, timestamps) tuple per spec / topic, see ZMQClient
+    pybind11::object peek_batch(const std::vector<BatchSpec> &specs, double timeout);
+    pybind11::object peek_aligned(const std::vector<std::string> &topics, double timestamp, double timeout);
+
+  private:
+    // How the reply blocks are converted for the future
+    enum class ReplyType
+    {
+        DATA,
+        BATCH, // PEEK_BATCH/PEEK_ALIGNED
+        SINCE,
+    };
+
+    // Returns a new future and sets callback to the callback that resolves it. Requires the GIL.
+    pybind11::object make_future_(ReplyType reply_type, Callback &callback);
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "py_common.h"
+#include "zmq_client.h"
+#include <string>
+#include <vector>
+
+// The ZMQClient exposed to Python. With zero_copy, blocks are returned as read-only memoryviews into the received
+// messages instead of being copied into new bytes objects.
+class PyZMQClient : public ZMQClient
+{
+  public:
+    using ZMQClient::ZMQClient;
+
+    pybind11::tuple peek_data(const std::string &topic, std::string end_type, int32_t n);
+    pybind11::tuple pop_data(const std::string &topic, std::string end_type, int32_t n);
+    // Blocks added with ZMQServer.put_array, as read-only ndarrays backed by the received messages
+    pybind11::tuple peek_arrays(const std::string &topic, std::string end_type, int32_t n);
+    pybind11::tuple peek_range(const std::string &topic, double start_time, double end_time);
+    pybind11::tuple peek_nearest(const std::string &topic, double timestamp, int32_t k);
+    // Returns (data, timestamps, sequences, cursor, evicted)
+    pybind11::tuple peek_since(const std::string &topic, uint64_t cursor, int32_t n);
+    // Return one (data, timestamps) tuple per spec / topic
+    pybind11::list peek_batch(const std::vector<BatchSpec> &specs);
+    pybind11::list peek_aligned(const std::vector<std::string> &topics, double timestamp);
+    // Returns the reply as bytes or, with zero_copy, a memoryview
+    pybind11::object request_with_data(const std::string &topic, const PyBytes &data);
+    pybind11::tuple get_last_retrieved_data();
+    pybind11::tuple synchronize_time(int32_t samples);
+    // get_server_stats as a dict
+    pybind11::object get_server_stats();
+};
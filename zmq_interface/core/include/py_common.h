@@ -0,0 +1,16 @@
+#pragma once
+#include "common.h"
+#include <pybind11/pybind11.h>
+#include <vector>
+
+// Conversions between the native types and the Python objects of the module. Only the pybind11 wrappers use them.
+using PyBytes = pybind11::bytes;
+
+// Converts blocks into the (data, timestamps) tuple returned to Python. With zero_copy, the data are read-only
+// memoryviews that share the blocks' memory; otherwise they are copied into bytes objects.
+pybind11::tuple ptrs_to_tuple(const std::vector<TimedPtr> &ptrs, bool zero_copy);
+pybind11::list results_to_list(const std::vector<std::vector<TimedPtr>> &results, bool zero_copy);
+// (data, timestamps, sequences, cursor, evicted)
+pybind11::tuple since_result_to_tuple(const SinceResult &result, bool zero_copy);
+// Copies the payload of a bytes object, so that it can be used without the GIL
+SharedBytes py_bytes_to_shared(const PyBytes &data);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "py_common.h"
+#include "zmq_server.h"
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+// The ZMQServer exposed to Python: converts between Python objects and blocks, and releases the GIL while the
+// native server works
+class PyZMQServer : public ZMQServer
+{
+  public:
+    using ZMQServer::ZMQServer;
+    ~PyZMQServer() override;
+
+    void put_data(const std::string &topic, const PyBytes &data);
+    void put_many(const std::string &topic, const std::vector<PyBytes> &data,
+                  const std::optional<std::vector<double>> &timestamps);
+    // Takes (topic, data, timestamps or None) tuples
+    void put_many_topics(
+        const std::vector<std::tuple<std::string, std::vector<PyBytes>, std::optional<std::vector<double>>>> &batches);
+    // Stores any buffer-protocol object (ndarray, memoryview, bytearray, ...) together with its dtype and shape,
+    // copied once straight from the object's memory. Read it back with peek_arrays.
+    void put_array(const std::string &topic, const pybind11::object &array);
+    pybind11::tuple peek_data(const std::string &topic, std::string end_type_str, int n);
+    pybind11::tuple peek_arrays(const std::string &topic, std::string end_type_str, int n);
+    pybind11::tuple pop_data(const std::string &topic, std::string end_type_str, int n);
+    pybind11::tuple peek_range(const std::string &topic, double start_time, double end_time);
+    pybind11::tuple peek_nearest(const std::string &topic, double timestamp, int32_t k);
+    // Returns (data, timestamps, sequences, cursor, evicted)
+    pybind11::tuple peek_since(const std::string &topic, uint64_t cursor, int32_t n);
+    // Python handlers take bytes, return a bytes-like object or None, and all run one at a time on a dedicated
+    // thread that holds the GIL while they run
+    void set_request_handler(const std::string &topic, pybind11::function handler);
+    // stats_json as a dict
+    pybind11::object get_stats();
+
+  private:
+    // Python handlers are queued to python_handler_thread_, which is started by the first set_request_handler
+    std::thread python_handler_thread_;
+    std::mutex python_jobs_mutex_;
+    std::condition_variable python_jobs_condition_;
+    std::deque<std::packaged_task<SharedBytes()>> python_jobs_;
+    bool python_handler_running_ = false;
+
+    SharedBytes run_python_job_(std::packaged_task<SharedBytes()> job);
+    void python_handler_loop_();
+};
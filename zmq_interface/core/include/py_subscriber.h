@@ -0,0 +1,15 @@
+#pragma once
+
+#include "py_common.h"
+#include "zmq_subscriber.h"
+#include <string>
+
+// The ZMQSubscriber exposed to Python
+class PyZMQSubscriber : public ZMQSubscriber
+{
+  public:
+    using ZMQSubscriber::ZMQSubscriber;
+    ~PyZMQSubscriber() override;
+
+    pybind11::tuple pop_data(const std::string &topic, int32_t n, double timeout);
+};
@@ -0,0 +1,125 @@
+#pragma once
+#include "common.h"
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// A recording is a directory with two memory-mapped, append-only files per topic, named after the hex-encoded topic:
+//   <topic>.seg: the blocks' bytes, back to back
+//   <topic>.idx: [IndexHeader] + count * [IndexEntry], in timestamp order
+// The entry count in the index header is only advanced after the block and its entry are written, so a recording
+// that was cut off (e.g. by a crash) is readable up to its last complete block.
+
+// A file mapped into memory. Writable files grow by doubling their mapping as they are appended to, and are
+// truncated to the appended size when closed.
+class MappedFile
+{
+  public:
+    // Creates (or truncates) the file for appending
+    MappedFile(const std::string &path, size_t initial_capacity);
+    // Maps an existing file read-only
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // Returns the offset of the appended bytes
+    uint64_t append(const char *data, size_t size);
+    // Writes over bytes that were already appended
+    void write_at(uint64_t offset, const char *data, size_t size);
+    const char *data() const;
+    size_t size() const;
+
+  private:
+    void map_(size_t capacity);
+
+    std::string path_;
+    bool writable_;
+    int fd_;
+    char *mapped_;
+    size_t capacity_;
+    size_t size_;
+};
+
+// Streams blocks of the chosen topics into a recording. record() only queues the block; a background thread
+// appends the queued blocks to the files, so the producer never waits for the disk.
+class Recorder
+{
+  public:
+    Recorder(const std::string &directory, const std::vector<std::string> &topics);
+    // Writes the blocks that are still queued before closing the files
+    ~Recorder();
+
+    bool records(const std::string &topic) const;
+    void record(const std::string &topic, const SharedBytes &data, double timestamp);
+    // Blocks until every block queued so far is written
+    void flush();
+    const std::string &directory() const;
+
+  private:
+    struct TopicLog
+    {
+        std::unique_ptr<MappedFile> segment;
+        std::unique_ptr<MappedFile> index;
+        uint64_t count;
+    };
+    struct PendingBlock
+    {
+        TopicLog *log;
+        SharedBytes data;
+        double timestamp;
+    };
+
+    void writer_loop_();
+    void write_block_(const PendingBlock &block);
+
+    const std::string directory_;
+    // Fixed after construction, so record() looks topics up without a lock
+    std::unordered_map<std::string, std::unique_ptr<TopicLog>> logs_;
+    std::thread writer_thread_;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_condition_;
+    std::condition_variable flushed_condition_;
+    std::deque<PendingBlock> queue_;
+    uint64_t queued_count_ = 0;
+    uint64_t written_count_ = 0;
+    bool running_ = true;
+};
+
+// Read-only view of a recording. Blocks are views into the mapped segment files and stay valid as long as any copy
+// of them exists, even after the reader is destroyed.
+class RecordingReader
+{
+  public:
+    explicit RecordingReader(const std::string &directory);
+
+    std::vector<std::string> topics() const;
+    size_t count(const std::string &topic) const;
+    TimedPtr at(const std::string &topic, size_t i) const;
+    // Index of the first block of the topic with a timestamp >= timestamp, found through the index
+    size_t lower_bound(const std::string &topic, double timestamp) const;
+    // Blocks with start_time <= timestamp <= end_time
+    std::vector<TimedPtr> peek_range(const std::string &topic, double start_time, double end_time) const;
+    // Earliest and latest timestamp over all topics, (0, 0) for an empty recording
+    double start_time() const;
+    double end_time() const;
+
+  private:
+    struct TopicIndex
+    {
+        std::shared_ptr<const MappedFile> segment;
+        std::shared_ptr<const MappedFile> index;
+        size_t count;
+    };
+
+    const TopicIndex &find_(const std::string &topic) const;
+    double timestamp_at_(const TopicIndex &index, size_t i) const;
+
+    std::map<std::string, TopicIndex> topics_;
+};
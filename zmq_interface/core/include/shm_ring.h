@@ -0,0 +1,93 @@
+#pragma once
+#include "common.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+
+// Location of a data block inside a shared memory ring. `position` is the absolute (never wrapping) write position of
+// the block and doubles as its generation: once the writer has reserved `capacity` bytes beyond it, the block is
+// stale.
+struct ShmDescriptor
+{
+    uint64_t segment_id;
+    uint64_t position;
+    uint64_t length;
+};
+
+// Single-writer byte ring in a POSIX shared memory segment. The server copies reply blocks into it and only sends
+// the small descriptors over the socket; clients on the same host map the segment and read the blocks directly.
+// Clients that hold views into the ring lease them in a reader slot of the segment, which the writer never overwrites.
+class ShmRing : public std::enable_shared_from_this<ShmRing>
+{
+  public:
+    // Blocks smaller than this are cheaper to send through the socket
+    static constexpr size_t MIN_BLOCK_SIZE = 4096;
+    // Number of client rings that can hold views at the same time. Reads of further clients copy the blocks.
+    static constexpr size_t MAX_READERS = 64;
+
+    // Creates a new segment with the given data capacity, rounded up to the block alignment (server side). Only the
+    // server's user can map it.
+    ShmRing(const std::string &name, size_t capacity);
+    // Maps an existing segment (client side). Clients only write their reader slot.
+    explicit ShmRing(const std::string &name);
+    ~ShmRing();
+
+    // Returns std::nullopt if the block would overwrite a block that a client still holds a view of, in which case
+    // the block has to be sent another way
+    std::optional<ShmDescriptor> write(const char *data, size_t size);
+    // Throws if the block has been overwritten. If copy is false, the block is returned as a view that the writer does
+    // not overwrite until the view is released; it is copied if all reader slots are taken. A client ring that gets a
+    // descriptor of another segment, e.g. after the server restarted, maps the segment that now has the ring's name.
+    SharedBytes read(const ShmDescriptor &descriptor, bool copy) const;
+
+    uint64_t segment_id() const;
+    size_t capacity() const;
+
+    static std::string name_from_endpoint(const std::string &endpoint);
+    static std::string encode_descriptor(const ShmDescriptor &descriptor);
+    static ShmDescriptor decode_descriptor(const char *data, size_t size);
+
+  private:
+    struct ReaderSlot
+    {
+        // 0 if the slot is free
+        std::atomic<int32_t> pid;
+        // Position of the oldest block the reader holds a view of, NO_LEASE if none
+        std::atomic<uint64_t> leased_position;
+    };
+
+    struct alignas(64) Header
+    {
+        uint64_t magic;
+        uint64_t segment_id;
+        uint64_t capacity;
+        std::atomic<uint64_t> reserved_position;
+        std::atomic<uint64_t> committed_position;
+        ReaderSlot readers[MAX_READERS];
+    };
+
+    bool is_valid_(const ShmDescriptor &descriptor) const;
+    // Leases the block at position for a view, or returns nullptr if no reader slot is free. Releasing the returned
+    // pointer ends the lease.
+    std::shared_ptr<const char> lease_(uint64_t position, const char *block) const;
+    void release_(uint64_t position) const;
+    // The current segment with the ring's name, which must have the given id
+    std::shared_ptr<const ShmRing> remapped_ring_(uint64_t segment_id) const;
+
+    std::string name_;
+    bool owner_;
+    size_t mapped_size_;
+    void *mapped_;
+    Header *header_;
+    char *data_;
+    std::mutex write_mutex_;
+    mutable std::mutex remap_mutex_;
+    mutable std::shared_ptr<const ShmRing> remapped_;
+    // Positions of the blocks this client holds views of, and its reader slot (-1 before the first view)
+    mutable std::mutex lease_mutex_;
+    mutable std::multiset<uint64_t> leased_positions_;
+    mutable int reader_slot_ = -1;
+};
@@ -0,0 +1,26 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Histogram of durations in power-of-two microsecond buckets: bucket 0 counts durations below 1us and bucket i those
+// in [2^(i-1), 2^i) us. Recording takes no lock, so it can be used on every request.
+class LatencyHistogram
+{
+  public:
+    static constexpr size_t BUCKET_NUM = 32;
+
+    void record(int64_t duration_us);
+    uint64_t count() const;
+    // {"count": n, "sum_us": s, "p50_us": x, "p99_us": y, "buckets": {"<upper bound in us>": n, ...}}, where the
+    // percentiles are the upper bounds of their buckets and empty buckets are left out
+    std::string to_json() const;
+
+  private:
+    std::array<std::atomic<uint64_t>, BUCKET_NUM> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_us_{0};
+};
+
+std::string json_escape(const std::string &str);
@@ -0,0 +1,57 @@
+#pragma once
+#include "common.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Fixed-capacity ring of timed blocks. The writer side (push_back, insert, pop_front, pop_back, clear, at,
+// timestamp_at) must be serialized by the caller. peek may run concurrently with the writer and takes no lock: every
+// slot is guarded by a sequence number, and a reader discards slots that were rewritten while it copied them. insert
+// moves blocks between slots, which peek detects through rewrites_ and then reads again.
+class TimedRing
+{
+  public:
+    explicit TimedRing(size_t capacity);
+
+    // Overwrites the oldest block when the ring is full
+    void push_back(const SharedBytes &data_ptr, double timestamp);
+    // Inserts the block before the block at index i. The ring must not be full.
+    void insert(size_t i, const SharedBytes &data_ptr, double timestamp);
+    void pop_front();
+    void pop_back();
+    void clear();
+    // Index 0 is the oldest block
+    TimedPtr at(size_t i) const;
+    double timestamp_at(size_t i) const;
+    size_t data_size_at(size_t i) const;
+    size_t size() const;
+    size_t capacity() const;
+
+    std::vector<TimedPtr> peek(EndType end_type, int32_t n) const;
+
+  private:
+    struct Slot
+    {
+        // Odd while the slot is being written
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<uint64_t> index{0};
+        // Only accessed through std::atomic_load / std::atomic_store
+        std::shared_ptr<const void> owner;
+        std::atomic<const char *> data{nullptr};
+        std::atomic<size_t> size{0};
+        std::atomic<double> timestamp{0};
+    };
+
+    void write_slot_(uint64_t index, const SharedBytes &data_ptr, double timestamp);
+    bool read_slot_(uint64_t index, TimedPtr &ptr) const;
+    std::vector<TimedPtr> peek_once_(EndType end_type, int32_t n) const;
+
+    const size_t capacity_;
+    std::unique_ptr<Slot[]> slots_;
+    // Blocks [tail_, head_) are stored in slots_[index % capacity_]
+    std::atomic<uint64_t> head_;
+    std::atomic<uint64_t> tail_;
+    uint64_t write_count_;
+    // Odd while insert moves blocks
+    std::atomic<uint64_t> rewrites_{0};
+};
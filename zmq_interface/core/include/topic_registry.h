@@ -0,0 +1,46 @@
+#pragma once
+#include "data_topic.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Registry of the server's topics. Lookups read an immutable snapshot of the topic map and never take a lock;
+// add_topic copies the map and publishes the new snapshot (RCU-style), so it is the only operation that is
+// serialized. Topics are never removed, and each DataTopic synchronizes its own data.
+// Every topic also gets a handle, numbered from 1 in the order the topics are added, which finds it by indexing
+// instead of hashing its name.
+class TopicRegistry
+{
+  public:
+    using TopicMap = std::unordered_map<std::string, std::shared_ptr<DataTopic>>;
+    using HandleTable = std::vector<std::shared_ptr<DataTopic>>;
+
+    TopicRegistry();
+
+    // Returns the handle of the new topic, or 0 if a topic with the same name already exists
+    uint32_t add_topic(std::shared_ptr<DataTopic> topic);
+    // Returns nullptr for unknown topics
+    std::shared_ptr<DataTopic> find(const std::string &topic) const;
+    std::shared_ptr<DataTopic> find(uint32_t handle) const;
+    // Returns 0 for unknown topics
+    uint32_t handle(const std::string &topic);
+    std::shared_ptr<const TopicMap> snapshot() const;
+
+  private:
+    std::mutex writer_mutex_;
+    std::shared_ptr<const TopicMap> topics_;
+    // Entry i holds the topic with handle i + 1
+    std::shared_ptr<const HandleTable> handle_table_;
+    // Only accessed with writer_mutex_ held
+    std::unordered_map<std::string, uint32_t> handles_;
+};
+
+// Servers on inproc:// endpoints register their topics here instead of binding a socket, so that clients in the same
+// process attach to them and read the stored blocks directly. Throws std::invalid_argument if the endpoint is taken.
+void register_local_endpoint(const std::string &endpoint, std::shared_ptr<TopicRegistry> topics);
+void unregister_local_endpoint(const std::string &endpoint);
+// Returns nullptr if no server in this process serves the endpoint
+std::shared_ptr<TopicRegistry> find_local_endpoint(const std::string &endpoint);
+bool is_local_endpoint(const std::string &endpoint);
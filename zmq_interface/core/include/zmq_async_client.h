@@ -0,0 +1,89 @@
+#pragma once
+
+#include <zmq.hpp>
+
+#include "common.h"
+#include "zmq_message.h"
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class RequestTimeoutError : public std::runtime_error
+{
+  public:
+    using std::runtime_error::runtime_error;
+};
+
+// Pipelined client built on a DEALER socket. Any number of requests can be outstanding; replies are matched to
+// requests by a correlation id that the server echoes back in the envelope, so it works with both the plain REP
+// server and the ROUTER/worker-pool server.
+class ZMQAsyncClient
+{
+  public:
+    // Called on the background thread with either the reply blocks or the error that ended the request
+    using Callback = std::function<void(const std::vector<TimedPtr> &, std::exception_ptr)>;
+
+    ZMQAsyncClient(const std::string &client_name, const std::string &server_endpoint, bool zero_copy = false);
+    virtual ~ZMQAsyncClient();
+    // Stops the background thread. Called by the destructor, which then fails the requests still pending.
+    void close();
+
+    // Send the same requests as ZMQClient. The callback receives the reply blocks, which for peek_since and
+    // peek_batch/peek_aligned still have to be split with split_since_result and split_batch_results.
+    // A timeout <= 0 means the request never expires.
+    void peek_data(const std::string &topic, EndType end_type, int32_t n, double timeout, Callback callback);
+    void pop_data(const std::string &topic, EndType end_type, int32_t n, double timeout, Callback callback);
+    void peek_range(const std::string &topic, double start_time, double end_time, double timeout, Callback callback);
+    void peek_nearest(const std::string &topic, double timestamp, int32_t k, double timeout, Callback callback);
+    void peek_since(const std::string &topic, uint64_t cursor, int32_t n, double timeout, Callback callback);
+    void peek_batch(const std::vector<BatchSpec> &specs, double timeout, Callback callback);
+    void peek_aligned(const std::vector<std::string> &topics, double timestamp, double timeout, Callback callback);
+
+    // The request data must end with a RequestFlag byte that contains RequestFlag::ACCEPT_CODECS
+    void send_request(ZMQMessage &message, double timeout, Callback callback);
+
+    double get_timestamp();
+    void reset_start_time(int64_t system_time_us);
+    bool zero_copy() const;
+
+  private:
+    struct PendingRequest
+    {
+        CmdType cmd;
+        std::chrono::steady_clock::time_point deadline;
+        Callback callback;
+    };
+
+    // Appends the request flags to the command's arguments
+    static std::string encode_request_data_(const std::string &arguments);
+    void background_loop_();
+    void handle_reply_(std::vector<zmq::message_t> &frames);
+    // Returns the time until the next deadline, capped by the poller timeout
+    std::chrono::milliseconds expire_requests_();
+    void fail_all_requests_(const std::string &reason);
+
+    std::string client_name_;
+    const bool zero_copy_;
+    std::shared_ptr<spdlog::logger> logger_;
+    zmq::context_t context_;
+    zmq::socket_t socket_;
+    // Requests from caller threads are handed to the background thread, which owns the DEALER socket
+    zmq::socket_t request_sender_;
+    zmq::socket_t request_receiver_;
+    std::mutex request_sender_mutex_;
+    const std::chrono::milliseconds poller_timeout_ms_;
+    std::atomic<bool> running_;
+    std::thread background_thread_;
+    std::atomic<uint64_t> next_request_id_;
+    std::mutex pending_requests_mutex_;
+    std::unordered_map<uint64_t, PendingRequest> pending_requests_;
+    int64_t steady_clock_start_time_us_;
+};
@@ -2,35 +2,168 @@
 
 #include <zmq.hpp>
 
+#include "clock_sync.h"
 #include "common.h"
+#include "shm_ring.h"
+#include "topic_registry.h"
 #include "zmq_message.h"
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 class ZMQClient
 {
   public:
-    ZMQClient(const std::string &client_name, const std::string &server_endpoint);
-    ~ZMQClient();
+    // If zero_copy is true, blocks read from the server's shared memory ring reference the ring instead of being
+    // copied out of it, and the Python wrapper returns memoryviews instead of bytes objects.
+    // If shared_memory is true and the server on the same ipc:// endpoint has a shared memory ring, large blocks are
+    // read from the ring instead of the socket. In zero-copy mode they are then views into the ring, which the server
+    // does not overwrite while they are alive; it sends large blocks through the socket instead while the ring is held
+    // up by old views (see ShmRing).
+    // The wire protocol version is negotiated with the server on the first request, up to max_protocol_version
+    // (see zmq_message.h).
+    // Calls from several threads are serialized, one request at a time.
+    // With an inproc:// endpoint, the client attaches to the ZMQServer on that endpoint in the same process, which must
+    // already exist, and reads its topics directly: a read shares the stored blocks instead of copying them through a
+    // socket. request_with_data, synchronize_time and get_server_stats are not available then.
+    ZMQClient(const std::string &client_name, const std::string &server_endpoint, bool zero_copy = false,
+              bool shared_memory = false, uint8_t max_protocol_version = PROTOCOL_V2);
+    virtual ~ZMQClient();
 
-    pybind11::tuple peek_data(const std::string &topic, std::string end_type, int32_t n);
-    pybind11::tuple pop_data(const std::string &topic, std::string end_type, int32_t n);
-    pybind11::tuple get_last_retrieved_data();
+    std::vector<TimedPtr> peek_data(const std::string &topic, EndType end_type, int32_t n);
+    std::vector<TimedPtr> pop_data(const std::string &topic, EndType end_type, int32_t n);
+    // Timestamps are in the server's time base, i.e. the same as the timestamps returned with the data
+    std::vector<TimedPtr> peek_range(const std::string &topic, double start_time, double end_time);
+    std::vector<TimedPtr> peek_nearest(const std::string &topic, double timestamp, int32_t k);
+    // Only the blocks added after the one with sequence number `cursor` (0 for all stored blocks), oldest first.
+    // Pass the returned cursor to the next call. evicted is true if some newer blocks were dropped by the server
+    // before this call could read them.
+    SinceResult peek_since(const std::string &topic, uint64_t cursor, int32_t n);
+    // Several peek_data queries in one round trip. Returns the blocks of every spec.
+    std::vector<std::vector<TimedPtr>> peek_batch(const std::vector<BatchSpec> &specs);
+    // The block nearest to timestamp of every topic, read from one consistent snapshot of the server
+    std::vector<std::vector<TimedPtr>> peek_aligned(const std::vector<std::string> &topics, double timestamp);
+    // Sends data to the request handler of topic (see ZMQServer::set_request_handler) and returns its reply
+    SharedBytes request_with_data(const std::string &topic, const SharedBytes &data);
+    // The blocks of the last reply
+    std::vector<TimedPtr> get_last_retrieved_ptrs() const;
+    bool zero_copy() const;
 
+    // After synchronize_time, timestamps are on the server's clock
     double get_timestamp();
+    // Aligns the client's clock with the wall clock, like the server's. Discards the synchronize_time state.
     void reset_start_time(int64_t system_time_us);
+    // Measures the offset to the server's clock with `samples` round trips (over the existing socket) and makes
+    // get_timestamp follow the server's clock from then on. Calling it periodically also corrects for the drift
+    // between the clocks once the calls span 10s. Returns (offset, uncertainty) in seconds.
+    std::pair<double, double> synchronize_time(int32_t samples);
+    // (offset, uncertainty) in seconds of the last synchronize_time, (0, 0) before the first one
+    std::pair<double, double> get_clock_offset();
+    // The server's counters and latency histograms as JSON, see ZMQServer::stats_json
+    std::string get_server_stats();
+    // The negotiated wire protocol version, 0 before the first request
+    uint8_t protocol_version() const;
+
+    // Keeps a local copy of the topic that a background thread refreshes every `interval` seconds, fetching only the
+    // blocks added since the last refresh. peek_data, peek_range and peek_nearest of the topic are then answered from
+    // the copy without a round trip. The copy drops blocks older than max_remaining_time like a server topic; pop_data
+    // still goes to the server and does not remove blocks from the copy. If the server restarted or dropped blocks
+    // before the copy got them, the copy is fetched again from scratch, so it never has gaps the server's topic does
+    // not have. Mirroring a topic again changes its settings.
+    // Clients attached over inproc:// already read the server's topics directly and do not mirror them.
+    void mirror_topic(const std::string &topic, double max_remaining_time, double interval = 0.01);
+    void unmirror_topic(const std::string &topic);
+    // Seconds since the mirror of topic was last brought up to date with the server, infinity before the first
+    // refresh. It keeps growing while the server does not answer.
+    double get_mirror_staleness(const std::string &topic);
 
   private:
-    std::vector<TimedPtr> deserialize_multiple_data_(const std::string &data);
-    // TimedPtr send_single_block_request_(const ZMQMessage &message);
+    struct Mirror
+    {
+        // Holds the blocks decompressed, as received
+        std::shared_ptr<DataTopic> data_topic;
+        double max_remaining_time;
+        double interval;
+        // Only used by the mirror thread, next_refresh while it holds mirrors_mutex_
+        uint64_t cursor = 0;
+        // Topic handle and server session of version 2 servers, 0 until resolved
+        uint32_t handle = 0;
+        uint32_t session = 0;
+        std::chrono::steady_clock::time_point next_refresh;
+        // steady_clock_us() of the last refresh, 0 before the first one
+        std::atomic<int64_t> refresh_time_us{0};
+    };
+
     std::vector<TimedPtr> send_request_(ZMQMessage &message);
+    // Checks the reply to a request with the command cmd and returns its blocks
+    std::vector<TimedPtr> reply_ptrs_(ZMQMessage &reply_message, CmdType cmd, bool copy_from_shm) const;
+    // Reads the blocks of a topic of the attached local server and decompresses them
+    std::vector<TimedPtr> read_local_(const std::string &topic,
+                                      const std::function<std::vector<TimedPtr>(DataTopic &)> &read);
+    void check_remote_(const std::string &action) const;
+    // Sends the frames and receives the reply frames
+    std::vector<zmq::message_t> exchange_(std::vector<zmq::message_t> &request_frames);
+    std::shared_ptr<Mirror> find_mirror_(const std::string &topic);
+    // Reads the blocks of a mirrored topic
+    std::vector<TimedPtr> read_mirror_(Mirror &mirror, const std::function<std::vector<TimedPtr>(DataTopic &)> &read);
+    void mirror_loop_();
+    // Fetches the blocks added since the last refresh over the mirror thread's socket, or all blocks of the topic if
+    // start_over is true or the copy no longer matches the server's topic. Returns false if the server did not answer
+    // in time, after which the socket has to be replaced.
+    bool refresh_mirror_(zmq::socket_t &socket, const std::string &topic, Mirror &mirror, bool start_over = false);
+    // Sends the request over the mirror thread's socket and receives the reply. Returns false on a timeout.
+    bool exchange_mirror_(zmq::socket_t &socket, ZMQMessage &message, std::vector<zmq::message_t> &reply_frames);
+    void stop_mirroring_();
+    // Negotiates the protocol version on the first call, and encodes the message in it
+    void apply_protocol_(ZMQMessage &message);
+    uint8_t negotiate_protocol_();
+    // Resolves the topic's handle once and caches it, 0 if the server does not store the topic
+    uint32_t topic_handle_(const std::string &topic);
+    std::vector<TimedPtr> request_ptrs_(const std::string &topic, CmdType cmd, EndType end_type,
+                                        const std::string &arguments);
+    // Appends the request flags to the command's arguments
+    std::string encode_request_data_(const std::string &arguments) const;
+    // Time since the start time on the client's own clock
+    double get_local_timestamp_() const;
 
+    // Serializes the use of socket_ and of the request state: the protocol version, topic handles and
+    // last_retrieved_ptrs_
+    mutable std::mutex request_mutex_;
+    // Guards clock_sync_ and steady_clock_start_time_us_. Taken after request_mutex_ when both are needed.
+    mutable std::mutex clock_mutex_;
     std::string client_name_;
+    const bool zero_copy_;
     std::shared_ptr<spdlog::logger> logger_;
     zmq::context_t context_;
     zmq::socket_t socket_;
+    std::shared_ptr<ShmRing> shm_ring_;
+    // Topics of the server on an inproc:// endpoint, nullptr for socket endpoints
+    std::shared_ptr<TopicRegistry> local_topics_;
     std::vector<TimedPtr> last_retrieved_ptrs_;
     int64_t steady_clock_start_time_us_;
+    ClockSync clock_sync_;
+    const uint8_t max_protocol_version_;
+    uint8_t protocol_version_ = 0;
+    // Session of the server that issued the cached topic handles
+    uint32_t session_ = 0;
+    std::unordered_map<std::string, uint32_t> topic_handles_;
+    const std::string server_endpoint_;
+    // Mirrored topics. The mirror thread has its own socket, since a REQ socket cannot be shared between threads.
+    std::mutex mirrors_mutex_;
+    std::condition_variable mirrors_condition_;
+    std::unordered_map<std::string, std::shared_ptr<Mirror>> mirrors_;
+    std::thread mirror_thread_;
+    bool mirror_running_ = false;
+    // Protocol version negotiated over the mirror thread's socket, 0 before. Only used by the mirror thread.
+    uint8_t mirror_protocol_version_ = 0;
 };
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "codec.h"
 #include "common.h"
-#include <pybind11/pybind11.h>
+#include "shm_ring.h"
+#include <memory>
+#include <tuple>
 #include <vector>
 #include <zmq.hpp>
 enum class CmdType : int8_t
@@ -9,11 +12,53 @@ enum class CmdType : int8_t
     PEEK_DATA = 1,
     POP_DATA = 2,
     REQUEST_WITH_DATA = 3,
-    SYNCHRONIZE_TIME = 4,
+    SYNCHRONIZE_TIME = 4, // Reply data: [double receive_time][double send_time] on the server's clock
+    STREAM_DATA = 5,
+    PEEK_RANGE = 6,    // Data: [double start_time][double end_time]
+    PEEK_NEAREST = 7,  // Data: [double timestamp][int32 k]
+    PEEK_BATCH = 8,    // Data: [u32 count] + count * [u8 topic_len][topic][int8 end_type][int32 n]
+    PEEK_ALIGNED = 9,  // Data: [double timestamp][u32 count] + count * [u8 topic_len][topic]
+    PEEK_SINCE = 10,   // Data: [u64 cursor][int32 n]
+    STATS = 11,        // Reply data: one block with the server's counters as JSON, see ZMQServer::stats_json
+    HANDSHAKE = 12,    // Data: [u8 highest protocol version of the client]. Reply data: [u8 protocol version to use]
+    TOPIC_HANDLE = 13, // Reply data: [u32 topic handle][u32 session], handle 0 if the server does not store the topic
     ERROR = -1,
     UNKNOWN = 0,
 };
 
+// Optional trailing byte of PEEK_DATA/POP_DATA/PEEK_RANGE/PEEK_NEAREST/PEEK_BATCH/PEEK_ALIGNED/PEEK_SINCE requests
+enum class RequestFlag : uint8_t
+{
+    NONE = 0,
+    SHARED_MEMORY = 1, // The client has mapped the server's shared memory ring
+    ACCEPT_CODECS = 2, // The client decodes compressed blocks itself, see ZMQMessage::set_block_codecs
+};
+
+bool has_request_flag(RequestFlag flags, RequestFlag flag);
+std::string cmd_type_to_str(CmdType cmd);
+
+// Wire protocol versions. Version 1 messages start with the length-prefixed topic name, the command and the end type,
+// and index blocks with 32-bit lengths. Version 2 messages start with a fixed 24-byte header:
+//   [u8 0][u8 PROTOCOL_V2_MARKER][int8 cmd][int8 end_type][u32 topic handle][u32 session][u8 topic_len][3 reserved]
+//   [double timestamp]
+// followed by the topic name only if the handle is 0, zero-padded to a multiple of 8 bytes. Their block index is
+// [u64 count] + count * [u64 length][double timestamp][u8 codec][7 reserved], and in single-frame messages every
+// block starts 64-byte aligned from the start of the message. Received blocks are views into that message, so they
+// keep this alignment relative to the receive buffer. A version 1 message can only start with 0 for an empty
+// topic, which is followed by a valid command, so the marker tells the versions apart.
+// Clients start with version 1 and switch after a HANDSHAKE; servers reply in the version of the request.
+constexpr uint8_t PROTOCOL_V1 = 1;
+constexpr uint8_t PROTOCOL_V2 = 2;
+constexpr uint8_t PROTOCOL_V2_MARKER = 0x82;
+constexpr size_t PROTOCOL_V2_ALIGNMENT = 64;
+// Topic handles are only valid within the server session they were issued in. Requests with a handle of another
+// session (e.g. after the server restarted) fail with this error, after which clients resolve their handles again.
+constexpr const char *STALE_TOPIC_HANDLE_ERROR = "Stale topic handle";
+
+// Reads the command and topic (or topic handle) of a serialized message of either version without decoding it.
+// Returns false if the header is truncated.
+bool peek_message_header(const char *data, size_t size, CmdType &cmd, std::string &topic, uint32_t &topic_handle);
+
 class ZMQMessage
 {
   public:
@@ -21,16 +66,42 @@ class ZMQMessage
                const std::vector<TimedPtr> &data_ptrs);
     ZMQMessage(const std::string &topic, CmdType cmd, EndType end_type, double timestamp, const std::string &data_str);
     ZMQMessage(const std::string &serialized);
+    // Header and block index in the first frame, followed by one frame per data block
+    ZMQMessage(std::vector<zmq::message_t> &frames);
 
     std::string topic() const;
+    // Version 2 requests may name their topic only by handle, which the server resolves through set_topic
+    void set_topic(const std::string &topic);
     CmdType cmd() const;
     EndType end_type() const;
     double timestamp() const;
     std::vector<TimedPtr> data_ptrs();
     std::string data_str(); // Should avoid using because it may copy a large amount of data
     std::string serialize();
+    // Zero-copy version of serialize(). Each data block is sent as its own frame which references the stored buffer.
+    // If shm_ring is given, large blocks are copied into it and only their descriptors are sent, unless that would
+    // overwrite blocks that clients hold views of.
+    std::vector<zmq::message_t> serialize_multipart(ShmRing *shm_ring = nullptr);
+    // Resolve shared memory descriptors in received frames through this ring
+    void set_shm_ring(std::shared_ptr<const ShmRing> shm_ring, bool copy);
+    // Adds the codec of every block (see codec.h) to the block index. Only for replies to requests with
+    // RequestFlag::ACCEPT_CODECS, since older clients cannot parse this index.
+    void set_block_codecs(const std::vector<Codec> &codecs);
+    // Expects a block index with codecs when decoding, and decompresses the blocks
+    void enable_codec_index();
+    // Encodes the message in the given protocol version. With version 2, a non-zero topic handle replaces the topic
+    // name on the wire.
+    void set_protocol(uint8_t version, uint32_t topic_handle = 0, uint32_t session = 0);
+    uint8_t protocol_version() const;
+    uint32_t topic_handle() const;
+    uint32_t session() const;
 
   private:
+    std::string encode_header_() const;
+    size_t decode_header_(const char *data, size_t size);
+    size_t decode_v2_header_(const char *data, size_t size);
+    std::string encode_block_index_() const;
+    size_t block_index_entry_size_() const;
     void encode_data_blocks_();
     void decode_data_blocks_();
     void check_input_validity_();
@@ -40,4 +111,31 @@ class ZMQMessage
     double timestamp_;
     std::vector<TimedPtr> data_ptrs_;
     std::string data_str_;
+    // First frame of a received message, which single-frame blocks are decoded as views into
+    std::shared_ptr<zmq::message_t> header_frame_;
+    std::vector<std::shared_ptr<zmq::message_t>> payload_frames_;
+    std::shared_ptr<const ShmRing> shm_ring_;
+    bool copy_from_shm_;
+    bool codec_index_ = false;
+    std::vector<Codec> block_codecs_;
+    uint8_t protocol_version_ = PROTOCOL_V1;
+    uint32_t topic_handle_ = 0;
+    uint32_t session_ = 0;
+    // Offset of the data in the single-frame message, which aligns version 2 blocks
+    size_t data_offset_ = 0;
 };
+
+// PEEK_BATCH/PEEK_ALIGNED replies carry the results of several queries in one message. Block 0 is a manifest with
+// the number of blocks of every result ([u32 result_count] + result_count * [u32 block_count]), followed by the
+// blocks of all results in order.
+// (topic, end type, n) of every query in a PEEK_BATCH request
+using BatchSpec = std::tuple<std::string, std::string, int32_t>;
+std::string encode_batch_request(const std::vector<BatchSpec> &specs);
+std::string encode_aligned_request(const std::vector<std::string> &topics, double timestamp);
+std::vector<TimedPtr> join_batch_results(const std::vector<std::vector<TimedPtr>> &results, double timestamp);
+std::vector<std::vector<TimedPtr>> split_batch_results(const std::vector<TimedPtr> &ptrs);
+
+// PEEK_SINCE replies start with a block [u64 cursor][u8 evicted] + block_count * [u64 sequence], followed by the
+// blocks themselves
+std::vector<TimedPtr> join_since_result(const SinceResult &result, double timestamp);
+SinceResult split_since_result(const std::vector<TimedPtr> &ptrs);
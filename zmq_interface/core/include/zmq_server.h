@@ -2,53 +2,222 @@
 
 #include <zmq.hpp>
 
-#include <deque>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <tuple>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "common.h"
 #include "data_topic.h"
+#include "recording.h"
+#include "shm_ring.h"
+#include "stats.h"
+#include "topic_registry.h"
 #include "spdlog/spdlog.h"
 #include "zmq_message.h"
 class ZMQServer
 {
   public:
-    ZMQServer(const std::string &server_name, const std::string &server_endpoint);
-    ~ZMQServer();
-    void add_topic(const std::string &topic, double max_remaining_time);
-    void put_data(const std::string &topic, const PyBytes &data);
-    pybind11::tuple peek_data(const std::string &topic, std::string end_type_str, int n);
-    pybind11::tuple pop_data(const std::string &topic, std::string end_type_str, int n);
+    // Computes the reply to a REQUEST_WITH_DATA request from its payload
+    using RequestHandler = std::function<SharedBytes(const SharedBytes &)>;
+    // (topic, blocks, timestamps), see put_many
+    using TopicBatch = std::tuple<std::string, std::vector<SharedBytes>, std::vector<double>>;
+
+    // If shared_memory_size > 0 (ipc:// endpoints only), large reply blocks are passed to clients on the same host
+    // through a shared memory ring of this many bytes instead of the socket.
+    // If publish_endpoint is not empty, every block passed to put_data is also published there for ZMQSubscribers.
+    // If num_workers > 0, requests are served by a ROUTER frontend and a pool of worker threads. Each request goes to
+    // an idle worker, so a large reply does not block other clients while a worker is free. An additional worker
+    // serves time synchronization, stats and topics marked with set_topic_priority.
+    // A server on an inproc:// endpoint serves no socket: ZMQClients in the same process attach to its topics and
+    // read the stored blocks directly, without serializing them (see ZMQClient).
+    ZMQServer(const std::string &server_name, const std::string &server_endpoint, size_t shared_memory_size = 0,
+              const std::string &publish_endpoint = "", int num_workers = 0);
+    virtual ~ZMQServer();
+    // Stops serving requests and joins the background threads. Called by the destructor.
+    void stop();
+    // If capacity > 0, the topic keeps at most this many blocks in a preallocated ring buffer that can be read
+    // without blocking the producer. max_bytes and max_count limit the stored payload size and block count
+    // (0 means unlimited).
+    // codec is one of "none", "lz4" and "shuffle_lz4". Blocks are compressed once in put_data and sent compressed
+    // to clients; shuffle_lz4 groups the bytes of element_size-byte numbers first, which suits float arrays.
+    // Returns the topic's handle, which version 2 clients use instead of its name (see zmq_message.h).
+    uint32_t add_topic(const std::string &topic, double max_remaining_time, size_t capacity = 0, size_t max_bytes = 0,
+                       size_t max_count = 0, const std::string &codec = "none", int element_size = 4);
+    // Stores the block with the current timestamp. The block's memory is shared, not copied.
+    void put_data(const std::string &topic, const SharedBytes &data);
+    // Stores the block with the given timestamp, e.g. from the hardware. The timestamps of a topic must all be on the
+    // same clock, which may differ from the server's: blocks expire max_remaining_time after the topic's newest
+    // timestamp, which keeps advancing with the time since the newest block was added (see DataTopic::expire_data).
+    // A block older than the topic's latest one is inserted at its place in time, and readers polling with
+    // peek_since still get it.
+    void put_data(const std::string &topic, const SharedBytes &data, double timestamp);
+    // Stores the blocks with one acquisition of the topic's lock and one eviction pass. timestamps has one entry per
+    // block, or is empty to give every block the current timestamp.
+    void put_many(const std::string &topic, const std::vector<SharedBytes> &data,
+                  const std::vector<double> &timestamps = {});
+    // put_many for several topics, checking the memory limit once after all of them
+    void put_many(const std::vector<TopicBatch> &batches);
+    // The n earliest or latest blocks (n < 0 returns all), decompressed
+    std::vector<TimedPtr> peek_data(const std::string &topic, EndType end_type, int32_t n);
+    std::vector<TimedPtr> pop_data(const std::string &topic, EndType end_type, int32_t n);
+    // Blocks with start_time <= timestamp <= end_time
+    std::vector<TimedPtr> peek_range(const std::string &topic, double start_time, double end_time);
+    // The k blocks closest to timestamp (k < 0 returns all), in chronological order
+    std::vector<TimedPtr> peek_nearest(const std::string &topic, double timestamp, int32_t k);
+    // The oldest n blocks (n < 0 returns all) newer than cursor, see DataTopic::peek_since_ptrs
+    SinceResult peek_since(const std::string &topic, uint64_t cursor, int32_t n);
     double get_timestamp();
     void reset_start_time(int64_t system_time_us);
+    void set_topic_priority(const std::string &topic, bool priority);
+    // Caps the payload bytes stored across all topics (0 means unlimited). When exceeded, the oldest blocks of any
+    // topic are evicted first.
+    void set_memory_limit(size_t max_bytes);
 
-    // void set_request_with_data_handler(std::function<PyBytes(const PyBytes)> handler);
+    // Serves REQUEST_WITH_DATA requests for topic, so that clients receive only the result instead of the data it
+    // is computed from. The topic does not need to hold data. Handlers run on the worker threads, so that a slow
+    // handler never stalls the thread that receives requests, and must be thread-safe. Throws if the server has no
+    // workers (num_workers == 0). Exceptions are sent back to the client as errors.
+    void set_request_handler(const std::string &topic, RequestHandler handler);
+    void remove_request_handler(const std::string &topic);
     std::unordered_map<std::string, int> get_topic_status();
+    std::unordered_map<std::string, size_t> get_topic_bytes();
+    // Counters since the server started, as a JSON object: request counts by command, errors, the time requests spent
+    // queued for a worker (num_workers > 0 only), being processed and being serialized, and the puts, pops,
+    // evictions and lock wait times of every topic. Clients get the same with a STATS request.
+    std::string stats_json();
+
+    // Records every block put into the topics into directory (see recording.h), replacing the current recording.
+    // Blocks are written by a background thread, so put_data only queues them. They are recorded in the order they
+    // were put, so blocks put out of order make the recording's time searches unreliable.
+    void start_recording(const std::string &directory, const std::vector<std::string> &topics);
+    // Writes the queued blocks and closes the recording
+    void stop_recording();
+    // Puts the blocks recorded in directory with start_time <= timestamp <= end_time back into their topics, in
+    // timestamp order and with their recorded timestamps, from a background thread. speed scales the recorded pace
+    // (speed <= 0 replays as fast as possible). The topics must already be added. The server clock is left alone, so
+    // live producers and synced clients are unaffected; replayed topics expire relative to their newest block.
+    void replay(const std::string &directory, double speed = 1.0,
+                double start_time = std::numeric_limits<double>::lowest(),
+                double end_time = std::numeric_limits<double>::max());
+    void stop_replay();
+    bool is_replaying();
+
+  protected:
+    // Throws std::invalid_argument if a request handler cannot be set for topic
+    void check_request_handler_(const std::string &topic) const;
 
   private:
     const std::string server_name_;
-    bool running_;
-    bool request_with_data_handler_initialized_;
-    int64_t steady_clock_start_time_us_;
+    std::atomic<bool> running_;
+    std::atomic<int64_t> steady_clock_start_time_us_;
     zmq::context_t context_;
     zmq::socket_t socket_;
-    zmq::pollitem_t poller_item_;
     const std::chrono::milliseconds poller_timeout_ms_;
+    const int num_workers_;
+    zmq::socket_t worker_backend_;
+    zmq::socket_t priority_backend_;
+    std::vector<std::thread> worker_threads_;
+    std::mutex priority_topics_mutex_;
+    std::unordered_set<std::string> priority_topics_;
+    std::unique_ptr<ShmRing> shm_ring_;
+    std::unique_ptr<zmq::socket_t> publisher_;
+    std::mutex publisher_mutex_;
     std::thread background_thread_;
-    std::mutex data_topic_mutex_;
+    // Drops expired blocks of topics that stopped receiving data
+    std::thread expiry_thread_;
+    std::mutex expiry_mutex_;
+    std::condition_variable expiry_condition_;
+    const std::chrono::milliseconds expiry_interval_ms_;
+    std::atomic<size_t> memory_limit_;
+    std::mutex eviction_mutex_;
+    std::atomic<bool> eviction_requested_{false};
 
-    std::unordered_map<std::string, DataTopic> data_topics_;
+    std::shared_ptr<TopicRegistry> topic_registry_;
+    // The inproc:// endpoint the topics are registered under, empty for socket endpoints
+    std::string local_endpoint_;
+    // Identifies this server instance in topic handles, so that handles from a previous instance are rejected
+    const uint32_t session_id_;
     std::shared_ptr<spdlog::logger> logger_;
 
-    void process_request_(ZMQMessage &message);
+    static constexpr size_t CMD_TYPE_NUM = 14;
+    // Indexed by command; unknown commands are counted as UNKNOWN
+    std::array<std::atomic<uint64_t>, CMD_TYPE_NUM> request_counts_{};
+    std::atomic<uint64_t> error_count_{0};
+    LatencyHistogram queue_latency_;
+    LatencyHistogram process_latency_;
+    LatencyHistogram serialize_latency_;
+    const int64_t stats_start_time_us_ = steady_clock_us();
+
+    // received_time_us is the steady_clock_us() at which the request was received from the client
+    void process_request_(ZMQMessage &message, zmq::socket_t &socket, int64_t received_time_us);
+    // Replies in the protocol version of the request
+    void send_error_(zmq::socket_t &socket, const ZMQMessage &request, const std::string &error_message);
+    // codecs are only used if the request flag contains RequestFlag::ACCEPT_CODECS
+    void send_data_reply_(zmq::socket_t &socket, ZMQMessage &message, const std::vector<TimedPtr> &ptrs,
+                          RequestFlag flag, const std::vector<Codec> &codecs);
+    // Parses a PEEK_BATCH/PEEK_ALIGNED request. Throws std::invalid_argument for malformed requests.
+    std::vector<std::vector<TimedPtr>> peek_batch_ptrs_(CmdType cmd, const std::string &data_str, RequestFlag &flag,
+                                                        std::vector<Codec> &codecs);
+    // Sends the reply to the request being processed, after the client envelope when a worker processes it
+    static void send_reply_(zmq::socket_t &socket, std::vector<zmq::message_t> &frames);
+    static void send_reply_(zmq::socket_t &socket, const std::string &reply_data);
+    static void send_multipart_(zmq::socket_t &socket, std::vector<zmq::message_t> &frames);
+    static std::vector<zmq::message_t> recv_multipart_(zmq::socket_t &socket);
+    void enforce_memory_limit_();
+    // Evicts the oldest blocks of all topics until the memory limit holds. The caller holds eviction_mutex_.
+    void evict_to_memory_limit_();
+    void expiry_loop_();
+    void publish_data_(const std::string &topic, const SharedBytes &data_ptr, double timestamp);
+    void put_data_(const std::string &topic, const SharedBytes &data_ptr, double timestamp);
+    // put_many without the memory limit check
+    void put_batch_(const std::string &topic, const std::vector<SharedBytes> &data,
+                    const std::vector<double> &timestamps);
+
+    // Read and replaced with std::atomic_load/store; recording_ spares put_data the load when not recording
+    std::shared_ptr<Recorder> recorder_;
+    std::atomic<bool> recording_{false};
+    std::thread replay_thread_;
+    std::mutex replay_mutex_;
+    std::condition_variable replay_condition_;
+    bool replay_stopping_ = false;
+    std::atomic<bool> replaying_{false};
+    void replay_loop_(std::shared_ptr<const RecordingReader> reader, double speed, double start_time, double end_time);
+
+    std::shared_ptr<DataTopic> find_topic_(const std::string &topic, const std::string &action);
+    // Return nothing for unknown (nullptr) topics
+    std::vector<TimedPtr> peek_data_ptrs_(const std::shared_ptr<DataTopic> &data_topic, EndType end_type, int32_t n,
+                                          std::vector<Codec> *codecs = nullptr);
+    std::vector<TimedPtr> pop_data_ptrs_(const std::shared_ptr<DataTopic> &data_topic, EndType end_type, int32_t n,
+                                         std::vector<Codec> *codecs = nullptr);
+    std::vector<TimedPtr> peek_range_ptrs_(const std::shared_ptr<DataTopic> &data_topic, double start_time,
+                                           double end_time, std::vector<Codec> *codecs = nullptr);
+    std::vector<TimedPtr> peek_nearest_ptrs_(const std::shared_ptr<DataTopic> &data_topic, double timestamp, int32_t k,
+                                             std::vector<Codec> *codecs = nullptr);
+    SinceResult peek_since_ptrs_(const std::shared_ptr<DataTopic> &data_topic, uint64_t cursor, int32_t n,
+                                 std::vector<Codec> *codecs = nullptr);
 
-    std::vector<TimedPtr> peek_data_ptrs_(const std::string &topic, EndType end_type, int32_t n);
-    std::vector<TimedPtr> pop_data_ptrs_(const std::string &topic, EndType end_type, int32_t n);
+    std::mutex request_handlers_mutex_;
+    std::unordered_map<std::string, std::shared_ptr<RequestHandler>> request_handlers_;
 
-    std::function<TimedPtr(const TimedPtr)> request_with_data_handler_;
+    void process_request_with_data_(ZMQMessage &message, zmq::socket_t &socket);
 
-    void background_loop_();
+    // Serves the REP socket when the server has no workers
+    void serve_loop_(zmq::socket_t &socket);
+    // Requests forwarded by frontend_loop_ are stamped with the time they were received
+    void handle_request_(std::vector<zmq::message_t> &frames, zmq::socket_t &socket, bool stamped);
+    // Serves the requests that frontend_loop_ dispatches to it over a REQ socket, which announces the worker as idle
+    // when it connects and with every reply
+    void worker_loop_(const std::string &backend_endpoint);
+    void frontend_loop_();
+    bool is_priority_request_(const std::vector<zmq::message_t> &frames);
 };
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <zmq.hpp>
+
+#include "common.h"
+#include "zmq_message.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Receives the blocks a ZMQServer publishes in put_data, so consumers do not have to poll peek_data
+class ZMQSubscriber
+{
+  public:
+    ZMQSubscriber(const std::string &subscriber_name, const std::string &publisher_endpoint, bool zero_copy = false);
+    virtual ~ZMQSubscriber();
+    // Stops receiving. Called by the destructor.
+    void close();
+
+    // Received blocks are queued until popped. With conflate, only the latest block is kept; otherwise the oldest
+    // blocks are dropped once queue_size is exceeded.
+    void subscribe(const std::string &topic, int32_t queue_size, bool conflate);
+    void unsubscribe(const std::string &topic);
+    // Called on the receiving thread for every new block of the topic, in addition to queueing it
+    void set_callback(const std::string &topic, std::function<void(const SharedBytes &, double)> callback);
+
+    // Waits up to timeout seconds for data, then pops the n earliest queued blocks (all if n < 0)
+    std::vector<TimedPtr> pop_data(const std::string &topic, int32_t n, double timeout);
+    bool zero_copy() const;
+
+  private:
+    struct Subscription
+    {
+        size_t queue_size;
+        std::deque<TimedPtr> queue;
+        std::shared_ptr<std::function<void(const SharedBytes &, double)>> callback;
+    };
+
+    void background_loop_();
+    void apply_pending_subscriptions_();
+    static std::string topic_filter_(const std::string &topic);
+
+    std::string subscriber_name_;
+    const bool zero_copy_;
+    std::shared_ptr<spdlog::logger> logger_;
+    zmq::context_t context_;
+    zmq::socket_t socket_;
+    const std::chrono::milliseconds poller_timeout_ms_;
+    std::atomic<bool> running_;
+    std::thread background_thread_;
+
+    std::mutex subscription_mutex_;
+    std::condition_variable data_condition_;
+    std::unordered_map<std::string, Subscription> subscriptions_;
+    // Filters to add (true) or remove (false) on the socket, which only the background thread may touch
+    std::vector<std::pair<std::string, bool>> pending_filters_;
+};
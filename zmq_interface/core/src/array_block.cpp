@@ -0,0 +1,170 @@
+#include "array_block.h"
+#include <cstring>
+#include <stdexcept>
+
+static const char ARRAY_BLOCK_MAGIC[4] = {'Z', 'I', 'A', '1'};
+static constexpr size_t ARRAY_HEADER_SIZE = sizeof(ARRAY_BLOCK_MAGIC) + 2 * sizeof(uint8_t) + sizeof(uint16_t);
+static constexpr size_t ARRAY_DATA_ALIGNMENT = 64;
+
+static bool has_strides(const std::vector<pybind11::ssize_t> &shape, const std::vector<pybind11::ssize_t> &strides,
+                        pybind11::ssize_t itemsize, bool fortran)
+{
+    pybind11::ssize_t expected = itemsize;
+    for (size_t i = 0; i < shape.size(); i++)
+    {
+        size_t dim = fortran ? i : shape.size() - 1 - i;
+        // Strides of dimensions with a single element are never used
+        if (shape[dim] > 1 && strides[dim] != expected)
+        {
+            return false;
+        }
+        expected *= shape[dim];
+    }
+    return true;
+}
+
+static void gather(const char *src, char *&dst, size_t dim, const std::vector<pybind11::ssize_t> &shape,
+                   const std::vector<pybind11::ssize_t> &strides, size_t itemsize)
+{
+    for (pybind11::ssize_t i = 0; i < shape[dim]; i++)
+    {
+        const char *item = src + i * strides[dim];
+        if (dim + 1 == shape.size())
+        {
+            std::memcpy(dst, item, itemsize);
+            dst += itemsize;
+        }
+        else
+        {
+            gather(item, dst, dim + 1, shape, strides, itemsize);
+        }
+    }
+}
+
+SharedBytes encode_array_block(const pybind11::object &array)
+{
+    // numpy.asarray does not copy buffer-protocol objects, and normalizes their format into a dtype string
+    pybind11::object ndarray = pybind11::module_::import("numpy").attr("asarray")(array);
+    pybind11::object dtype_object = ndarray.attr("dtype");
+    // Object arrays hold pointers into this process, and dtype.str does not describe the fields of structured dtypes
+    if (dtype_object.attr("hasobject").cast<bool>())
+    {
+        throw std::invalid_argument("Arrays of Python objects cannot be stored");
+    }
+    if (!dtype_object.attr("names").is_none())
+    {
+        throw std::invalid_argument("Arrays with a structured dtype cannot be stored");
+    }
+    std::string dtype = dtype_object.attr("str").cast<std::string>();
+    pybind11::buffer_info info = ndarray.cast<pybind11::buffer>().request();
+    if (dtype.size() > UINT8_MAX)
+    {
+        throw std::invalid_argument("Unsupported dtype: " + dtype);
+    }
+
+    std::vector<pybind11::ssize_t> shape = info.shape;
+    std::vector<pybind11::ssize_t> strides = info.strides;
+    size_t ndim = shape.size();
+    size_t nbytes = info.itemsize;
+    for (pybind11::ssize_t extent : shape)
+    {
+        nbytes *= extent;
+    }
+    bool c_contiguous = has_strides(shape, strides, info.itemsize, false);
+    bool contiguous = c_contiguous || has_strides(shape, strides, info.itemsize, true);
+    if (!contiguous)
+    {
+        pybind11::ssize_t stride = info.itemsize;
+        for (size_t i = ndim; i-- > 0;)
+        {
+            strides[i] = stride;
+            stride *= shape[i];
+        }
+    }
+
+    size_t header_size = ARRAY_HEADER_SIZE + dtype.size() + 2 * ndim * sizeof(int64_t);
+    size_t data_offset = (header_size + ARRAY_DATA_ALIGNMENT - 1) / ARRAY_DATA_ALIGNMENT * ARRAY_DATA_ALIGNMENT;
+    std::string block(data_offset + nbytes, '\0');
+    char *header = &block[0];
+    std::memcpy(header, ARRAY_BLOCK_MAGIC, sizeof(ARRAY_BLOCK_MAGIC));
+    header[4] = static_cast<char>(ndim);
+    header[5] = static_cast<char>(dtype.size());
+    uint16_t offset = static_cast<uint16_t>(data_offset);
+    std::memcpy(header + 6, &offset, sizeof(offset));
+    header += ARRAY_HEADER_SIZE;
+    std::memcpy(header, dtype.data(), dtype.size());
+    header += dtype.size();
+    for (size_t i = 0; i < ndim; i++)
+    {
+        int64_t extent = shape[i];
+        std::memcpy(header + i * sizeof(int64_t), &extent, sizeof(int64_t));
+        int64_t stride = strides[i];
+        std::memcpy(header + (ndim + i) * sizeof(int64_t), &stride, sizeof(int64_t));
+    }
+
+    char *data = &block[data_offset];
+    if (contiguous)
+    {
+        if (nbytes > 0)
+        {
+            std::memcpy(data, info.ptr, nbytes);
+        }
+    }
+    else
+    {
+        gather(static_cast<const char *>(info.ptr), data, 0, shape, info.strides, info.itemsize);
+    }
+    return SharedBytes(std::move(block));
+}
+
+bool is_array_block(const SharedBytes &block)
+{
+    return block.size() >= ARRAY_HEADER_SIZE &&
+           std::memcmp(block.data(), ARRAY_BLOCK_MAGIC, sizeof(ARRAY_BLOCK_MAGIC)) == 0;
+}
+
+pybind11::object array_block_to_ndarray(const SharedBytes &block)
+{
+    if (!is_array_block(block))
+    {
+        throw std::invalid_argument("Block does not contain an array. Was it added with put_array?");
+    }
+    const char *header = block.data();
+    size_t ndim = static_cast<uint8_t>(header[4]);
+    size_t dtype_size = static_cast<uint8_t>(header[5]);
+    uint16_t data_offset;
+    std::memcpy(&data_offset, header + 6, sizeof(data_offset));
+    if (ARRAY_HEADER_SIZE + dtype_size + 2 * ndim * sizeof(int64_t) > data_offset || data_offset > block.size())
+    {
+        throw std::invalid_argument("Array block has an invalid header");
+    }
+    header += ARRAY_HEADER_SIZE;
+    std::string dtype(header, dtype_size);
+    header += dtype_size;
+    pybind11::tuple shape(ndim);
+    pybind11::tuple strides(ndim);
+    for (size_t i = 0; i < ndim; i++)
+    {
+        int64_t extent;
+        std::memcpy(&extent, header + i * sizeof(int64_t), sizeof(int64_t));
+        shape[i] = pybind11::int_(extent);
+        int64_t stride;
+        std::memcpy(&stride, header + (ndim + i) * sizeof(int64_t), sizeof(int64_t));
+        strides[i] = pybind11::int_(stride);
+    }
+    // The SharedBytes buffer is read-only, so is the array. numpy checks that the data fit into the block.
+    return pybind11::module_::import("numpy").attr("ndarray")(shape, pybind11::str(dtype), pybind11::cast(block),
+                                                              data_offset, strides);
+}
+
+pybind11::tuple array_ptrs_to_tuple(const std::vector<TimedPtr> &ptrs)
+{
+    pybind11::list arrays;
+    pybind11::list timestamps;
+    for (const TimedPtr &ptr : ptrs)
+    {
+        arrays.append(array_block_to_ndarray(std::get<0>(ptr)));
+        timestamps.append(std::get<1>(ptr));
+    }
+    return pybind11::make_tuple(arrays, timestamps);
+}
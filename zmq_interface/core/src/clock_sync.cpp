@@ -0,0 +1,112 @@
+#include "clock_sync.h"
+#include <algorithm>
+#include <stdexcept>
+
+ClockSync::ClockSync(size_t history_size) : history_size_(history_size)
+{
+    if (history_size == 0)
+    {
+        throw std::invalid_argument("History size must be positive");
+    }
+    reset();
+}
+
+void ClockSync::add_sample(double t0, double t1, double t2, double t3)
+{
+    double delay = (t3 - t0) - (t2 - t1);
+    if (delay < 0)
+    {
+        // Only possible if a clock jumped during the exchange
+        return;
+    }
+    samples_.push_back(Sample{(t0 + t3) / 2, ((t1 - t0) + (t2 - t3)) / 2, delay});
+}
+
+bool ClockSync::update()
+{
+    if (samples_.empty())
+    {
+        return false;
+    }
+    // Queueing only ever delays a message, so the fastest quarter of the exchanges is the most symmetric
+    std::sort(samples_.begin(), samples_.end(), [](const Sample &a, const Sample &b) { return a.delay < b.delay; });
+    size_t kept = std::max<size_t>(1, samples_.size() / 4);
+    std::vector<Sample> best(samples_.begin(), samples_.begin() + kept);
+    samples_.clear();
+    std::sort(best.begin(), best.end(), [](const Sample &a, const Sample &b) { return a.offset < b.offset; });
+    const Sample &median = best[kept / 2];
+    uncertainty_ = 0;
+    for (const Sample &sample : best)
+    {
+        uncertainty_ = std::max(uncertainty_, sample.delay / 2);
+    }
+
+    history_.emplace_back(median.local_time, median.offset);
+    while (history_.size() > history_size_)
+    {
+        history_.pop_front();
+    }
+    reference_time_ = median.local_time;
+    reference_offset_ = median.offset;
+    drift_ = 0;
+    if (history_.back().first - history_.front().first >= MIN_DRIFT_SPAN)
+    {
+        // Least squares line through the offsets, evaluated at the latest round
+        double mean_time = 0;
+        double mean_offset = 0;
+        for (const auto &point : history_)
+        {
+            mean_time += point.first;
+            mean_offset += point.second;
+        }
+        mean_time /= history_.size();
+        mean_offset /= history_.size();
+        double covariance = 0;
+        double variance = 0;
+        for (const auto &point : history_)
+        {
+            covariance += (point.first - mean_time) * (point.second - mean_offset);
+            variance += (point.first - mean_time) * (point.first - mean_time);
+        }
+        drift_ = covariance / variance;
+        reference_offset_ = mean_offset + drift_ * (reference_time_ - mean_time);
+    }
+    synchronized_ = true;
+    return true;
+}
+
+void ClockSync::reset()
+{
+    samples_.clear();
+    history_.clear();
+    synchronized_ = false;
+    reference_time_ = 0;
+    reference_offset_ = 0;
+    drift_ = 0;
+    uncertainty_ = 0;
+}
+
+bool ClockSync::synchronized() const
+{
+    return synchronized_;
+}
+
+double ClockSync::offset(double local_time) const
+{
+    return reference_offset_ + drift_ * (local_time - reference_time_);
+}
+
+double ClockSync::to_remote(double local_time) const
+{
+    return local_time + offset(local_time);
+}
+
+double ClockSync::uncertainty() const
+{
+    return uncertainty_;
+}
+
+double ClockSync::drift() const
+{
+    return drift_;
+}
@@ -0,0 +1,160 @@
+#include "codec.h"
+#include <cstring>
+#include <lz4.h>
+#include <memory>
+#include <stdexcept>
+
+static constexpr size_t ENCODED_HEADER_SIZE = sizeof(uint8_t) + sizeof(uint8_t) + sizeof(uint64_t);
+
+Codec str_to_codec(const std::string &codec)
+{
+    if (codec == "none")
+    {
+        return Codec::NONE;
+    }
+    if (codec == "lz4")
+    {
+        return Codec::LZ4;
+    }
+    if (codec == "shuffle_lz4")
+    {
+        return Codec::SHUFFLE_LZ4;
+    }
+    throw std::invalid_argument("Invalid codec: " + codec + ". Should be one of none, lz4, shuffle_lz4");
+}
+
+std::string codec_to_str(Codec codec)
+{
+    switch (codec)
+    {
+    case Codec::NONE:
+        return "none";
+    case Codec::LZ4:
+        return "lz4";
+    case Codec::SHUFFLE_LZ4:
+        return "shuffle_lz4";
+    }
+    throw std::invalid_argument("Invalid codec: " + std::to_string(static_cast<int>(codec)));
+}
+
+// Groups byte k of every element together, which makes slowly varying numbers compress much better
+static void shuffle_bytes(const char *src, char *dst, size_t size, size_t element_size)
+{
+    size_t element_num = size / element_size;
+    for (size_t i = 0; i < element_num; i++)
+    {
+        for (size_t k = 0; k < element_size; k++)
+        {
+            dst[k * element_num + i] = src[i * element_size + k];
+        }
+    }
+    std::memcpy(dst + element_num * element_size, src + element_num * element_size, size % element_size);
+}
+
+static void unshuffle_bytes(const char *src, char *dst, size_t size, size_t element_size)
+{
+    size_t element_num = size / element_size;
+    for (size_t i = 0; i < element_num; i++)
+    {
+        for (size_t k = 0; k < element_size; k++)
+        {
+            dst[i * element_size + k] = src[k * element_num + i];
+        }
+    }
+    std::memcpy(dst + element_num * element_size, src + element_num * element_size, size % element_size);
+}
+
+static std::string encode_header(Codec codec, uint8_t element_size, uint64_t raw_size)
+{
+    std::string header;
+    header.push_back(static_cast<char>(codec));
+    header.push_back(static_cast<char>(element_size));
+    header.append(uint64_to_bytes(raw_size));
+    return header;
+}
+
+SharedBytes encode_block(const SharedBytes &data, Codec codec, uint8_t element_size)
+{
+    if (codec != Codec::NONE && data.size() > 0 && data.size() <= LZ4_MAX_INPUT_SIZE)
+    {
+        const char *src = data.data();
+        std::unique_ptr<char[]> shuffled;
+        if (codec == Codec::SHUFFLE_LZ4 && element_size > 1)
+        {
+            shuffled.reset(new char[data.size()]);
+            shuffle_bytes(data.data(), shuffled.get(), data.size(), element_size);
+            src = shuffled.get();
+        }
+        std::string encoded = encode_header(codec, element_size, data.size());
+        encoded.resize(ENCODED_HEADER_SIZE + LZ4_compressBound(data.size()));
+        int compressed_size = LZ4_compress_default(src, &encoded[ENCODED_HEADER_SIZE], data.size(),
+                                                   encoded.size() - ENCODED_HEADER_SIZE);
+        if (compressed_size > 0 && static_cast<size_t>(compressed_size) < data.size())
+        {
+            encoded.resize(ENCODED_HEADER_SIZE + compressed_size);
+            encoded.shrink_to_fit();
+            return SharedBytes(std::move(encoded));
+        }
+    }
+    std::string encoded = encode_header(Codec::NONE, 1, data.size());
+    encoded.append(data.data(), data.size());
+    return SharedBytes(std::move(encoded));
+}
+
+Codec encoded_block_codec(const SharedBytes &encoded)
+{
+    if (encoded.size() < ENCODED_HEADER_SIZE)
+    {
+        throw std::invalid_argument("Encoded block is shorter than its header");
+    }
+    return static_cast<Codec>(encoded.data()[0]);
+}
+
+SharedBytes decode_block(const SharedBytes &encoded)
+{
+    Codec codec = encoded_block_codec(encoded);
+    uint8_t element_size = static_cast<uint8_t>(encoded.data()[1]);
+    uint64_t raw_size = bytes_to_uint64(std::string(encoded.data() + 2, sizeof(uint64_t)));
+    const char *payload = encoded.data() + ENCODED_HEADER_SIZE;
+    size_t payload_size = encoded.size() - ENCODED_HEADER_SIZE;
+    if (codec == Codec::NONE)
+    {
+        if (payload_size != raw_size)
+        {
+            throw std::invalid_argument("Uncompressed block size does not match its header");
+        }
+        return SharedBytes(encoded.owner(), payload, payload_size);
+    }
+    if (codec != Codec::LZ4 && codec != Codec::SHUFFLE_LZ4)
+    {
+        throw std::invalid_argument("Unknown codec " + std::to_string(static_cast<int>(codec)));
+    }
+    if (raw_size > LZ4_MAX_INPUT_SIZE)
+    {
+        throw std::invalid_argument("Compressed block is too large");
+    }
+    std::shared_ptr<std::string> raw = std::make_shared<std::string>(raw_size, '\0');
+    int decompressed_size = LZ4_decompress_safe(payload, &(*raw)[0], payload_size, raw_size);
+    if (decompressed_size < 0 || static_cast<uint64_t>(decompressed_size) != raw_size)
+    {
+        throw std::invalid_argument("Failed to decompress block");
+    }
+    if (codec == Codec::SHUFFLE_LZ4 && element_size > 1)
+    {
+        std::shared_ptr<std::string> unshuffled = std::make_shared<std::string>(raw_size, '\0');
+        unshuffle_bytes(raw->data(), &(*unshuffled)[0], raw_size, element_size);
+        raw = std::move(unshuffled);
+    }
+    const char *raw_data = raw->data();
+    return SharedBytes(std::move(raw), raw_data, raw_size);
+}
+
+SharedBytes strip_block(const SharedBytes &encoded, Codec &codec)
+{
+    codec = encoded_block_codec(encoded);
+    if (codec == Codec::NONE)
+    {
+        return decode_block(encoded);
+    }
+    return encoded;
+}
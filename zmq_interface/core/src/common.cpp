@@ -11,6 +11,66 @@ int64_t system_clock_us()
         .count();
 }
 
+SharedBytes::SharedBytes() : owner_(), data_(nullptr), size_(0)
+{
+}
+
+SharedBytes::SharedBytes(std::string data)
+{
+    std::shared_ptr<const std::string> str = std::make_shared<const std::string>(std::move(data));
+    data_ = str->data();
+    size_ = str->size();
+    owner_ = std::move(str);
+}
+
+SharedBytes::SharedBytes(const char *data, size_t size) : SharedBytes(std::string(data, size))
+{
+}
+
+SharedBytes::SharedBytes(std::shared_ptr<const void> owner, const char *data, size_t size)
+    : owner_(std::move(owner)), data_(data), size_(size)
+{
+}
+
+const char *SharedBytes::data() const
+{
+    return data_;
+}
+
+size_t SharedBytes::size() const
+{
+    return size_;
+}
+
+bool SharedBytes::empty() const
+{
+    return size_ == 0;
+}
+
+std::string SharedBytes::str() const
+{
+    return std::string(data_, size_);
+}
+
+const std::shared_ptr<const void> &SharedBytes::owner() const
+{
+    return owner_;
+}
+
+std::string uint64_to_bytes(uint64_t value)
+{
+    return std::string(reinterpret_cast<const char *>(&value), sizeof(uint64_t));
+}
+
+uint64_t bytes_to_uint64(const std::string &bytes)
+{
+    if (bytes.size() != sizeof(uint64_t))
+    {
+        throw std::invalid_argument("Input bytes must have the same size as an unsigned 64-bit integer");
+    }
+    return *reinterpret_cast<const uint64_t *>(bytes.data());
+}
+
 std::string uint32_to_bytes(uint32_t value)
 {
     return std::string(reinterpret_cast<const char *>(&value), sizeof(uint32_t));
@@ -1,22 +1,61 @@
 #include "data_topic.h"
+#include <algorithm>
 
-DataTopic::DataTopic(const std::string &topic_name, double max_remaining_time)
-    : max_remaining_time_(max_remaining_time), topic_name_(topic_name)
+DataTopic::DataTopic(const std::string &topic_name, double max_remaining_time, size_t capacity, size_t max_bytes,
+                     size_t max_count, Codec codec, uint8_t element_size)
+    : max_remaining_time_(max_remaining_time), topic_name_(topic_name), max_bytes_(max_bytes), max_count_(max_count),
+      codec_(codec), element_size_(element_size), bytes_(0), next_sequence_(1)
 {
     data_.clear();
+    if (capacity > 0)
+    {
+        ring_ = std::make_unique<TimedRing>(capacity);
+    }
 }
 
-void DataTopic::add_data_ptr(const PyBytesPtr data_ptr, double timestamp)
+void DataTopic::add_data_ptr(const SharedBytes data_ptr, double timestamp)
 {
-    data_.push_back({data_ptr, timestamp});
-    while (!data_.empty() && timestamp - std::get<1>(data_.front()) > max_remaining_time_)
+    // Compress before taking the lock, so that readers are not blocked by it
+    SharedBytes stored_ptr = codec_ != Codec::NONE ? encode_block(data_ptr, codec_, element_size_) : data_ptr;
+    std::unique_lock<std::mutex> lock = lock_();
+    puts_.fetch_add(1, std::memory_order_relaxed);
+    put_bytes_.fetch_add(data_ptr.size(), std::memory_order_relaxed);
+    insert_ordered_(stored_ptr, timestamp);
+    evict_();
+}
+
+void DataTopic::add_data_ptrs(const std::vector<TimedPtr> &ptrs)
+{
+    if (ptrs.empty())
     {
-        data_.pop_front();
+        return;
     }
+    std::vector<TimedPtr> stored_ptrs;
+    stored_ptrs.reserve(ptrs.size());
+    size_t put_bytes = 0;
+    for (const auto &[data_ptr, timestamp] : ptrs)
+    {
+        stored_ptrs.emplace_back(codec_ != Codec::NONE ? encode_block(data_ptr, codec_, element_size_) : data_ptr,
+                                 timestamp);
+        put_bytes += data_ptr.size();
+    }
+    std::unique_lock<std::mutex> lock = lock_();
+    puts_.fetch_add(ptrs.size(), std::memory_order_relaxed);
+    put_bytes_.fetch_add(put_bytes, std::memory_order_relaxed);
+    for (const auto &[data_ptr, timestamp] : stored_ptrs)
+    {
+        insert_ordered_(data_ptr, timestamp);
+    }
+    evict_();
 }
 
 std::vector<TimedPtr> DataTopic::peek_data_ptrs(EndType end_type, int32_t n)
 {
+    if (ring_ != nullptr)
+    {
+        return ring_->peek(end_type, n);
+    }
+    std::unique_lock<std::mutex> lock = lock_();
     if (data_.empty())
     {
         return std::vector<TimedPtr>();
@@ -41,28 +80,38 @@ std::vector<TimedPtr> DataTopic::peek_data_ptrs(EndType end_type, int32_t n)
 
 std::vector<TimedPtr> DataTopic::pop_data_ptrs(EndType end_type, int32_t n)
 {
-    if (data_.empty())
+    std::unique_lock<std::mutex> lock = lock_();
+    if (count_() == 0)
     {
         return std::vector<TimedPtr>();
     }
-    if (n < 0 || n > data_.size())
+    if (n < 0 || n > count_())
     {
-        n = data_.size();
+        n = count_();
     }
-    std::vector<TimedPtr> ret = peek_data_ptrs(end_type, n);
-
+    std::vector<TimedPtr> ret;
+    ret.reserve(n);
+    pops_.fetch_add(n, std::memory_order_relaxed);
     if (end_type == EndType::LATEST)
     {
+        for (size_t i = count_() - n; i < count_(); i++)
+        {
+            ret.push_back(at_(i));
+        }
         for (int i = 0; i < n; i++)
         {
-            data_.pop_back();
+            pop_back_();
         }
     }
     else if (end_type == EndType::EARLIEST)
     {
         for (int i = 0; i < n; i++)
         {
-            data_.pop_front();
+            ret.push_back(at_(i));
+        }
+        for (int i = 0; i < n; i++)
+        {
+            pop_front_(false);
         }
     }
     else
@@ -72,12 +121,420 @@ std::vector<TimedPtr> DataTopic::pop_data_ptrs(EndType end_type, int32_t n)
     return ret;
 }
 
+std::vector<TimedPtr> DataTopic::peek_range_ptrs(double start_time, double end_time)
+{
+    std::unique_lock<std::mutex> lock = lock_();
+    std::vector<TimedPtr> ret;
+    if (start_time > end_time)
+    {
+        return ret;
+    }
+    size_t end = upper_bound_(end_time);
+    for (size_t i = lower_bound_(start_time); i < end; i++)
+    {
+        ret.push_back(at_(i));
+    }
+    return ret;
+}
+
+std::vector<TimedPtr> DataTopic::peek_nearest_ptrs(double timestamp, int32_t k)
+{
+    std::unique_lock<std::mutex> lock = lock_();
+    return nearest_ptrs_(timestamp, k);
+}
+
+SinceResult DataTopic::peek_since_ptrs(uint64_t cursor, int32_t n)
+{
+    std::unique_lock<std::mutex> lock = lock_();
+    SinceResult result;
+    uint64_t last_sequence = next_sequence_ - 1;
+    if (unsorted_prefix_ > 0)
+    {
+        peek_since_unsorted_(cursor, n, result);
+    }
+    else
+    {
+        size_t begin = std::upper_bound(sequences_.begin(), sequences_.end(), cursor) - sequences_.begin();
+        size_t end = n < 0 || static_cast<size_t>(n) > count_() - begin ? count_() : begin + n;
+        result.ptrs.reserve(end - begin);
+        result.sequences.reserve(end - begin);
+        for (size_t i = begin; i < end; i++)
+        {
+            result.ptrs.push_back(at_(i));
+            result.sequences.push_back(sequences_[i]);
+        }
+    }
+    result.cursor = result.sequences.empty()
+                        ? last_sequence
+                        : *std::max_element(result.sequences.begin(), result.sequences.end());
+    // Every number up to the new cursor was assigned to a block, so any that is not returned was dropped.
+    // A cursor beyond the last sequence number comes from another topic instance, e.g. before a server restart.
+    result.evicted = cursor > 0 && (cursor > last_sequence || result.cursor - cursor > result.ptrs.size());
+    return result;
+}
+
+std::vector<std::vector<TimedPtr>> DataTopic::peek_nearest_aligned(
+    const std::vector<std::shared_ptr<DataTopic>> &topics, double timestamp)
+{
+    // Lock in address order so that concurrent aligned reads cannot deadlock
+    std::vector<DataTopic *> lock_order;
+    for (const std::shared_ptr<DataTopic> &topic : topics)
+    {
+        if (topic != nullptr)
+        {
+            lock_order.push_back(topic.get());
+        }
+    }
+    std::sort(lock_order.begin(), lock_order.end());
+    lock_order.erase(std::unique(lock_order.begin(), lock_order.end()), lock_order.end());
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(lock_order.size());
+    for (DataTopic *topic : lock_order)
+    {
+        locks.push_back(topic->lock_());
+    }
+
+    std::vector<std::vector<TimedPtr>> results;
+    results.reserve(topics.size());
+    for (const std::shared_ptr<DataTopic> &topic : topics)
+    {
+        results.push_back(topic != nullptr ? topic->nearest_ptrs_(timestamp, 1) : std::vector<TimedPtr>());
+    }
+    return results;
+}
+
+std::vector<TimedPtr> DataTopic::nearest_ptrs_(double timestamp, int32_t k) const
+{
+    if (k < 0 || static_cast<size_t>(k) > count_())
+    {
+        k = count_();
+    }
+    // Grow the window [begin, end) around the insertion point towards the closer neighbor
+    size_t begin = lower_bound_(timestamp);
+    size_t end = begin;
+    while (end - begin < static_cast<size_t>(k))
+    {
+        if (begin == 0 || (end < count_() && timestamp_at_(end) - timestamp < timestamp - timestamp_at_(begin - 1)))
+        {
+            end++;
+        }
+        else
+        {
+            begin--;
+        }
+    }
+    std::vector<TimedPtr> ret;
+    ret.reserve(k);
+    for (size_t i = begin; i < end; i++)
+    {
+        ret.push_back(at_(i));
+    }
+    return ret;
+}
+
 void DataTopic::clear_data()
 {
+    std::unique_lock<std::mutex> lock = lock_();
+    if (ring_ != nullptr)
+    {
+        ring_->clear();
+    }
     data_.clear();
+    sequences_.clear();
+    unsorted_prefix_ = 0;
+    bytes_ = 0;
+}
+
+void DataTopic::expire_data()
+{
+    std::unique_lock<std::mutex> lock = lock_();
+    if (count_() == 0)
+    {
+        return;
+    }
+    double timestamp = timestamp_at_(count_() - 1) + static_cast<double>(steady_clock_us() - latest_added_us_) / 1e6;
+    while (count_() > 0 && timestamp - timestamp_at_(0) > max_remaining_time_)
+    {
+        pop_front_();
+    }
+}
+
+bool DataTopic::evict_oldest(double timestamp)
+{
+    std::unique_lock<std::mutex> lock = lock_();
+    if (count_() == 0 || timestamp_at_(0) != timestamp)
+    {
+        return false;
+    }
+    pop_front_();
+    return true;
+}
+
+bool DataTopic::oldest_timestamp(double &timestamp) const
+{
+    std::unique_lock<std::mutex> lock = lock_();
+    if (count_() == 0)
+    {
+        return false;
+    }
+    timestamp = timestamp_at_(0);
+    return true;
+}
+
+void DataTopic::decode_blocks(std::vector<TimedPtr> &ptrs, std::vector<Codec> *codecs) const
+{
+    for (TimedPtr &ptr : ptrs)
+    {
+        if (codec_ == Codec::NONE)
+        {
+            if (codecs != nullptr)
+            {
+                codecs->push_back(Codec::NONE);
+            }
+        }
+        else if (codecs != nullptr)
+        {
+            Codec block_codec;
+            std::get<0>(ptr) = strip_block(std::get<0>(ptr), block_codec);
+            codecs->push_back(block_codec);
+        }
+        else
+        {
+            std::get<0>(ptr) = decode_block(std::get<0>(ptr));
+        }
+    }
+}
+
+Codec DataTopic::codec() const
+{
+    return codec_;
 }
 
 int DataTopic::size() const
 {
-    return data_.size();
+    std::unique_lock<std::mutex> lock = lock_();
+    return count_();
+}
+
+size_t DataTopic::bytes() const
+{
+    return bytes_.load(std::memory_order_relaxed);
+}
+
+std::string DataTopic::stats_json() const
+{
+    return "{\"size\": " + std::to_string(size()) + ", \"bytes\": " + std::to_string(bytes()) +
+           ", \"puts\": " + std::to_string(puts_.load(std::memory_order_relaxed)) +
+           ", \"put_bytes\": " + std::to_string(put_bytes_.load(std::memory_order_relaxed)) +
+           ", \"pops\": " + std::to_string(pops_.load(std::memory_order_relaxed)) +
+           ", \"evictions\": " + std::to_string(evictions_.load(std::memory_order_relaxed)) +
+           ", \"lock_waits\": " + lock_waits_.to_json() + "}";
+}
+
+std::unique_lock<std::mutex> DataTopic::lock_() const
+{
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock())
+    {
+        // Only contended acquisitions are timed, so the uncontended path reads no clock
+        int64_t start_time_us = steady_clock_us();
+        lock.lock();
+        lock_waits_.record(steady_clock_us() - start_time_us);
+    }
+    return lock;
+}
+
+const std::string &DataTopic::name() const
+{
+    return topic_name_;
+}
+
+size_t DataTopic::count_() const
+{
+    return ring_ != nullptr ? ring_->size() : data_.size();
+}
+
+TimedPtr DataTopic::at_(size_t i) const
+{
+    return ring_ != nullptr ? ring_->at(i) : data_[i];
+}
+
+double DataTopic::timestamp_at_(size_t i) const
+{
+    return ring_ != nullptr ? ring_->timestamp_at(i) : std::get<1>(data_[i]);
+}
+
+size_t DataTopic::data_size_at_(size_t i) const
+{
+    return ring_ != nullptr ? ring_->data_size_at(i) : std::get<0>(data_[i]).size();
+}
+
+size_t DataTopic::lower_bound_(double timestamp) const
+{
+    size_t begin = 0;
+    size_t end = count_();
+    while (begin < end)
+    {
+        size_t middle = begin + (end - begin) / 2;
+        if (timestamp_at_(middle) < timestamp)
+        {
+            begin = middle + 1;
+        }
+        else
+        {
+            end = middle;
+        }
+    }
+    return begin;
+}
+
+size_t DataTopic::upper_bound_(double timestamp) const
+{
+    size_t begin = 0;
+    size_t end = count_();
+    while (begin < end)
+    {
+        size_t middle = begin + (end - begin) / 2;
+        if (timestamp_at_(middle) <= timestamp)
+        {
+            begin = middle + 1;
+        }
+        else
+        {
+            end = middle;
+        }
+    }
+    return begin;
+}
+
+void DataTopic::push_back_(const SharedBytes &data_ptr, double timestamp)
+{
+    bytes_ += data_ptr.size();
+    if (ring_ != nullptr)
+    {
+        if (ring_->size() == ring_->capacity())
+        {
+            // Evict explicitly so that the byte count stays correct
+            pop_front_();
+        }
+        ring_->push_back(data_ptr, timestamp);
+    }
+    else
+    {
+        data_.emplace_back(data_ptr, timestamp);
+    }
+    sequences_.push_back(next_sequence_++);
+}
+
+void DataTopic::pop_front_(bool evicted)
+{
+    if (evicted)
+    {
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+    bytes_ -= data_size_at_(0);
+    if (ring_ != nullptr)
+    {
+        ring_->pop_front();
+    }
+    else
+    {
+        data_.pop_front();
+    }
+    sequences_.pop_front();
+    unsorted_prefix_ = unsorted_prefix_ > 0 ? unsorted_prefix_ - 1 : 0;
+}
+
+void DataTopic::pop_back_()
+{
+    bytes_ -= data_size_at_(count_() - 1);
+    if (ring_ != nullptr)
+    {
+        ring_->pop_back();
+    }
+    else
+    {
+        data_.pop_back();
+    }
+    sequences_.pop_back();
+    unsorted_prefix_ = std::min(unsorted_prefix_, count_());
+}
+
+void DataTopic::insert_ordered_(const SharedBytes &data_ptr, double timestamp)
+{
+    if (count_() == 0 || timestamp >= timestamp_at_(count_() - 1))
+    {
+        push_back_(data_ptr, timestamp);
+        latest_added_us_ = steady_clock_us();
+        return;
+    }
+    // Placed after the blocks with the same timestamp, like a block appended at that time
+    size_t i = upper_bound_(timestamp);
+    if (ring_ != nullptr && ring_->size() == ring_->capacity())
+    {
+        if (i == 0)
+        {
+            // Older than every block of a full ring, so it would be the one dropped
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        pop_front_();
+        i--;
+    }
+    bytes_ += data_ptr.size();
+    if (ring_ != nullptr)
+    {
+        ring_->insert(i, data_ptr, timestamp);
+    }
+    else
+    {
+        data_.emplace(data_.begin() + i, data_ptr, timestamp);
+    }
+    // The new block has the highest sequence number but is followed by older ones
+    sequences_.insert(sequences_.begin() + i, next_sequence_++);
+    unsorted_prefix_ = std::max(i < unsorted_prefix_ ? unsorted_prefix_ + 1 : unsorted_prefix_, i + 1);
+}
+
+void DataTopic::evict_()
+{
+    if (count_() == 0)
+    {
+        return;
+    }
+    double latest_timestamp = timestamp_at_(count_() - 1);
+    while (count_() > 0 && latest_timestamp - timestamp_at_(0) > max_remaining_time_)
+    {
+        pop_front_();
+    }
+    while (count_() > 1 && ((max_count_ > 0 && count_() > max_count_) || (max_bytes_ > 0 && bytes_ > max_bytes_)))
+    {
+        pop_front_();
+    }
+}
+
+void DataTopic::peek_since_unsorted_(uint64_t cursor, int32_t n, SinceResult &result) const
+{
+    // Returns the n lowest sequence numbers above cursor, so that the next cursor skips none, in timestamp order
+    std::vector<size_t> indices;
+    for (size_t i = 0; i < count_(); i++)
+    {
+        if (sequences_[i] > cursor)
+        {
+            indices.push_back(i);
+        }
+    }
+    if (n >= 0 && static_cast<size_t>(n) < indices.size())
+    {
+        std::nth_element(indices.begin(), indices.begin() + n, indices.end(),
+                         [this](size_t a, size_t b) { return sequences_[a] < sequences_[b]; });
+        indices.resize(n);
+        std::sort(indices.begin(), indices.end());
+    }
+    result.ptrs.reserve(indices.size());
+    result.sequences.reserve(indices.size());
+    for (size_t i : indices)
+    {
+        result.ptrs.push_back(at_(i));
+        result.sequences.push_back(sequences_[i]);
+    }
 }
@@ -0,0 +1,163 @@
+#include "py_async_client.h"
+
+PyZMQAsyncClient::~PyZMQAsyncClient()
+{
+    // The background thread may be waiting for the GIL to resolve a future
+    pybind11::gil_scoped_release release;
+    close();
+}
+
+pybind11::object PyZMQAsyncClient::peek_data(const std::string &topic, std::string end_type, int32_t n, double timeout)
+{
+    EndType end_type_value = str_to_end_type(end_type);
+    Callback callback;
+    pybind11::object future = make_future_(ReplyType::DATA, callback);
+    {
+        pybind11::gil_scoped_release release;
+        ZMQAsyncClient::peek_data(topic, end_type_value, n, timeout, std::move(callback));
+    }
+    return future;
+}
+
+pybind11::object PyZMQAsyncClient::pop_data(const std::string &topic, std::string end_type, int32_t n, double timeout)
+{
+    EndType end_type_value = str_to_end_type(end_type);
+    Callback callback;
+    pybind11::object future = make_future_(ReplyType::DATA, callback);
+    {
+        pybind11::gil_scoped_release release;
+        ZMQAsyncClient::pop_data(topic, end_type_value, n, timeout, std::move(callback));
+    }
+    return future;
+}
+
+pybind11::object PyZMQAsyncClient::peek_range(const std::string &topic, double start_time, double end_time,
+                                              double timeout)
+{
+    Callback callback;
+    pybind11::object future = make_future_(ReplyType::DATA, callback);
+    {
+        pybind11::gil_scoped_release release;
+        ZMQAsyncClient::peek_range(topic, start_time, end_time, timeout, std::move(callback));
+    }
+    return future;
+}
+
+pybind11::object PyZMQAsyncClient::peek_nearest(const std::string &topic, double timestamp, int32_t k, double timeout)
+{
+    Callback callback;
+    pybind11::object future = make_future_(ReplyType::DATA, callback);
+    {
+        pybind11::gil_scoped_release release;
+        ZMQAsyncClient::peek_nearest(topic, timestamp, k, timeout, std::move(callback));
+    }
+    return future;
+}
+
+pybind11::object PyZMQAsyncClient::peek_since(const std::string &topic, uint64_t cursor, int32_t n, double timeout)
+{
+    Callback callback;
+    pybind11::object future = make_future_(ReplyType::SINCE, callback);
+    {
+        pybind11::gil_scoped_release release;
+        ZMQAsyncClient::peek_since(topic, cursor, n, timeout, std::move(callback));
+    }
+    return future;
+}
+
+pybind11::object PyZMQAsyncClient::peek_batch(const std::vector<BatchSpec> &specs, double timeout)
+{
+    Callback callback;
+    pybind11::object future = make_future_(ReplyType::BATCH, callback);
+    {
+        pybind11::gil_scoped_release release;
+        ZMQAsyncClient::peek_batch(specs, timeout, std::move(callback));
+    }
+    return future;
+}
+
+pybind11::object PyZMQAsyncClient::peek_aligned(const std::vector<std::string> &topics, double timestamp,
+                                                double timeout)
+{
+    Callback callback;
+    pybind11::object future = make_future_(ReplyType::BATCH, callback);
+    {
+        pybind11::gil_scoped_release release;
+        ZMQAsyncClient::peek_aligned(topics, timestamp, timeout, std::move(callback));
+    }
+    return future;
+}
+
+pybind11::object PyZMQAsyncClient::make_future_(ReplyType reply_type, Callback &callback)
+{
+    pybind11::object future = pybind11::module_::import("concurrent.futures").attr("Future")();
+    // Futures of requests in flight cannot be cancelled, since the request has already been sent
+    future.attr("set_running_or_notify_cancel")();
+    // The callback runs on the background thread, so the future may only be touched and released with the GIL held
+    std::shared_ptr<pybind11::object> future_ptr(new pybind11::object(future), [](pybind11::object *ptr) {
+        pybind11::gil_scoped_acquire acquire;
+        delete ptr;
+    });
+    bool zero_copy = ZMQAsyncClient::zero_copy();
+    callback = [future_ptr, zero_copy, reply_type](const std::vector<TimedPtr> &ptrs, std::exception_ptr error) {
+        std::vector<std::vector<TimedPtr>> results;
+        SinceResult since_result;
+        if (error == nullptr && reply_type != ReplyType::DATA)
+        {
+            try
+            {
+                if (reply_type == ReplyType::BATCH)
+                {
+                    results = split_batch_results(ptrs);
+                }
+                else
+                {
+                    since_result = split_since_result(ptrs);
+                }
+            }
+            catch (const std::exception &)
+            {
+                error = std::current_exception();
+            }
+        }
+        pybind11::gil_scoped_acquire acquire;
+        try
+        {
+            if (error == nullptr)
+            {
+                pybind11::object result;
+                if (reply_type == ReplyType::BATCH)
+                {
+                    result = results_to_list(results, zero_copy);
+                }
+                else if (reply_type == ReplyType::SINCE)
+                {
+                    result = since_result_to_tuple(since_result, zero_copy);
+                }
+                else
+                {
+                    result = ptrs_to_tuple(ptrs, zero_copy);
+                }
+                future_ptr->attr("set_result")(result);
+                return;
+            }
+            try
+            {
+                std::rethrow_exception(error);
+            }
+            catch (const RequestTimeoutError &e)
+            {
+                future_ptr->attr("set_exception")(pybind11::handle(PyExc_TimeoutError)(e.what()));
+            }
+            catch (const std::exception &e)
+            {
+                future_ptr->attr("set_exception")(pybind11::handle(PyExc_RuntimeError)(e.what()));
+            }
+        }
+        catch (const pybind11::error_already_set &)
+        {
+            // The future was already resolved
+        }
+    };
+    return future;
+}
@@ -0,0 +1,125 @@
+#include "py_client.h"
+#include "array_block.h"
+
+pybind11::tuple PyZMQClient::peek_data(const std::string &topic, std::string end_type, int32_t n)
+{
+    EndType end_type_value = str_to_end_type(end_type);
+    std::vector<TimedPtr> ptrs;
+    {
+        pybind11::gil_scoped_release release;
+        ptrs = ZMQClient::peek_data(topic, end_type_value, n);
+    }
+    return ptrs_to_tuple(ptrs, zero_copy());
+}
+
+pybind11::tuple PyZMQClient::pop_data(const std::string &topic, std::string end_type, int32_t n)
+{
+    EndType end_type_value = str_to_end_type(end_type);
+    std::vector<TimedPtr> ptrs;
+    {
+        pybind11::gil_scoped_release release;
+        ptrs = ZMQClient::pop_data(topic, end_type_value, n);
+    }
+    return ptrs_to_tuple(ptrs, zero_copy());
+}
+
+pybind11::tuple PyZMQClient::peek_arrays(const std::string &topic, std::string end_type, int32_t n)
+{
+    EndType end_type_value = str_to_end_type(end_type);
+    std::vector<TimedPtr> ptrs;
+    {
+        pybind11::gil_scoped_release release;
+        ptrs = ZMQClient::peek_data(topic, end_type_value, n);
+    }
+    return array_ptrs_to_tuple(ptrs);
+}
+
+pybind11::tuple PyZMQClient::peek_range(const std::string &topic, double start_time, double end_time)
+{
+    std::vector<TimedPtr> ptrs;
+    {
+        pybind11::gil_scoped_release release;
+        ptrs = ZMQClient::peek_range(topic, start_time, end_time);
+    }
+    return ptrs_to_tuple(ptrs, zero_copy());
+}
+
+pybind11::tuple PyZMQClient::peek_nearest(const std::string &topic, double timestamp, int32_t k)
+{
+    std::vector<TimedPtr> ptrs;
+    {
+        pybind11::gil_scoped_release release;
+        ptrs = ZMQClient::peek_nearest(topic, timestamp, k);
+    }
+    return ptrs_to_tuple(ptrs, zero_copy());
+}
+
+pybind11::tuple PyZMQClient::peek_since(const std::string &topic, uint64_t cursor, int32_t n)
+{
+    SinceResult result;
+    {
+        pybind11::gil_scoped_release release;
+        result = ZMQClient::peek_since(topic, cursor, n);
+    }
+    return since_result_to_tuple(result, zero_copy());
+}
+
+pybind11::list PyZMQClient::peek_batch(const std::vector<BatchSpec> &specs)
+{
+    std::vector<std::vector<TimedPtr>> results;
+    {
+        pybind11::gil_scoped_release release;
+        results = ZMQClient::peek_batch(specs);
+    }
+    return results_to_list(results, zero_copy());
+}
+
+pybind11::list PyZMQClient::peek_aligned(const std::vector<std::string> &topics, double timestamp)
+{
+    std::vector<std::vector<TimedPtr>> results;
+    {
+        pybind11::gil_scoped_release release;
+        results = ZMQClient::peek_aligned(topics, timestamp);
+    }
+    return results_to_list(results, zero_copy());
+}
+
+pybind11::object PyZMQClient::request_with_data(const std::string &topic, const PyBytes &data)
+{
+    SharedBytes request = py_bytes_to_shared(data);
+    SharedBytes result;
+    {
+        pybind11::gil_scoped_release release;
+        result = ZMQClient::request_with_data(topic, request);
+    }
+    if (zero_copy())
+    {
+        return pybind11::memoryview(pybind11::cast(result));
+    }
+    return PyBytes(result.data(), result.size());
+}
+
+pybind11::tuple PyZMQClient::get_last_retrieved_data()
+{
+    return ptrs_to_tuple(get_last_retrieved_ptrs(), zero_copy());
+}
+
+pybind11::tuple PyZMQClient::synchronize_time(int32_t samples)
+{
+    std::pair<double, double> offset;
+    {
+        pybind11::gil_scoped_release release;
+        offset = ZMQClient::synchronize_time(samples);
+    }
+    return pybind11::make_tuple(offset.first, offset.second);
+}
+
+pybind11::object PyZMQClient::get_server_stats()
+{
+    std::string stats;
+    {
+        pybind11::gil_scoped_release release;
+        stats = ZMQClient::get_server_stats();
+    }
+    return pybind11::module_::import("json").attr("loads")(stats);
+}
@@ -0,0 +1,47 @@
+#include "py_common.h"
+
+pybind11::tuple ptrs_to_tuple(const std::vector<TimedPtr> &ptrs, bool zero_copy)
+{
+    pybind11::list data;
+    pybind11::list timestamps;
+    for (const TimedPtr &ptr : ptrs)
+    {
+        if (zero_copy)
+        {
+            // The memoryview keeps the SharedBytes, and thereby the memory it references, alive
+            data.append(pybind11::memoryview(pybind11::cast(std::get<0>(ptr))));
+        }
+        else
+        {
+            data.append(PyBytes(std::get<0>(ptr).data(), std::get<0>(ptr).size()));
+        }
+        timestamps.append(std::get<1>(ptr));
+    }
+    return pybind11::make_tuple(data, timestamps);
+}
+
+pybind11::list results_to_list(const std::vector<std::vector<TimedPtr>> &results, bool zero_copy)
+{
+    pybind11::list ret;
+    for (const std::vector<TimedPtr> &result : results)
+    {
+        ret.append(ptrs_to_tuple(result, zero_copy));
+    }
+    return ret;
+}
+
+pybind11::tuple since_result_to_tuple(const SinceResult &result, bool zero_copy)
+{
+    pybind11::tuple data = ptrs_to_tuple(result.ptrs, zero_copy);
+    pybind11::list sequences;
+    for (uint64_t sequence : result.sequences)
+    {
+        sequences.append(sequence);
+    }
+    return pybind11::make_tuple(data[0], data[1], sequences, result.cursor, result.evicted);
+}
+
+SharedBytes py_bytes_to_shared(const PyBytes &data)
+{
+    return SharedBytes(PYBIND11_BYTES_AS_STRING(data.ptr()), PYBIND11_BYTES_SIZE(data.ptr()));
+}
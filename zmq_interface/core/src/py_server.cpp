@@ -0,0 +1,227 @@
+#include "py_server.h"
+#include "array_block.h"
+
+PyZMQServer::~PyZMQServer()
+{
+    // Workers may be waiting for a Python handler, which needs the GIL to finish
+    pybind11::gil_scoped_release release;
+    if (python_handler_thread_.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(python_jobs_mutex_);
+            python_handler_running_ = false;
+        }
+        python_jobs_condition_.notify_all();
+        python_handler_thread_.join();
+        // Fails the requests that are still queued with std::future_error
+        python_jobs_.clear();
+    }
+    stop();
+}
+
+void PyZMQServer::put_data(const std::string &topic, const PyBytes &data)
+{
+    // Copy the payload into native memory while holding the GIL, so that the server never touches it afterwards
+    SharedBytes data_ptr = py_bytes_to_shared(data);
+
+    pybind11::gil_scoped_release release;
+    ZMQServer::put_data(topic, data_ptr);
+}
+
+void PyZMQServer::put_many(const std::string &topic, const std::vector<PyBytes> &data,
+                           const std::optional<std::vector<double>> &timestamps)
+{
+    std::vector<SharedBytes> data_ptrs;
+    data_ptrs.reserve(data.size());
+    for (const PyBytes &block : data)
+    {
+        data_ptrs.push_back(py_bytes_to_shared(block));
+    }
+
+    pybind11::gil_scoped_release release;
+    ZMQServer::put_many(topic, data_ptrs, timestamps.value_or(std::vector<double>()));
+}
+
+void PyZMQServer::put_many_topics(
+    const std::vector<std::tuple<std::string, std::vector<PyBytes>, std::optional<std::vector<double>>>> &batches)
+{
+    std::vector<TopicBatch> native_batches;
+    native_batches.reserve(batches.size());
+    for (const auto &[topic, data, timestamps] : batches)
+    {
+        std::vector<SharedBytes> data_ptrs;
+        data_ptrs.reserve(data.size());
+        for (const PyBytes &block : data)
+        {
+            data_ptrs.push_back(py_bytes_to_shared(block));
+        }
+        native_batches.emplace_back(topic, std::move(data_ptrs), timestamps.value_or(std::vector<double>()));
+    }
+
+    pybind11::gil_scoped_release release;
+    ZMQServer::put_many(native_batches);
+}
+
+void PyZMQServer::put_array(const std::string &topic, const pybind11::object &array)
+{
+    SharedBytes data_ptr = encode_array_block(array);
+
+    pybind11::gil_scoped_release release;
+    ZMQServer::put_data(topic, data_ptr);
+}
+
+pybind11::tuple PyZMQServer::peek_data(const std::string &topic, std::string end_type_str, int n)
+{
+    EndType end_type = str_to_end_type(end_type_str);
+    std::vector<TimedPtr> ptrs;
+    {
+        pybind11::gil_scoped_release release;
+        ptrs = ZMQServer::peek_data(topic, end_type, n);
+    }
+    return ptrs_to_tuple(ptrs, false);
+}
+
+pybind11::tuple PyZMQServer::peek_arrays(const std::string &topic, std::string end_type_str, int n)
+{
+    EndType end_type = str_to_end_type(end_type_str);
+    std::vector<TimedPtr> ptrs;
+    {
+        pybind11::gil_scoped_release release;
+        ptrs = ZMQServer::peek_data(topic, end_type, n);
+    }
+    return array_ptrs_to_tuple(ptrs);
+}
+
+pybind11::tuple PyZMQServer::peek_since(const std::string &topic, uint64_t cursor, int32_t n)
+{
+    SinceResult result;
+    {
+        pybind11::gil_scoped_release release;
+        result = ZMQServer::peek_since(topic, cursor, n);
+    }
+    return since_result_to_tuple(result, false);
+}
+
+pybind11::tuple PyZMQServer::pop_data(const std::string &topic, std::string end_type_str, int n)
+{
+    EndType end_type = str_to_end_type(end_type_str);
+    std::vector<TimedPtr> ptrs;
+    {
+        pybind11::gil_scoped_release release;
+        ptrs = ZMQServer::pop_data(topic, end_type, n);
+    }
+    return ptrs_to_tuple(ptrs, false);
+}
+
+pybind11::tuple PyZMQServer::peek_range(const std::string &topic, double start_time, double end_time)
+{
+    std::vector<TimedPtr> ptrs;
+    {
+        pybind11::gil_scoped_release release;
+        ptrs = ZMQServer::peek_range(topic, start_time, end_time);
+    }
+    return ptrs_to_tuple(ptrs, false);
+}
+
+pybind11::tuple PyZMQServer::peek_nearest(const std::string &topic, double timestamp, int32_t k)
+{
+    std::vector<TimedPtr> ptrs;
+    {
+        pybind11::gil_scoped_release release;
+        ptrs = ZMQServer::peek_nearest(topic, timestamp, k);
+    }
+    return ptrs_to_tuple(ptrs, false);
+}
+
+void PyZMQServer::set_request_handler(const std::string &topic, pybind11::function handler)
+{
+    // Checked before the handler thread is started, so that an invalid call leaves no thread behind
+    check_request_handler_(topic);
+    {
+        std::lock_guard<std::mutex> lock(python_jobs_mutex_);
+        if (!python_handler_running_)
+        {
+            python_handler_running_ = true;
+            python_handler_thread_ = std::thread(&PyZMQServer::python_handler_loop_, this);
+        }
+    }
+    // The handler may be released by a worker thread, which then needs the GIL
+    std::shared_ptr<pybind11::function> handler_ptr(new pybind11::function(std::move(handler)),
+                                                    [](pybind11::function *ptr) {
+                                                        pybind11::gil_scoped_acquire acquire;
+                                                        delete ptr;
+                                                    });
+    ZMQServer::set_request_handler(topic, [this, handler_ptr](const SharedBytes &request) {
+        return run_python_job_(std::packaged_task<SharedBytes()>([handler_ptr, request] {
+            pybind11::gil_scoped_acquire acquire;
+            try
+            {
+                pybind11::object result = (*handler_ptr)(PyBytes(request.data(), request.size()));
+                if (result.is_none())
+                {
+                    return SharedBytes();
+                }
+                if (!PyBytes_Check(result.ptr()))
+                {
+                    // Copies any other bytes-like object, e.g. a bytearray or a contiguous ndarray
+                    result = pybind11::reinterpret_steal<pybind11::object>(PyObject_Bytes(result.ptr()));
+                    if (!result)
+                    {
+                        throw pybind11::error_already_set();
+                    }
+                }
+                return SharedBytes(PYBIND11_BYTES_AS_STRING(result.ptr()), PYBIND11_BYTES_SIZE(result.ptr()));
+            }
+            catch (const pybind11::error_already_set &e)
+            {
+                // The Python exception must not outlive the GIL
+                throw std::runtime_error(e.what());
+            }
+        }));
+    });
+}
+
+pybind11::object PyZMQServer::get_stats()
+{
+    std::string stats;
+    {
+        pybind11::gil_scoped_release release;
+        stats = stats_json();
+    }
+    return pybind11::module_::import("json").attr("loads")(stats);
+}
+
+SharedBytes PyZMQServer::run_python_job_(std::packaged_task<SharedBytes()> job)
+{
+    std::future<SharedBytes> result = job.get_future();
+    {
+        std::lock_guard<std::mutex> lock(python_jobs_mutex_);
+        if (!python_handler_running_)
+        {
+            throw std::runtime_error("Server is shutting down");
+        }
+        python_jobs_.push_back(std::move(job));
+    }
+    python_jobs_condition_.notify_one();
+    return result.get();
+}
+
+void PyZMQServer::python_handler_loop_()
+{
+    while (true)
+    {
+        std::packaged_task<SharedBytes()> job;
+        {
+            std::unique_lock<std::mutex> lock(python_jobs_mutex_);
+            python_jobs_condition_.wait(lock, [this] { return !python_jobs_.empty() || !python_handler_running_; });
+            if (!python_handler_running_)
+            {
+                return;
+            }
+            job = std::move(python_jobs_.front());
+            python_jobs_.pop_front();
+        }
+        // Exceptions are stored in the job's future
+        job();
+    }
+}
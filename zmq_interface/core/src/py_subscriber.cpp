@@ -0,0 +1,18 @@
+#include "py_subscriber.h"
+
+PyZMQSubscriber::~PyZMQSubscriber()
+{
+    // The background thread may be waiting for the GIL to run a Python callback
+    pybind11::gil_scoped_release release;
+    close();
+}
+
+pybind11::tuple PyZMQSubscriber::pop_data(const std::string &topic, int32_t n, double timeout)
+{
+    std::vector<TimedPtr> ptrs;
+    {
+        pybind11::gil_scoped_release release;
+        ptrs = ZMQSubscriber::pop_data(topic, n, timeout);
+    }
+    return ptrs_to_tuple(ptrs, zero_copy());
+}
@@ -1,17 +1,19 @@
-#include "common.h"
-#include "data_topic.h"
-#include "zmq_client.h"
-#include "zmq_message.h"
-#include "zmq_server.h"
+#include "py_async_client.h"
+#include "py_client.h"
+#include "py_common.h"
+#include "py_server.h"
+#include "py_subscriber.h"
+#include <limits>
 #include <pybind11/functional.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
 namespace py = pybind11;
 
-PyBytesPtr bytes_to_shared_string(py::bytes py_bytes)
+// Turns a concurrent.futures.Future into an awaitable of the running event loop
+static py::object wrap_future(py::object future)
 {
-    return std::make_shared<py::bytes>(py_bytes);
+    return py::module_::import("asyncio").attr("wrap_future")(future);
 }
 
 PYBIND11_MODULE(zmq_interface, m)
@@ -20,21 +22,163 @@ PYBIND11_MODULE(zmq_interface, m)
     m.def("steady_clock_us", &steady_clock_us);
     m.def("system_clock_us", &system_clock_us);
 
-    py::class_<ZMQClient>(m, "ZMQClient")
-        .def(py::init<const std::string &, const std::string &>())
-        .def("peek_data", &ZMQClient::peek_data)
-        .def("pop_data", &ZMQClient::pop_data)
-        .def("get_last_retrieved_data", &ZMQClient::get_last_retrieved_data)
-        .def("reset_start_time", &ZMQClient::reset_start_time)
-        .def("get_timestamp", &ZMQClient::get_timestamp);
-
-    py::class_<ZMQServer>(m, "ZMQServer")
-        .def(py::init<const std::string &, const std::string &>())
-        .def("add_topic", &ZMQServer::add_topic)
-        .def("put_data", &ZMQServer::put_data)
-        .def("peek_data", &ZMQServer::peek_data)
-        .def("pop_data", &ZMQServer::pop_data)
-        .def("get_topic_status", &ZMQServer::get_topic_status)
-        .def("reset_start_time", &ZMQServer::reset_start_time)
-        .def("get_timestamp", &ZMQServer::get_timestamp);
+    py::class_<SharedBytes>(m, "SharedBytes", py::buffer_protocol())
+        .def_buffer([](const SharedBytes &bytes) {
+            return py::buffer_info(const_cast<char *>(bytes.data()), sizeof(char), "B", 1,
+                                   {static_cast<py::ssize_t>(bytes.size())}, {sizeof(char)}, true);
+        })
+        .def("__len__", &SharedBytes::size)
+        .def("__bytes__", [](const SharedBytes &bytes) { return py::bytes(bytes.data(), bytes.size()); });
+
+    py::class_<PyZMQClient>(m, "ZMQClient")
+        .def(py::init<const std::string &, const std::string &, bool, bool, uint8_t>(), py::arg("client_name"),
+             py::arg("server_endpoint"), py::arg("zero_copy") = false, py::arg("shared_memory") = false,
+             py::arg("max_protocol_version") = PROTOCOL_V2)
+        .def("peek_data", &PyZMQClient::peek_data)
+        .def("pop_data", &PyZMQClient::pop_data)
+        .def("peek_arrays", &PyZMQClient::peek_arrays, py::arg("topic"), py::arg("end_type"), py::arg("n"))
+        .def("peek_range", &PyZMQClient::peek_range, py::arg("topic"), py::arg("start_time"), py::arg("end_time"))
+        .def("peek_nearest", &PyZMQClient::peek_nearest, py::arg("topic"), py::arg("timestamp"), py::arg("k") = 1)
+        .def("peek_since", &PyZMQClient::peek_since, py::arg("topic"), py::arg("cursor"), py::arg("n") = -1)
+        .def("peek_batch", &PyZMQClient::peek_batch, py::arg("specs"))
+        .def("peek_aligned", &PyZMQClient::peek_aligned, py::arg("topics"), py::arg("timestamp"))
+        .def("request_with_data", &PyZMQClient::request_with_data, py::arg("topic"), py::arg("data"))
+        .def("get_last_retrieved_data", &PyZMQClient::get_last_retrieved_data)
+        .def("synchronize_time", &PyZMQClient::synchronize_time, py::arg("samples") = 16)
+        .def("get_clock_offset", &PyZMQClient::get_clock_offset, py::call_guard<py::gil_scoped_release>())
+        .def("get_server_stats", &PyZMQClient::get_server_stats)
+        .def("protocol_version", &PyZMQClient::protocol_version)
+        .def("mirror_topic", &PyZMQClient::mirror_topic, py::arg("topic"), py::arg("max_remaining_time"),
+             py::arg("interval") = 0.01, py::call_guard<py::gil_scoped_release>())
+        .def("unmirror_topic", &PyZMQClient::unmirror_topic, py::arg("topic"),
+             py::call_guard<py::gil_scoped_release>())
+        .def("get_mirror_staleness", &PyZMQClient::get_mirror_staleness, py::arg("topic"))
+        .def("reset_start_time", &PyZMQClient::reset_start_time)
+        .def("get_timestamp", &PyZMQClient::get_timestamp);
+
+    py::class_<PyZMQAsyncClient>(m, "ZMQAsyncClient")
+        .def(py::init<const std::string &, const std::string &, bool>(), py::arg("client_name"),
+             py::arg("server_endpoint"), py::arg("zero_copy") = false)
+        .def("peek_data", &PyZMQAsyncClient::peek_data, py::arg("topic"), py::arg("end_type"), py::arg("n"),
+             py::arg("timeout") = 0.0)
+        .def("pop_data", &PyZMQAsyncClient::pop_data, py::arg("topic"), py::arg("end_type"), py::arg("n"),
+             py::arg("timeout") = 0.0)
+        .def("peek_range", &PyZMQAsyncClient::peek_range, py::arg("topic"), py::arg("start_time"), py::arg("end_time"),
+             py::arg("timeout") = 0.0)
+        .def("peek_nearest", &PyZMQAsyncClient::peek_nearest, py::arg("topic"), py::arg("timestamp"), py::arg("k") = 1,
+             py::arg("timeout") = 0.0)
+        .def("peek_since", &PyZMQAsyncClient::peek_since, py::arg("topic"), py::arg("cursor"), py::arg("n") = -1,
+             py::arg("timeout") = 0.0)
+        .def("peek_batch", &PyZMQAsyncClient::peek_batch, py::arg("specs"), py::arg("timeout") = 0.0)
+        .def("peek_aligned", &PyZMQAsyncClient::peek_aligned, py::arg("topics"), py::arg("timestamp"),
+             py::arg("timeout") = 0.0)
+        .def(
+            "apeek_data",
+            [](PyZMQAsyncClient &client, const std::string &topic, std::string end_type, int32_t n, double timeout) {
+                return wrap_future(client.peek_data(topic, end_type, n, timeout));
+            },
+            py::arg("topic"), py::arg("end_type"), py::arg("n"), py::arg("timeout") = 0.0)
+        .def(
+            "apop_data",
+            [](PyZMQAsyncClient &client, const std::string &topic, std::string end_type, int32_t n, double timeout) {
+                return wrap_future(client.pop_data(topic, end_type, n, timeout));
+            },
+            py::arg("topic"), py::arg("end_type"), py::arg("n"), py::arg("timeout") = 0.0)
+        .def(
+            "apeek_range",
+            [](PyZMQAsyncClient &client, const std::string &topic, double start_time, double end_time, double timeout) {
+                return wrap_future(client.peek_range(topic, start_time, end_time, timeout));
+            },
+            py::arg("topic"), py::arg("start_time"), py::arg("end_time"), py::arg("timeout") = 0.0)
+        .def(
+            "apeek_nearest",
+            [](PyZMQAsyncClient &client, const std::string &topic, double timestamp, int32_t k, double timeout) {
+                return wrap_future(client.peek_nearest(topic, timestamp, k, timeout));
+            },
+            py::arg("topic"), py::arg("timestamp"), py::arg("k") = 1, py::arg("timeout") = 0.0)
+        .def(
+            "apeek_since",
+            [](PyZMQAsyncClient &client, const std::string &topic, uint64_t cursor, int32_t n, double timeout) {
+                return wrap_future(client.peek_since(topic, cursor, n, timeout));
+            },
+            py::arg("topic"), py::arg("cursor"), py::arg("n") = -1, py::arg("timeout") = 0.0)
+        .def(
+            "apeek_batch",
+            [](PyZMQAsyncClient &client, const std::vector<BatchSpec> &specs, double timeout) {
+                return wrap_future(client.peek_batch(specs, timeout));
+            },
+            py::arg("specs"), py::arg("timeout") = 0.0)
+        .def(
+            "apeek_aligned",
+            [](PyZMQAsyncClient &client, const std::vector<std::string> &topics, double timestamp, double timeout) {
+                return wrap_future(client.peek_aligned(topics, timestamp, timeout));
+            },
+            py::arg("topics"), py::arg("timestamp"), py::arg("timeout") = 0.0)
+        .def("reset_start_time", &PyZMQAsyncClient::reset_start_time)
+        .def("get_timestamp", &PyZMQAsyncClient::get_timestamp);
+
+    py::class_<PyZMQServer>(m, "ZMQServer")
+        .def(py::init<const std::string &, const std::string &, size_t, const std::string &, int>(),
+             py::arg("server_name"), py::arg("server_endpoint"), py::arg("shared_memory_size") = 0,
+             py::arg("publish_endpoint") = "", py::arg("num_workers") = 0)
+        .def("add_topic", &PyZMQServer::add_topic, py::arg("topic"), py::arg("max_remaining_time"),
+             py::arg("capacity") = 0, py::arg("max_bytes") = 0, py::arg("max_count") = 0, py::arg("codec") = "none",
+             py::arg("element_size") = 4)
+        .def("put_data", &PyZMQServer::put_data)
+        .def("put_many", &PyZMQServer::put_many, py::arg("topic"), py::arg("data"), py::arg("timestamps") = py::none())
+        .def("put_many_topics", &PyZMQServer::put_many_topics, py::arg("batches"))
+        .def("put_array", &PyZMQServer::put_array, py::arg("topic"), py::arg("array"))
+        .def("peek_data", &PyZMQServer::peek_data)
+        .def("peek_arrays", &PyZMQServer::peek_arrays, py::arg("topic"), py::arg("end_type"), py::arg("n"))
+        .def("pop_data", &PyZMQServer::pop_data)
+        .def("peek_range", &PyZMQServer::peek_range, py::arg("topic"), py::arg("start_time"), py::arg("end_time"))
+        .def("peek_nearest", &PyZMQServer::peek_nearest, py::arg("topic"), py::arg("timestamp"), py::arg("k") = 1)
+        .def("peek_since", &PyZMQServer::peek_since, py::arg("topic"), py::arg("cursor"), py::arg("n") = -1)
+        .def("get_topic_status", &PyZMQServer::get_topic_status)
+        .def("get_topic_bytes", &PyZMQServer::get_topic_bytes)
+        .def("get_stats", &PyZMQServer::get_stats)
+        .def("set_memory_limit", &PyZMQServer::set_memory_limit)
+        .def("set_request_handler", &PyZMQServer::set_request_handler, py::arg("topic"), py::arg("handler"))
+        .def("remove_request_handler", &PyZMQServer::remove_request_handler, py::arg("topic"))
+        .def("reset_start_time", &PyZMQServer::reset_start_time)
+        .def("set_topic_priority", &PyZMQServer::set_topic_priority, py::arg("topic"), py::arg("priority") = true)
+        .def("start_recording", &PyZMQServer::start_recording, py::arg("directory"), py::arg("topics"))
+        .def("stop_recording", &PyZMQServer::stop_recording, py::call_guard<py::gil_scoped_release>())
+        .def("replay", &PyZMQServer::replay, py::arg("directory"), py::arg("speed") = 1.0,
+             py::arg("start_time") = std::numeric_limits<double>::lowest(),
+             py::arg("end_time") = std::numeric_limits<double>::max(), py::call_guard<py::gil_scoped_release>())
+        .def("stop_replay", &PyZMQServer::stop_replay, py::call_guard<py::gil_scoped_release>())
+        .def("is_replaying", &PyZMQServer::is_replaying)
+        .def("get_timestamp", &PyZMQServer::get_timestamp);
+
+    py::class_<RecordingReader>(m, "RecordingReader")
+        .def(py::init<const std::string &>(), py::arg("directory"))
+        .def("topics", &RecordingReader::topics)
+        .def("count", &RecordingReader::count, py::arg("topic"))
+        .def("start_time", &RecordingReader::start_time)
+        .def("end_time", &RecordingReader::end_time)
+        .def(
+            "at",
+            [](const RecordingReader &reader, const std::string &topic, size_t i) {
+                TimedPtr block = reader.at(topic, i);
+                return py::make_tuple(py::bytes(std::get<0>(block).data(), std::get<0>(block).size()),
+                                      std::get<1>(block));
+            },
+            py::arg("topic"), py::arg("i"))
+        .def("lower_bound", &RecordingReader::lower_bound, py::arg("topic"), py::arg("timestamp"))
+        .def(
+            "peek_range",
+            [](const RecordingReader &reader, const std::string &topic, double start_time, double end_time) {
+                return ptrs_to_tuple(reader.peek_range(topic, start_time, end_time), false);
+            },
+            py::arg("topic"), py::arg("start_time"), py::arg("end_time"));
+
+    py::class_<PyZMQSubscriber>(m, "ZMQSubscriber")
+        .def(py::init<const std::string &, const std::string &, bool>(), py::arg("subscriber_name"),
+             py::arg("publisher_endpoint"), py::arg("zero_copy") = false)
+        .def("subscribe", &PyZMQSubscriber::subscribe, py::arg("topic"), py::arg("queue_size") = 100,
+             py::arg("conflate") = false)
+        .def("unsubscribe", &PyZMQSubscriber::unsubscribe)
+        .def("set_callback", &PyZMQSubscriber::set_callback)
+        .def("pop_data", &PyZMQSubscriber::pop_data, py::arg("topic"), py::arg("n") = -1, py::arg("timeout") = 0.0);
 }
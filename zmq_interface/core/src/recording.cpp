@@ -0,0 +1,404 @@
+#include "recording.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr uint64_t RECORDING_MAGIC = 0x31434552515a5a5a; // "ZZZQREC1"
+static constexpr uint32_t RECORDING_VERSION = 1;
+static constexpr size_t SEGMENT_INITIAL_CAPACITY = 1 << 20;
+static constexpr size_t INDEX_INITIAL_CAPACITY = 1 << 16;
+
+struct IndexHeader
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t topic_length;
+    // Number of complete blocks
+    uint64_t count;
+    char topic[256];
+};
+
+struct IndexEntry
+{
+    double timestamp;
+    uint64_t offset;
+    uint64_t size;
+};
+
+static std::string recording_path(const std::string &directory, const std::string &topic, const char *extension)
+{
+    return (std::filesystem::path(directory) / (bytes_to_hex(topic) + extension)).string();
+}
+
+MappedFile::MappedFile(const std::string &path, size_t initial_capacity)
+    : path_(path), writable_(true), fd_(-1), mapped_(nullptr), capacity_(0), size_(0)
+{
+    fd_ = open(path_.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("Failed to create " + path_ + ": " + std::strerror(errno));
+    }
+    map_(std::max<size_t>(initial_capacity, 1));
+}
+
+MappedFile::MappedFile(const std::string &path) : path_(path), writable_(false), fd_(-1), mapped_(nullptr), size_(0)
+{
+    int fd = open(path_.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open " + path_ + ": " + std::strerror(errno));
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Failed to stat " + path_ + ": " + std::strerror(errno));
+    }
+    size_ = file_stat.st_size;
+    capacity_ = size_;
+    if (size_ > 0)
+    {
+        void *mapped = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to map " + path_ + ": " + std::strerror(errno));
+        }
+        mapped_ = static_cast<char *>(mapped);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (mapped_ != nullptr)
+    {
+        munmap(mapped_, capacity_);
+    }
+    if (writable_)
+    {
+        // Drop the unused tail of the last mapping. On failure the file keeps a zero-filled tail, which readers ignore
+        // since they only use the offsets in the index.
+        int result = ftruncate(fd_, size_);
+        (void)result;
+        close(fd_);
+    }
+}
+
+uint64_t MappedFile::append(const char *data, size_t size)
+{
+    if (size_ + size > capacity_)
+    {
+        size_t capacity = capacity_;
+        while (size_ + size > capacity)
+        {
+            capacity *= 2;
+        }
+        map_(capacity);
+    }
+    uint64_t offset = size_;
+    std::memcpy(mapped_ + offset, data, size);
+    size_ += size;
+    return offset;
+}
+
+void MappedFile::write_at(uint64_t offset, const char *data, size_t size)
+{
+    if (offset + size > size_)
+    {
+        throw std::out_of_range("Write past the end of " + path_);
+    }
+    std::memcpy(mapped_ + offset, data, size);
+}
+
+const char *MappedFile::data() const
+{
+    return mapped_;
+}
+
+size_t MappedFile::size() const
+{
+    return size_;
+}
+
+void MappedFile::map_(size_t capacity)
+{
+    if (ftruncate(fd_, capacity) != 0)
+    {
+        throw std::runtime_error("Failed to resize " + path_ + ": " + std::strerror(errno));
+    }
+    void *mapped = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapped == MAP_FAILED)
+    {
+        throw std::runtime_error("Failed to map " + path_ + ": " + std::strerror(errno));
+    }
+    if (mapped_ != nullptr)
+    {
+        munmap(mapped_, capacity_);
+    }
+    mapped_ = static_cast<char *>(mapped);
+    capacity_ = capacity;
+}
+
+Recorder::Recorder(const std::string &directory, const std::vector<std::string> &topics) : directory_(directory)
+{
+    std::filesystem::create_directories(directory_);
+    for (const std::string &topic : topics)
+    {
+        if (topic.empty() || topic.size() > UINT8_MAX)
+        {
+            throw std::invalid_argument("Topic must have between 1 and 255 characters");
+        }
+        if (logs_.count(topic) > 0)
+        {
+            continue;
+        }
+        std::unique_ptr<TopicLog> log = std::make_unique<TopicLog>();
+        log->segment =
+            std::make_unique<MappedFile>(recording_path(directory_, topic, ".seg"), SEGMENT_INITIAL_CAPACITY);
+        log->index = std::make_unique<MappedFile>(recording_path(directory_, topic, ".idx"), INDEX_INITIAL_CAPACITY);
+        log->count = 0;
+        IndexHeader header = {};
+        header.magic = RECORDING_MAGIC;
+        header.version = RECORDING_VERSION;
+        header.topic_length = topic.size();
+        std::memcpy(header.topic, topic.data(), topic.size());
+        log->index->append(reinterpret_cast<const char *>(&header), sizeof(header));
+        logs_.emplace(topic, std::move(log));
+    }
+    writer_thread_ = std::thread(&Recorder::writer_loop_, this);
+}
+
+Recorder::~Recorder()
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        running_ = false;
+    }
+    queue_condition_.notify_all();
+    writer_thread_.join();
+}
+
+bool Recorder::records(const std::string &topic) const
+{
+    return logs_.count(topic) > 0;
+}
+
+void Recorder::record(const std::string &topic, const SharedBytes &data, double timestamp)
+{
+    auto it = logs_.find(topic);
+    if (it == logs_.end())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        queue_.push_back(PendingBlock{it->second.get(), data, timestamp});
+        queued_count_++;
+    }
+    queue_condition_.notify_one();
+}
+
+void Recorder::flush()
+{
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    uint64_t target_count = queued_count_;
+    flushed_condition_.wait(lock, [this, target_count] { return written_count_ >= target_count; });
+}
+
+const std::string &Recorder::directory() const
+{
+    return directory_;
+}
+
+void Recorder::writer_loop_()
+{
+    std::deque<PendingBlock> blocks;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            written_count_ += blocks.size();
+            flushed_condition_.notify_all();
+            blocks.clear();
+            queue_condition_.wait(lock, [this] { return !queue_.empty() || !running_; });
+            if (queue_.empty())
+            {
+                return;
+            }
+            blocks.swap(queue_);
+        }
+        for (const PendingBlock &block : blocks)
+        {
+            write_block_(block);
+        }
+    }
+}
+
+void Recorder::write_block_(const PendingBlock &block)
+{
+    TopicLog &log = *block.log;
+    IndexEntry entry;
+    entry.timestamp = block.timestamp;
+    entry.size = block.data.size();
+    entry.offset = log.segment->append(block.data.data(), block.data.size());
+    log.index->append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+    // Published last, so that readers of a cut-off recording never see an incomplete block
+    log.count++;
+    log.index->write_at(offsetof(IndexHeader, count), reinterpret_cast<const char *>(&log.count), sizeof(log.count));
+}
+
+RecordingReader::RecordingReader(const std::string &directory)
+{
+    if (!std::filesystem::is_directory(directory))
+    {
+        throw std::invalid_argument("Recording " + directory + " does not exist");
+    }
+    for (const std::filesystem::directory_entry &file : std::filesystem::directory_iterator(directory))
+    {
+        if (file.path().extension() != ".idx")
+        {
+            continue;
+        }
+        TopicIndex topic_index;
+        topic_index.index = std::make_shared<const MappedFile>(file.path().string());
+        IndexHeader header;
+        if (topic_index.index->size() < sizeof(IndexHeader))
+        {
+            throw std::runtime_error("Index " + file.path().string() + " is truncated");
+        }
+        std::memcpy(&header, topic_index.index->data(), sizeof(header));
+        if (header.magic != RECORDING_MAGIC || header.version != RECORDING_VERSION ||
+            header.topic_length > sizeof(header.topic))
+        {
+            throw std::runtime_error(file.path().string() + " is not a recording index");
+        }
+        std::filesystem::path segment_path = file.path();
+        topic_index.segment = std::make_shared<const MappedFile>(segment_path.replace_extension(".seg").string());
+        // Entries or blocks beyond the file (from a crash while growing it) are not counted
+        topic_index.count = std::min<size_t>(header.count, (topic_index.index->size() - sizeof(IndexHeader)) /
+                                                               sizeof(IndexEntry));
+        while (topic_index.count > 0)
+        {
+            IndexEntry entry;
+            std::memcpy(&entry,
+                        topic_index.index->data() + sizeof(IndexHeader) + (topic_index.count - 1) * sizeof(IndexEntry),
+                        sizeof(entry));
+            if (entry.offset + entry.size <= topic_index.segment->size())
+            {
+                break;
+            }
+            topic_index.count--;
+        }
+        topics_.emplace(std::string(header.topic, header.topic_length), std::move(topic_index));
+    }
+}
+
+std::vector<std::string> RecordingReader::topics() const
+{
+    std::vector<std::string> topics;
+    for (const auto &pair : topics_)
+    {
+        topics.push_back(pair.first);
+    }
+    return topics;
+}
+
+size_t RecordingReader::count(const std::string &topic) const
+{
+    return find_(topic).count;
+}
+
+TimedPtr RecordingReader::at(const std::string &topic, size_t i) const
+{
+    const TopicIndex &index = find_(topic);
+    if (i >= index.count)
+    {
+        throw std::out_of_range("Block " + std::to_string(i) + " of topic `" + topic + "` does not exist");
+    }
+    IndexEntry entry;
+    std::memcpy(&entry, index.index->data() + sizeof(IndexHeader) + i * sizeof(IndexEntry), sizeof(entry));
+    return TimedPtr(SharedBytes(index.segment, index.segment->data() + entry.offset, entry.size), entry.timestamp);
+}
+
+size_t RecordingReader::lower_bound(const std::string &topic, double timestamp) const
+{
+    const TopicIndex &index = find_(topic);
+    size_t low = 0;
+    size_t high = index.count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (timestamp_at_(index, middle) < timestamp)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+std::vector<TimedPtr> RecordingReader::peek_range(const std::string &topic, double start_time, double end_time) const
+{
+    const TopicIndex &index = find_(topic);
+    std::vector<TimedPtr> ret;
+    for (size_t i = lower_bound(topic, start_time); i < index.count && timestamp_at_(index, i) <= end_time; i++)
+    {
+        ret.push_back(at(topic, i));
+    }
+    return ret;
+}
+
+double RecordingReader::start_time() const
+{
+    double start_time = std::numeric_limits<double>::infinity();
+    for (const auto &pair : topics_)
+    {
+        if (pair.second.count > 0)
+        {
+            start_time = std::min(start_time, timestamp_at_(pair.second, 0));
+        }
+    }
+    return start_time == std::numeric_limits<double>::infinity() ? 0 : start_time;
+}
+
+double RecordingReader::end_time() const
+{
+    double end_time = -std::numeric_limits<double>::infinity();
+    for (const auto &pair : topics_)
+    {
+        if (pair.second.count > 0)
+        {
+            end_time = std::max(end_time, timestamp_at_(pair.second, pair.second.count - 1));
+        }
+    }
+    return end_time == -std::numeric_limits<double>::infinity() ? 0 : end_time;
+}
+
+const RecordingReader::TopicIndex &RecordingReader::find_(const std::string &topic) const
+{
+    auto it = topics_.find(topic);
+    if (it == topics_.end())
+    {
+        throw std::invalid_argument("Topic `" + topic + "` is not in the recording");
+    }
+    return it->second;
+}
+
+double RecordingReader::timestamp_at_(const TopicIndex &index, size_t i) const
+{
+    double timestamp;
+    std::memcpy(&timestamp, index.index->data() + sizeof(IndexHeader) + i * sizeof(IndexEntry), sizeof(timestamp));
+    return timestamp;
+}
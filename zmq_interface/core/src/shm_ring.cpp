@@ -0,0 +1,272 @@
+#include "shm_ring.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr uint64_t SHM_RING_MAGIC = 0x324e4952514d5a5a; // "ZZMQRIN2"
+static constexpr uint64_t SHM_BLOCK_ALIGNMENT = 64;
+static constexpr uint64_t NO_LEASE = std::numeric_limits<uint64_t>::max();
+
+ShmRing::ShmRing(const std::string &name, size_t capacity) : name_(name), owner_(true), mapped_(nullptr)
+{
+    if (capacity == 0)
+    {
+        throw std::invalid_argument("Shared memory capacity must be positive");
+    }
+    // Blocks are aligned relative to the start of the ring, which only keeps them aligned across wraps if the
+    // capacity is a multiple of the alignment
+    capacity = (capacity + SHM_BLOCK_ALIGNMENT - 1) / SHM_BLOCK_ALIGNMENT * SHM_BLOCK_ALIGNMENT;
+    mapped_size_ = sizeof(Header) + capacity;
+    shm_unlink(name_.c_str()); // Remove a segment left behind by a previous server on the same endpoint
+    int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to create shared memory segment " + name_ + ": " + std::strerror(errno));
+    }
+    if (ftruncate(fd, mapped_size_) != 0)
+    {
+        close(fd);
+        shm_unlink(name_.c_str());
+        throw std::runtime_error("Failed to resize shared memory segment " + name_ + ": " + std::strerror(errno));
+    }
+    mapped_ = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped_ == MAP_FAILED)
+    {
+        shm_unlink(name_.c_str());
+        throw std::runtime_error("Failed to map shared memory segment " + name_ + ": " + std::strerror(errno));
+    }
+    header_ = new (mapped_) Header();
+    header_->magic = SHM_RING_MAGIC;
+    header_->segment_id = std::random_device()() ^ (static_cast<uint64_t>(steady_clock_us()) << 16);
+    header_->capacity = capacity;
+    header_->reserved_position.store(0);
+    header_->committed_position.store(0);
+    for (ReaderSlot &reader : header_->readers)
+    {
+        reader.pid.store(0);
+        reader.leased_position.store(NO_LEASE);
+    }
+    data_ = static_cast<char *>(mapped_) + sizeof(Header);
+}
+
+ShmRing::ShmRing(const std::string &name) : name_(name), owner_(false), mapped_size_(0), mapped_(nullptr)
+{
+    int fd = shm_open(name_.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open shared memory segment " + name_ + ": " + std::strerror(errno));
+    }
+    struct stat segment_stat;
+    if (fstat(fd, &segment_stat) != 0 || segment_stat.st_size < static_cast<off_t>(sizeof(Header)))
+    {
+        close(fd);
+        throw std::runtime_error("Shared memory segment " + name_ + " is not initialized");
+    }
+    mapped_size_ = segment_stat.st_size;
+    mapped_ = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped_ == MAP_FAILED)
+    {
+        throw std::runtime_error("Failed to map shared memory segment " + name_ + ": " + std::strerror(errno));
+    }
+    header_ = static_cast<Header *>(mapped_);
+    data_ = static_cast<char *>(mapped_) + sizeof(Header);
+    if (header_->magic != SHM_RING_MAGIC || sizeof(Header) + header_->capacity > mapped_size_)
+    {
+        munmap(mapped_, mapped_size_);
+        throw std::runtime_error("Shared memory segment " + name_ + " is not a valid ring buffer");
+    }
+}
+
+ShmRing::~ShmRing()
+{
+    if (reader_slot_ >= 0)
+    {
+        // Every view holds the ring, so none is left
+        header_->readers[reader_slot_].leased_position.store(NO_LEASE);
+        header_->readers[reader_slot_].pid.store(0);
+    }
+    munmap(mapped_, mapped_size_);
+    if (owner_)
+    {
+        shm_unlink(name_.c_str());
+    }
+}
+
+std::optional<ShmDescriptor> ShmRing::write(const char *data, size_t size)
+{
+    uint64_t capacity = header_->capacity;
+    if (size > capacity)
+    {
+        throw std::invalid_argument("Data block of " + std::to_string(size) +
+                                    " bytes does not fit into the shared memory ring of " + std::to_string(capacity) +
+                                    " bytes");
+    }
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    uint64_t reserved_position = header_->reserved_position.load(std::memory_order_relaxed);
+    uint64_t position = (reserved_position + SHM_BLOCK_ALIGNMENT - 1) / SHM_BLOCK_ALIGNMENT * SHM_BLOCK_ALIGNMENT;
+    if (position % capacity + size > capacity)
+    {
+        // Blocks never wrap: skip the tail of the ring and start again at its beginning
+        position += capacity - position % capacity;
+    }
+    // Readers of blocks in the region about to be overwritten see this before any of the new bytes. It is published
+    // before the leases are checked, and readers lease before they check it, so either the writer sees a new lease or
+    // the reader sees the reservation and does not return the view.
+    header_->reserved_position.store(position + size);
+    for (const ReaderSlot &reader : header_->readers)
+    {
+        uint64_t leased_position = reader.leased_position.load();
+        if (leased_position != NO_LEASE && leased_position + capacity < position + size)
+        {
+            header_->reserved_position.store(reserved_position);
+            return std::nullopt;
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(data_ + position % capacity, data, size);
+    header_->committed_position.store(position + size, std::memory_order_release);
+    return ShmDescriptor{header_->segment_id, position, size};
+}
+
+SharedBytes ShmRing::read(const ShmDescriptor &descriptor, bool copy) const
+{
+    if (!owner_ && descriptor.segment_id != header_->segment_id)
+    {
+        return remapped_ring_(descriptor.segment_id)->read(descriptor, copy);
+    }
+    if (!is_valid_(descriptor))
+    {
+        throw std::runtime_error("Shared memory block was overwritten before it could be read. Consider increasing "
+                                 "the shared memory size of the server.");
+    }
+    const char *block = data_ + descriptor.position % header_->capacity;
+    if (!copy)
+    {
+        std::shared_ptr<const char> lease = lease_(descriptor.position, block);
+        if (lease != nullptr)
+        {
+            if (!is_valid_(descriptor))
+            {
+                throw std::runtime_error("Shared memory block was overwritten before it could be read. Consider "
+                                         "increasing the shared memory size of the server.");
+            }
+            return SharedBytes(lease, block, descriptor.length);
+        }
+    }
+    SharedBytes data(block, descriptor.length);
+    // Seqlock-style validation: the copy is only usable if the writer did not reach the block while copying
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!is_valid_(descriptor))
+    {
+        throw std::runtime_error("Shared memory block was overwritten while it was being read. Consider increasing "
+                                 "the shared memory size of the server.");
+    }
+    return data;
+}
+
+std::shared_ptr<const char> ShmRing::lease_(uint64_t position, const char *block) const
+{
+    std::lock_guard<std::mutex> lock(lease_mutex_);
+    for (size_t i = 0; reader_slot_ < 0 && i < MAX_READERS; ++i)
+    {
+        int32_t free_pid = 0;
+        if (header_->readers[i].pid.compare_exchange_strong(free_pid, static_cast<int32_t>(getpid())))
+        {
+            reader_slot_ = static_cast<int>(i);
+        }
+    }
+    if (reader_slot_ < 0)
+    {
+        return nullptr;
+    }
+    leased_positions_.insert(position);
+    header_->readers[reader_slot_].leased_position.store(*leased_positions_.begin());
+    std::shared_ptr<const ShmRing> ring = shared_from_this();
+    return std::shared_ptr<const char>(block, [ring, position](const char *) { ring->release_(position); });
+}
+
+void ShmRing::release_(uint64_t position) const
+{
+    std::lock_guard<std::mutex> lock(lease_mutex_);
+    leased_positions_.erase(leased_positions_.find(position));
+    header_->readers[reader_slot_].leased_position.store(leased_positions_.empty() ? NO_LEASE
+                                                                                   : *leased_positions_.begin());
+}
+
+std::shared_ptr<const ShmRing> ShmRing::remapped_ring_(uint64_t segment_id) const
+{
+    std::lock_guard<std::mutex> lock(remap_mutex_);
+    if (remapped_ == nullptr || remapped_->segment_id() != segment_id)
+    {
+        // The server was restarted and created a new segment under the same name
+        remapped_ = std::make_shared<ShmRing>(name_);
+        if (remapped_->segment_id() != segment_id)
+        {
+            throw std::runtime_error("Shared memory segment " + name_ + " of the block no longer exists");
+        }
+    }
+    return remapped_;
+}
+
+bool ShmRing::is_valid_(const ShmDescriptor &descriptor) const
+{
+    uint64_t capacity = header_->capacity;
+    if (descriptor.segment_id != header_->segment_id || descriptor.length > capacity ||
+        descriptor.position % capacity + descriptor.length > capacity)
+    {
+        return false;
+    }
+    // The reservation is loaded sequentially consistent, to pair with the writer's lease check
+    return descriptor.position + descriptor.length <= header_->committed_position.load(std::memory_order_acquire) &&
+           header_->reserved_position.load() <= descriptor.position + capacity;
+}
+
+uint64_t ShmRing::segment_id() const
+{
+    return header_->segment_id;
+}
+
+size_t ShmRing::capacity() const
+{
+    return header_->capacity;
+}
+
+std::string ShmRing::name_from_endpoint(const std::string &endpoint)
+{
+    if (endpoint.find("ipc://") != 0)
+    {
+        throw std::invalid_argument("Shared memory is only available for ipc:// endpoints");
+    }
+    std::string name = "/zmq_interface";
+    for (char c : endpoint.substr(6))
+    {
+        name.push_back(c == '/' ? '_' : c);
+    }
+    return name;
+}
+
+std::string ShmRing::encode_descriptor(const ShmDescriptor &descriptor)
+{
+    return std::string(reinterpret_cast<const char *>(&descriptor), sizeof(ShmDescriptor));
+}
+
+ShmDescriptor ShmRing::decode_descriptor(const char *data, size_t size)
+{
+    if (size != sizeof(ShmDescriptor))
+    {
+        throw std::invalid_argument("Shared memory descriptor must be " + std::to_string(sizeof(ShmDescriptor)) +
+                                    " bytes, but got " + std::to_string(size));
+    }
+    ShmDescriptor descriptor;
+    std::memcpy(&descriptor, data, sizeof(ShmDescriptor));
+    return descriptor;
+}
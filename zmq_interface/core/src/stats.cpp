@@ -0,0 +1,82 @@
+#include "stats.h"
+#include <cstdio>
+
+void LatencyHistogram::record(int64_t duration_us)
+{
+    size_t bucket = 0;
+    for (uint64_t upper = 1; bucket + 1 < BUCKET_NUM && duration_us >= static_cast<int64_t>(upper); upper <<= 1)
+    {
+        bucket++;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_us_.fetch_add(duration_us > 0 ? duration_us : 0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    return count_.load(std::memory_order_relaxed);
+}
+
+std::string LatencyHistogram::to_json() const
+{
+    std::array<uint64_t, BUCKET_NUM> buckets;
+    uint64_t count = 0;
+    for (size_t i = 0; i < BUCKET_NUM; i++)
+    {
+        buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        count += buckets[i];
+    }
+    // Computed from the same bucket snapshot as the percentiles, which count_ may be ahead of
+    auto percentile = [&buckets, count](double p) {
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKET_NUM; i++)
+        {
+            seen += buckets[i];
+            if (seen > 0 && seen >= p * count)
+            {
+                return uint64_t(1) << i;
+            }
+        }
+        return uint64_t(0);
+    };
+    std::string json = "{\"count\": " + std::to_string(count) +
+                       ", \"sum_us\": " + std::to_string(sum_us_.load(std::memory_order_relaxed)) +
+                       ", \"p50_us\": " + std::to_string(percentile(0.5)) +
+                       ", \"p99_us\": " + std::to_string(percentile(0.99)) + ", \"buckets\": {";
+    bool first = true;
+    for (size_t i = 0; i < BUCKET_NUM; i++)
+    {
+        if (buckets[i] == 0)
+        {
+            continue;
+        }
+        json += (first ? "\"" : ", \"") + std::to_string(uint64_t(1) << i) + "\": " + std::to_string(buckets[i]);
+        first = false;
+    }
+    return json + "}}";
+}
+
+std::string json_escape(const std::string &str)
+{
+    std::string escaped = "\"";
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            escaped += buffer;
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+    return escaped + "\"";
+}
@@ -0,0 +1,195 @@
+#include "timed_ring.h"
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+TimedRing::TimedRing(size_t capacity)
+    : capacity_(capacity), slots_(new Slot[capacity]), head_(0), tail_(0), write_count_(0)
+{
+    if (capacity == 0)
+    {
+        throw std::invalid_argument("Ring capacity must be positive");
+    }
+}
+
+void TimedRing::push_back(const SharedBytes &data_ptr, double timestamp)
+{
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_relaxed) == capacity_)
+    {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    write_slot_(head, data_ptr, timestamp);
+    head_.store(head + 1, std::memory_order_release);
+}
+
+void TimedRing::insert(size_t i, const SharedBytes &data_ptr, double timestamp)
+{
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail == capacity_)
+    {
+        throw std::runtime_error("Cannot insert into a full ring");
+    }
+    if (i >= head - tail)
+    {
+        push_back(data_ptr, timestamp);
+        return;
+    }
+    uint64_t rewrites = rewrites_.load(std::memory_order_relaxed);
+    rewrites_.store(rewrites + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    // Shift the newer blocks up by one slot, newest first
+    for (uint64_t index = head; index > tail + i; --index)
+    {
+        TimedPtr ptr = at(index - 1 - tail);
+        write_slot_(index, std::get<0>(ptr), std::get<1>(ptr));
+    }
+    write_slot_(tail + i, data_ptr, timestamp);
+    head_.store(head + 1, std::memory_order_relaxed);
+    rewrites_.store(rewrites + 2, std::memory_order_release);
+}
+
+void TimedRing::pop_front()
+{
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    tail_.store(tail + 1, std::memory_order_release);
+    // Release the block right away instead of when the slot is reused
+    write_slot_(tail, SharedBytes(), 0);
+}
+
+void TimedRing::pop_back()
+{
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    head_.store(head - 1, std::memory_order_release);
+    write_slot_(head - 1, SharedBytes(), 0);
+}
+
+void TimedRing::clear()
+{
+    while (size() > 0)
+    {
+        pop_front();
+    }
+}
+
+TimedPtr TimedRing::at(size_t i) const
+{
+    const Slot &slot = slots_[(tail_.load(std::memory_order_relaxed) + i) % capacity_];
+    return TimedPtr(SharedBytes(std::atomic_load(&slot.owner), slot.data.load(std::memory_order_relaxed),
+                                slot.size.load(std::memory_order_relaxed)),
+                    slot.timestamp.load(std::memory_order_relaxed));
+}
+
+double TimedRing::timestamp_at(size_t i) const
+{
+    return slots_[(tail_.load(std::memory_order_relaxed) + i) % capacity_].timestamp.load(std::memory_order_relaxed);
+}
+
+size_t TimedRing::data_size_at(size_t i) const
+{
+    return slots_[(tail_.load(std::memory_order_relaxed) + i) % capacity_].size.load(std::memory_order_relaxed);
+}
+
+size_t TimedRing::size() const
+{
+    return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_relaxed);
+}
+
+size_t TimedRing::capacity() const
+{
+    return capacity_;
+}
+
+std::vector<TimedPtr> TimedRing::peek(EndType end_type, int32_t n) const
+{
+    if (end_type != EndType::LATEST && end_type != EndType::EARLIEST)
+    {
+        throw std::runtime_error("Invalid end type");
+    }
+    while (true)
+    {
+        uint64_t rewrites = rewrites_.load(std::memory_order_acquire);
+        if (rewrites % 2 == 0)
+        {
+            std::vector<TimedPtr> ret = peek_once_(end_type, n);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (rewrites_.load(std::memory_order_relaxed) == rewrites)
+            {
+                return ret;
+            }
+        }
+        std::this_thread::yield();
+    }
+}
+
+std::vector<TimedPtr> TimedRing::peek_once_(EndType end_type, int32_t n) const
+{
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    uint64_t head = head_.load(std::memory_order_acquire);
+    if (head <= tail)
+    {
+        return {};
+    }
+    uint64_t count = std::min<uint64_t>(head - tail, capacity_);
+    if (n >= 0 && static_cast<uint64_t>(n) < count)
+    {
+        count = n;
+    }
+    uint64_t begin = end_type == EndType::LATEST ? head - count : tail;
+    std::vector<TimedPtr> ret;
+    ret.reserve(count);
+    TimedPtr ptr;
+    for (uint64_t index = begin; index < begin + count; ++index)
+    {
+        // Slots that fail validation were evicted or popped after the indices were read
+        if (read_slot_(index, ptr))
+        {
+            ret.push_back(std::move(ptr));
+        }
+    }
+    return ret;
+}
+
+void TimedRing::write_slot_(uint64_t index, const SharedBytes &data_ptr, double timestamp)
+{
+    Slot &slot = slots_[index % capacity_];
+    uint64_t sequence = 2 * ++write_count_;
+    slot.sequence.store(sequence - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.index.store(index, std::memory_order_relaxed);
+    std::atomic_store(&slot.owner, data_ptr.owner());
+    slot.data.store(data_ptr.data(), std::memory_order_relaxed);
+    slot.size.store(data_ptr.size(), std::memory_order_relaxed);
+    slot.timestamp.store(timestamp, std::memory_order_relaxed);
+    slot.sequence.store(sequence, std::memory_order_release);
+}
+
+bool TimedRing::read_slot_(uint64_t index, TimedPtr &ptr) const
+{
+    const Slot &slot = slots_[index % capacity_];
+    uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence == 0 || sequence % 2 == 1 || slot.index.load(std::memory_order_relaxed) != index)
+    {
+        return false;
+    }
+    std::shared_ptr<const void> owner = std::atomic_load(&slot.owner);
+    const char *data = slot.data.load(std::memory_order_relaxed);
+    size_t size = slot.size.load(std::memory_order_relaxed);
+    double timestamp = slot.timestamp.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence || owner == nullptr)
+    {
+        return false;
+    }
+    ptr = TimedPtr(SharedBytes(std::move(owner), data, size), timestamp);
+    return true;
+}
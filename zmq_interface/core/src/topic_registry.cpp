@@ -0,0 +1,90 @@
+#include "topic_registry.h"
+#include <stdexcept>
+
+TopicRegistry::TopicRegistry()
+    : topics_(std::make_shared<const TopicMap>()), handle_table_(std::make_shared<const HandleTable>())
+{
+}
+
+uint32_t TopicRegistry::add_topic(std::shared_ptr<DataTopic> topic)
+{
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    std::shared_ptr<const TopicMap> current = snapshot();
+    if (current->find(topic->name()) != current->end())
+    {
+        return 0;
+    }
+    std::shared_ptr<HandleTable> updated_handles = std::make_shared<HandleTable>(*std::atomic_load(&handle_table_));
+    updated_handles->push_back(topic);
+    uint32_t handle = updated_handles->size();
+    handles_.emplace(topic->name(), handle);
+    std::shared_ptr<TopicMap> updated = std::make_shared<TopicMap>(*current);
+    updated->emplace(topic->name(), std::move(topic));
+    // The handle is published first, so that a topic found by name always has a handle that finds it as well
+    std::atomic_store(&handle_table_, std::shared_ptr<const HandleTable>(std::move(updated_handles)));
+    std::atomic_store(&topics_, std::shared_ptr<const TopicMap>(std::move(updated)));
+    return handle;
+}
+
+std::shared_ptr<DataTopic> TopicRegistry::find(const std::string &topic) const
+{
+    std::shared_ptr<const TopicMap> topics = snapshot();
+    auto it = topics->find(topic);
+    if (it == topics->end())
+    {
+        return nullptr;
+    }
+    return it->second;
+}
+
+std::shared_ptr<DataTopic> TopicRegistry::find(uint32_t handle) const
+{
+    std::shared_ptr<const HandleTable> handle_table = std::atomic_load(&handle_table_);
+    if (handle == 0 || handle > handle_table->size())
+    {
+        return nullptr;
+    }
+    return (*handle_table)[handle - 1];
+}
+
+uint32_t TopicRegistry::handle(const std::string &topic)
+{
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    auto it = handles_.find(topic);
+    return it == handles_.end() ? 0 : it->second;
+}
+
+std::shared_ptr<const TopicRegistry::TopicMap> TopicRegistry::snapshot() const
+{
+    return std::atomic_load(&topics_);
+}
+
+static std::mutex local_endpoints_mutex;
+static std::unordered_map<std::string, std::shared_ptr<TopicRegistry>> local_endpoints;
+
+void register_local_endpoint(const std::string &endpoint, std::shared_ptr<TopicRegistry> topics)
+{
+    std::lock_guard<std::mutex> lock(local_endpoints_mutex);
+    if (!local_endpoints.emplace(endpoint, std::move(topics)).second)
+    {
+        throw std::invalid_argument("Endpoint " + endpoint + " is already served in this process");
+    }
+}
+
+void unregister_local_endpoint(const std::string &endpoint)
+{
+    std::lock_guard<std::mutex> lock(local_endpoints_mutex);
+    local_endpoints.erase(endpoint);
+}
+
+std::shared_ptr<TopicRegistry> find_local_endpoint(const std::string &endpoint)
+{
+    std::lock_guard<std::mutex> lock(local_endpoints_mutex);
+    auto it = local_endpoints.find(endpoint);
+    return it == local_endpoints.end() ? nullptr : it->second;
+}
+
+bool is_local_endpoint(const std::string &endpoint)
+{
+    return endpoint.find("inproc://") == 0;
+}
@@ -0,0 +1,278 @@
+#include "zmq_async_client.h"
+#include <algorithm>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+static const char *ASYNC_REQUEST_ENDPOINT = "inproc://async_requests";
+
+ZMQAsyncClient::ZMQAsyncClient(const std::string &client_name, const std::string &server_endpoint, bool zero_copy)
+    : client_name_(client_name), zero_copy_(zero_copy), logger_(spdlog::stdout_color_mt(client_name)), context_(1),
+      socket_(context_, zmq::socket_type::dealer), request_sender_(context_, zmq::socket_type::push),
+      request_receiver_(context_, zmq::socket_type::pull), poller_timeout_ms_(100), running_(false),
+      next_request_id_(0), steady_clock_start_time_us_(steady_clock_us())
+{
+    logger_->set_pattern("[%H:%M:%S %n %^%l%$] %v");
+    socket_.connect(server_endpoint);
+    request_receiver_.bind(ASYNC_REQUEST_ENDPOINT);
+    request_sender_.connect(ASYNC_REQUEST_ENDPOINT);
+    running_ = true;
+    background_thread_ = std::thread(&ZMQAsyncClient::background_loop_, this);
+}
+
+ZMQAsyncClient::~ZMQAsyncClient()
+{
+    close();
+    fail_all_requests_("Client was closed before the reply arrived");
+    request_sender_.close();
+    request_receiver_.close();
+    socket_.close();
+    context_.close();
+}
+
+void ZMQAsyncClient::close()
+{
+    running_ = false;
+    if (background_thread_.joinable())
+    {
+        background_thread_.join();
+    }
+}
+
+void ZMQAsyncClient::peek_data(const std::string &topic, EndType end_type, int32_t n, double timeout,
+                               Callback callback)
+{
+    ZMQMessage message(topic, CmdType::PEEK_DATA, end_type, get_timestamp(), encode_request_data_(int32_to_bytes(n)));
+    send_request(message, timeout, std::move(callback));
+}
+
+void ZMQAsyncClient::pop_data(const std::string &topic, EndType end_type, int32_t n, double timeout,
+                              Callback callback)
+{
+    ZMQMessage message(topic, CmdType::POP_DATA, end_type, get_timestamp(), encode_request_data_(int32_to_bytes(n)));
+    send_request(message, timeout, std::move(callback));
+}
+
+void ZMQAsyncClient::peek_range(const std::string &topic, double start_time, double end_time, double timeout,
+                                Callback callback)
+{
+    ZMQMessage message(topic, CmdType::PEEK_RANGE, EndType::NONE, get_timestamp(),
+                       encode_request_data_(double_to_bytes(start_time) + double_to_bytes(end_time)));
+    send_request(message, timeout, std::move(callback));
+}
+
+void ZMQAsyncClient::peek_nearest(const std::string &topic, double timestamp, int32_t k, double timeout,
+                                  Callback callback)
+{
+    ZMQMessage message(topic, CmdType::PEEK_NEAREST, EndType::NONE, get_timestamp(),
+                       encode_request_data_(double_to_bytes(timestamp) + int32_to_bytes(k)));
+    send_request(message, timeout, std::move(callback));
+}
+
+void ZMQAsyncClient::peek_since(const std::string &topic, uint64_t cursor, int32_t n, double timeout,
+                                Callback callback)
+{
+    ZMQMessage message(topic, CmdType::PEEK_SINCE, EndType::NONE, get_timestamp(),
+                       encode_request_data_(uint64_to_bytes(cursor) + int32_to_bytes(n)));
+    send_request(message, timeout, std::move(callback));
+}
+
+void ZMQAsyncClient::peek_batch(const std::vector<BatchSpec> &specs, double timeout, Callback callback)
+{
+    ZMQMessage message("", CmdType::PEEK_BATCH, EndType::NONE, get_timestamp(),
+                       encode_request_data_(encode_batch_request(specs)));
+    send_request(message, timeout, std::move(callback));
+}
+
+void ZMQAsyncClient::peek_aligned(const std::vector<std::string> &topics, double timestamp, double timeout,
+                                  Callback callback)
+{
+    ZMQMessage message("", CmdType::PEEK_ALIGNED, EndType::NONE, get_timestamp(),
+                       encode_request_data_(encode_aligned_request(topics, timestamp)));
+    send_request(message, timeout, std::move(callback));
+}
+
+void ZMQAsyncClient::send_request(ZMQMessage &message, double timeout, Callback callback)
+{
+    if (!running_)
+    {
+        throw std::runtime_error("Client is closed");
+    }
+    uint64_t request_id = next_request_id_++;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    if (timeout > 0)
+    {
+        deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                          std::chrono::duration<double>(timeout));
+    }
+    {
+        std::lock_guard<std::mutex> lock(pending_requests_mutex_);
+        pending_requests_[request_id] = PendingRequest{message.cmd(), deadline, std::move(callback)};
+    }
+    std::string request_id_str = uint64_to_bytes(request_id);
+    std::string serialized = message.serialize();
+    std::lock_guard<std::mutex> lock(request_sender_mutex_);
+    request_sender_.send(zmq::message_t(request_id_str.data(), request_id_str.size()), zmq::send_flags::sndmore);
+    request_sender_.send(zmq::message_t(serialized.data(), serialized.size()), zmq::send_flags::none);
+}
+
+std::string ZMQAsyncClient::encode_request_data_(const std::string &arguments)
+{
+    return arguments + static_cast<char>(RequestFlag::ACCEPT_CODECS);
+}
+
+double ZMQAsyncClient::get_timestamp()
+{
+    return (steady_clock_us() - steady_clock_start_time_us_) / 1e6;
+}
+
+void ZMQAsyncClient::reset_start_time(int64_t system_time_us)
+{
+    steady_clock_start_time_us_ = steady_clock_us() + (system_time_us - system_clock_us());
+}
+
+bool ZMQAsyncClient::zero_copy() const
+{
+    return zero_copy_;
+}
+
+void ZMQAsyncClient::background_loop_()
+{
+    zmq::pollitem_t poller_items[] = {{request_receiver_, 0, ZMQ_POLLIN, 0}, {socket_, 0, ZMQ_POLLIN, 0}};
+    std::chrono::milliseconds poll_timeout = poller_timeout_ms_;
+    while (running_)
+    {
+        zmq::poll(poller_items, 2, poll_timeout.count());
+        if (poller_items[0].revents & ZMQ_POLLIN)
+        {
+            // [request id, request] -> DEALER envelope [request id, empty delimiter, request]
+            zmq::message_t request_id;
+            zmq::message_t request;
+            (void)request_receiver_.recv(request_id);
+            (void)request_receiver_.recv(request);
+            socket_.send(request_id, zmq::send_flags::sndmore);
+            socket_.send(zmq::message_t(), zmq::send_flags::sndmore);
+            socket_.send(request, zmq::send_flags::none);
+        }
+        if (poller_items[1].revents & ZMQ_POLLIN)
+        {
+            std::vector<zmq::message_t> frames;
+            do
+            {
+                frames.emplace_back();
+                (void)socket_.recv(frames.back());
+            } while (frames.back().more());
+            handle_reply_(frames);
+        }
+        poll_timeout = expire_requests_();
+    }
+}
+
+void ZMQAsyncClient::handle_reply_(std::vector<zmq::message_t> &frames)
+{
+    if (frames.size() < 3 || frames[0].size() != sizeof(uint64_t) || frames[1].size() != 0)
+    {
+        logger_->warn("Received a reply with an invalid envelope. Ignoring it.");
+        return;
+    }
+    uint64_t request_id = bytes_to_uint64(std::string(frames[0].data<char>(), frames[0].size()));
+    PendingRequest request;
+    {
+        std::lock_guard<std::mutex> lock(pending_requests_mutex_);
+        auto it = pending_requests_.find(request_id);
+        if (it == pending_requests_.end())
+        {
+            logger_->debug("Received a reply for request {} after it expired. Ignoring it.", request_id);
+            return;
+        }
+        request = std::move(it->second);
+        pending_requests_.erase(it);
+    }
+
+    std::vector<zmq::message_t> reply_frames(std::make_move_iterator(frames.begin() + 2),
+                                             std::make_move_iterator(frames.end()));
+    std::vector<TimedPtr> ptrs;
+    std::exception_ptr error;
+    try
+    {
+        ZMQMessage reply_message(reply_frames);
+        // Compressed blocks are decoded here on the background thread, off the caller's thread
+        reply_message.enable_codec_index();
+        if (reply_message.cmd() == CmdType::ERROR)
+        {
+            throw std::runtime_error("Server returned error: " + reply_message.data_str());
+        }
+        if (reply_message.cmd() != request.cmd)
+        {
+            throw std::runtime_error("Command type mismatch. Sent " + std::to_string(static_cast<int>(request.cmd)) +
+                                     " but received " + std::to_string(static_cast<int>(reply_message.cmd())));
+        }
+        ptrs = reply_message.data_ptrs();
+    }
+    catch (const std::exception &)
+    {
+        error = std::current_exception();
+    }
+    try
+    {
+        request.callback(ptrs, error);
+    }
+    catch (const std::exception &e)
+    {
+        logger_->error("Callback for request {} raised an exception: {}", request_id, e.what());
+    }
+}
+
+std::chrono::milliseconds ZMQAsyncClient::expire_requests_()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point next_wakeup = now + poller_timeout_ms_;
+    std::vector<PendingRequest> expired_requests;
+    {
+        std::lock_guard<std::mutex> lock(pending_requests_mutex_);
+        for (auto it = pending_requests_.begin(); it != pending_requests_.end();)
+        {
+            if (it->second.deadline <= now)
+            {
+                expired_requests.push_back(std::move(it->second));
+                it = pending_requests_.erase(it);
+            }
+            else
+            {
+                next_wakeup = std::min(next_wakeup, it->second.deadline);
+                ++it;
+            }
+        }
+    }
+    for (PendingRequest &request : expired_requests)
+    {
+        try
+        {
+            request.callback({}, std::make_exception_ptr(RequestTimeoutError("Request timed out")));
+        }
+        catch (const std::exception &e)
+        {
+            logger_->error("Callback for an expired request raised an exception: {}", e.what());
+        }
+    }
+    // Round up so that the poller does not wake up just before the deadline
+    return std::chrono::duration_cast<std::chrono::milliseconds>(next_wakeup - now) + std::chrono::milliseconds(1);
+}
+
+void ZMQAsyncClient::fail_all_requests_(const std::string &reason)
+{
+    std::unordered_map<uint64_t, PendingRequest> pending_requests;
+    {
+        std::lock_guard<std::mutex> lock(pending_requests_mutex_);
+        pending_requests.swap(pending_requests_);
+    }
+    for (auto &it : pending_requests)
+    {
+        try
+        {
+            it.second.callback({}, std::make_exception_ptr(std::runtime_error(reason)));
+        }
+        catch (const std::exception &e)
+        {
+            logger_->error("Callback for request {} raised an exception: {}", it.first, e.what());
+        }
+    }
+}
@@ -1,81 +1,244 @@
 #include "zmq_client.h"
+#include <algorithm>
+#include <limits>
 
-ZMQClient::ZMQClient(const std::string &client_name, const std::string &server_endpoint)
+// How long the mirror thread waits for a reply before it gives up on its socket, and the step in which it checks
+// whether it should stop while waiting
+static constexpr int64_t MIRROR_REPLY_TIMEOUT_MS = 1000;
+static constexpr int64_t MIRROR_POLL_STEP_MS = 100;
+
+ZMQClient::ZMQClient(const std::string &client_name, const std::string &server_endpoint, bool zero_copy,
+                     bool shared_memory, uint8_t max_protocol_version)
     : context_(1), socket_(context_, zmq::socket_type::req), steady_clock_start_time_us_(steady_clock_us()),
-      last_retrieved_ptrs_(), logger_(spdlog::stdout_color_mt(client_name))
+      last_retrieved_ptrs_(), logger_(spdlog::stdout_color_mt(client_name)), zero_copy_(zero_copy),
+      max_protocol_version_(max_protocol_version), server_endpoint_(server_endpoint)
 {
+    if (max_protocol_version != PROTOCOL_V1 && max_protocol_version != PROTOCOL_V2)
+    {
+        throw std::invalid_argument("Protocol version must be 1 or 2");
+    }
     logger_->set_pattern("[%H:%M:%S %n %^%l%$] %v");
+    if (is_local_endpoint(server_endpoint))
+    {
+        local_topics_ = find_local_endpoint(server_endpoint);
+        if (local_topics_ == nullptr)
+        {
+            throw std::invalid_argument("No server in this process serves " + server_endpoint);
+        }
+        return;
+    }
     socket_.connect(server_endpoint);
+    if (shared_memory)
+    {
+        try
+        {
+            shm_ring_ = std::make_shared<ShmRing>(ShmRing::name_from_endpoint(server_endpoint));
+        }
+        catch (const std::exception &e)
+        {
+            logger_->warn("Shared memory is not available, falling back to the socket: {}", e.what());
+        }
+    }
 }
 
 ZMQClient::~ZMQClient()
 {
+    stop_mirroring_();
     socket_.close();
     context_.close();
 }
 
-pybind11::tuple ZMQClient::peek_data(const std::string &topic, std::string end_type, int32_t n)
+std::vector<TimedPtr> ZMQClient::peek_data(const std::string &topic, EndType end_type, int32_t n)
 {
-    std::string data_str = int32_to_bytes(n);
-    ZMQMessage message(topic, CmdType::PEEK_DATA, str_to_end_type(end_type), get_timestamp(), data_str);
-    std::vector<TimedPtr> reply_ptrs = send_request_(message);
-    pybind11::list data;
-    pybind11::list timestamps;
-    if (reply_ptrs.empty())
+    if (local_topics_ != nullptr)
     {
-        logger_->debug("No data available for topic: {}", topic);
+        if (end_type == EndType::NONE)
+        {
+            throw std::invalid_argument("End type cannot be NONE for peek_data");
+        }
+        return read_local_(topic, [&](DataTopic &data_topic) { return data_topic.peek_data_ptrs(end_type, n); });
     }
-    for (const TimedPtr ptr : reply_ptrs)
+    if (std::shared_ptr<Mirror> mirror = find_mirror_(topic))
     {
-        data.append(*std::get<0>(ptr));
-        timestamps.append(std::get<1>(ptr));
+        if (end_type == EndType::NONE)
+        {
+            throw std::invalid_argument("End type cannot be NONE for peek_data");
+        }
+        return read_mirror_(*mirror, [&](DataTopic &data_topic) { return data_topic.peek_data_ptrs(end_type, n); });
     }
-    return pybind11::make_tuple(data, timestamps);
+    return request_ptrs_(topic, CmdType::PEEK_DATA, end_type, int32_to_bytes(n));
 }
 
-pybind11::tuple ZMQClient::pop_data(const std::string &topic, std::string end_type, int32_t n)
+std::vector<TimedPtr> ZMQClient::pop_data(const std::string &topic, EndType end_type, int32_t n)
 {
-    std::string data_str = int32_to_bytes(n);
-    ZMQMessage message(topic, CmdType::POP_DATA, str_to_end_type(end_type), get_timestamp(), data_str);
-    std::vector<TimedPtr> reply_ptrs = send_request_(message);
-    pybind11::list data;
-    pybind11::list timestamps;
-    if (reply_ptrs.empty())
+    if (local_topics_ != nullptr)
     {
-        logger_->debug("No data available for topic: {}", topic);
+        if (end_type == EndType::NONE)
+        {
+            throw std::invalid_argument("End type cannot be NONE for pop_data");
+        }
+        return read_local_(topic, [&](DataTopic &data_topic) { return data_topic.pop_data_ptrs(end_type, n); });
+    }
+    return request_ptrs_(topic, CmdType::POP_DATA, end_type, int32_to_bytes(n));
+}
+
+std::vector<TimedPtr> ZMQClient::peek_range(const std::string &topic, double start_time, double end_time)
+{
+    if (local_topics_ != nullptr)
+    {
+        return read_local_(topic,
+                           [&](DataTopic &data_topic) { return data_topic.peek_range_ptrs(start_time, end_time); });
+    }
+    if (std::shared_ptr<Mirror> mirror = find_mirror_(topic))
+    {
+        return read_mirror_(*mirror,
+                            [&](DataTopic &data_topic) { return data_topic.peek_range_ptrs(start_time, end_time); });
+    }
+    return request_ptrs_(topic, CmdType::PEEK_RANGE, EndType::NONE,
+                         double_to_bytes(start_time) + double_to_bytes(end_time));
+}
+
+std::vector<TimedPtr> ZMQClient::peek_nearest(const std::string &topic, double timestamp, int32_t k)
+{
+    if (local_topics_ != nullptr)
+    {
+        return read_local_(topic, [&](DataTopic &data_topic) { return data_topic.peek_nearest_ptrs(timestamp, k); });
     }
-    for (const TimedPtr ptr : reply_ptrs)
+    if (std::shared_ptr<Mirror> mirror = find_mirror_(topic))
     {
-        data.append(*std::get<0>(ptr));
-        timestamps.append(std::get<1>(ptr));
+        return read_mirror_(*mirror, [&](DataTopic &data_topic) { return data_topic.peek_nearest_ptrs(timestamp, k); });
     }
-    return pybind11::make_tuple(data, timestamps);
+    return request_ptrs_(topic, CmdType::PEEK_NEAREST, EndType::NONE, double_to_bytes(timestamp) + int32_to_bytes(k));
 }
 
-// PyBytes ZMQClient::request_with_data(const std::string &topic, const PyBytes data)
-// {
-//     TimedPtr data_ptr = std::make_shared<pybind11::bytes>(data);
-//     ZMQMessage message(topic, CmdType::REQUEST_WITH_DATA, std::make_tuple(data_ptr, get_timestamp()));
-//     return *send_single_block_request_(message);
-// }
+SinceResult ZMQClient::peek_since(const std::string &topic, uint64_t cursor, int32_t n)
+{
+    if (local_topics_ != nullptr)
+    {
+        std::shared_ptr<DataTopic> data_topic = local_topics_->find(topic);
+        if (data_topic == nullptr)
+        {
+            return {};
+        }
+        SinceResult result = data_topic->peek_since_ptrs(cursor, n);
+        data_topic->decode_blocks(result.ptrs);
+        std::lock_guard<std::mutex> lock(request_mutex_);
+        last_retrieved_ptrs_ = result.ptrs;
+        return result;
+    }
+    return split_since_result(
+        request_ptrs_(topic, CmdType::PEEK_SINCE, EndType::NONE, uint64_to_bytes(cursor) + int32_to_bytes(n)));
+}
 
-pybind11::tuple ZMQClient::get_last_retrieved_data()
+std::vector<std::vector<TimedPtr>> ZMQClient::peek_batch(const std::vector<BatchSpec> &specs)
 {
-    if (last_retrieved_ptrs_.empty())
+    if (local_topics_ != nullptr)
     {
-        return pybind11::make_tuple(pybind11::list(), pybind11::list());
+        std::vector<std::vector<TimedPtr>> results;
+        for (const BatchSpec &spec : specs)
+        {
+            results.push_back(peek_data(std::get<0>(spec), str_to_end_type(std::get<1>(spec)), std::get<2>(spec)));
+        }
+        return results;
     }
-    pybind11::list data;
-    pybind11::list timestamps;
-    for (const TimedPtr ptr : last_retrieved_ptrs_)
+    ZMQMessage message("", CmdType::PEEK_BATCH, EndType::NONE, get_timestamp(),
+                       encode_request_data_(encode_batch_request(specs)));
+    return split_batch_results(send_request_(message));
+}
+
+std::vector<std::vector<TimedPtr>> ZMQClient::peek_aligned(const std::vector<std::string> &topics, double timestamp)
+{
+    if (local_topics_ != nullptr)
     {
-        data.append(*std::get<0>(ptr));
-        timestamps.append(std::get<1>(ptr));
+        std::vector<std::shared_ptr<DataTopic>> data_topics;
+        for (const std::string &topic : topics)
+        {
+            data_topics.push_back(local_topics_->find(topic));
+        }
+        std::vector<std::vector<TimedPtr>> results = DataTopic::peek_nearest_aligned(data_topics, timestamp);
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            if (data_topics[i] != nullptr)
+            {
+                data_topics[i]->decode_blocks(results[i]);
+            }
+        }
+        return results;
+    }
+    ZMQMessage message("", CmdType::PEEK_ALIGNED, EndType::NONE, get_timestamp(),
+                       encode_request_data_(encode_aligned_request(topics, timestamp)));
+    return split_batch_results(send_request_(message));
+}
+
+std::vector<TimedPtr> ZMQClient::read_local_(const std::string &topic,
+                                             const std::function<std::vector<TimedPtr>(DataTopic &)> &read)
+{
+    std::shared_ptr<DataTopic> data_topic = local_topics_->find(topic);
+    if (data_topic == nullptr)
+    {
+        logger_->debug("No data available for topic: {}", topic);
+        return {};
     }
-    return pybind11::make_tuple(data, timestamps);
+    // The blocks are shared with the topic, only their reference counts change
+    std::vector<TimedPtr> ptrs = read(*data_topic);
+    data_topic->decode_blocks(ptrs);
+    std::lock_guard<std::mutex> lock(request_mutex_);
+    last_retrieved_ptrs_ = ptrs;
+    return ptrs;
+}
+
+void ZMQClient::check_remote_(const std::string &action) const
+{
+    if (local_topics_ != nullptr)
+    {
+        throw std::runtime_error(action + " is not available for clients attached to a server in the same process");
+    }
+}
+
+std::vector<TimedPtr> ZMQClient::request_ptrs_(const std::string &topic, CmdType cmd, EndType end_type,
+                                               const std::string &arguments)
+{
+    ZMQMessage message(topic, cmd, end_type, get_timestamp(), encode_request_data_(arguments));
+    std::vector<TimedPtr> reply_ptrs = send_request_(message);
+    if (reply_ptrs.empty())
+    {
+        logger_->debug("No data available for topic: {}", topic);
+    }
+    return reply_ptrs;
+}
+
+SharedBytes ZMQClient::request_with_data(const std::string &topic, const SharedBytes &data)
+{
+    check_remote_("request_with_data");
+    double timestamp = get_timestamp();
+    ZMQMessage message(topic, CmdType::REQUEST_WITH_DATA, EndType::NONE, timestamp, {TimedPtr(data, timestamp)});
+    std::vector<TimedPtr> reply_ptrs = send_request_(message);
+    if (reply_ptrs.size() != 1)
+    {
+        throw std::runtime_error("Reply should have 1 data block, but got " + std::to_string(reply_ptrs.size()));
+    }
+    return std::get<0>(reply_ptrs[0]);
+}
+
+std::vector<TimedPtr> ZMQClient::get_last_retrieved_ptrs() const
+{
+    std::lock_guard<std::mutex> lock(request_mutex_);
+    return last_retrieved_ptrs_;
+}
+
+bool ZMQClient::zero_copy() const
+{
+    return zero_copy_;
 }
 
 double ZMQClient::get_timestamp()
+{
+    std::lock_guard<std::mutex> lock(clock_mutex_);
+    double local_timestamp = get_local_timestamp_();
+    return clock_sync_.synchronized() ? clock_sync_.to_remote(local_timestamp) : local_timestamp;
+}
+
+double ZMQClient::get_local_timestamp_() const
 {
     return static_cast<double>(steady_clock_us() - steady_clock_start_time_us_) / 1e6;
 }
@@ -83,57 +246,492 @@ double ZMQClient::get_timestamp()
 void ZMQClient::reset_start_time(int64_t system_time_us)
 {
     logger_->info("Resetting start time. Will clear all data retrieved before this time");
+    std::lock_guard<std::mutex> request_lock(request_mutex_);
+    std::lock_guard<std::mutex> clock_lock(clock_mutex_);
     last_retrieved_ptrs_.clear();
+    clock_sync_.reset();
     steady_clock_start_time_us_ = steady_clock_us() + (system_time_us - system_clock_us());
 }
 
-// TimedPtr ZMQClient::send_single_block_request_(const ZMQMessage &message)
-// {
-//     std::string serialized = message.serialize();
-//     zmq::message_t request(serialized.data(), serialized.size());
-//     socket_.send(request, zmq::send_flags::none);
-//     zmq::message_t reply;
-//     socket_.recv(reply);
-//     ZMQMessage reply_message(std::string(reply.data<char>(), reply.data<char>() + reply.size()), get_timestamp());
-//     if (reply_message.cmd() == CmdType::ERROR)
-//     {
-//         throw std::runtime_error("Server returned error: " + reply_message.data_str());
-//     }
-//     if (reply_message.cmd() != message.cmd())
-//     {
-//         throw std::runtime_error("Command type mismatch. Sent " + std::to_string(static_cast<int>(message.cmd())) +
-//                                  " but received " + std::to_string(static_cast<int>(reply_message.cmd())));
-//     }
-//     if (reply_message.cmd() == CmdType::GET_LATEST_DATA || reply_message.cmd() == CmdType::REQUEST_WITH_DATA)
-//     {
-//         last_retrieved_ptrs_ = {reply_message.data_ptr()};
-//         return reply_message.data_ptr();
-//     }
-//     throw std::runtime_error("Invalid command type: " + std::to_string(static_cast<int>(reply_message.cmd())));
-// }
+std::pair<double, double> ZMQClient::synchronize_time(int32_t samples)
+{
+    if (samples <= 0)
+    {
+        throw std::invalid_argument("Number of samples must be positive");
+    }
+    check_remote_("synchronize_time");
+    std::lock_guard<std::mutex> lock(request_mutex_);
+    std::string request_data = ZMQMessage("", CmdType::SYNCHRONIZE_TIME, EndType::NONE, 0, "").serialize();
+    for (int32_t i = 0; i < samples; i++)
+    {
+        double send_time = get_local_timestamp_();
+        socket_.send(zmq::message_t(request_data.data(), request_data.size()), zmq::send_flags::none);
+        std::vector<zmq::message_t> reply_frames;
+        do
+        {
+            reply_frames.emplace_back();
+            socket_.recv(reply_frames.back());
+        } while (reply_frames.back().more());
+        double receive_time = get_local_timestamp_();
+        ZMQMessage reply_message(reply_frames);
+        std::string data_str = reply_message.data_str();
+        if (reply_message.cmd() == CmdType::ERROR)
+        {
+            throw std::runtime_error("Server returned error: " + data_str);
+        }
+        if (reply_message.cmd() != CmdType::SYNCHRONIZE_TIME || data_str.size() != 2 * sizeof(double))
+        {
+            throw std::runtime_error("Invalid reply to a time synchronization request");
+        }
+        std::lock_guard<std::mutex> clock_lock(clock_mutex_);
+        clock_sync_.add_sample(send_time, bytes_to_double(data_str.substr(0, sizeof(double))),
+                               bytes_to_double(data_str.substr(sizeof(double))), receive_time);
+    }
+    std::pair<double, double> offset;
+    {
+        std::lock_guard<std::mutex> clock_lock(clock_mutex_);
+        if (!clock_sync_.update())
+        {
+            throw std::runtime_error("No valid time synchronization samples");
+        }
+        offset = std::make_pair(clock_sync_.offset(get_local_timestamp_()), clock_sync_.uncertainty());
+        logger_->info("Synchronized with the server's clock: offset {:.6f}s, uncertainty {:.1f}us, drift {:.2f}ppm",
+                      offset.first, offset.second * 1e6, clock_sync_.drift() * 1e6);
+    }
+    return offset;
+}
+
+std::pair<double, double> ZMQClient::get_clock_offset()
+{
+    std::lock_guard<std::mutex> lock(clock_mutex_);
+    return std::make_pair(clock_sync_.offset(get_local_timestamp_()), clock_sync_.uncertainty());
+}
+
+std::string ZMQClient::get_server_stats()
+{
+    check_remote_("get_server_stats");
+    ZMQMessage message("", CmdType::STATS, EndType::NONE, get_timestamp(), "");
+    std::vector<TimedPtr> ptrs = send_request_(message);
+    if (ptrs.size() != 1)
+    {
+        throw std::runtime_error("Invalid reply to a stats request");
+    }
+    return std::get<0>(ptrs[0]).str();
+}
+
+uint8_t ZMQClient::protocol_version() const
+{
+    return protocol_version_;
+}
+
+std::vector<zmq::message_t> ZMQClient::exchange_(std::vector<zmq::message_t> &request_frames)
+{
+    for (size_t i = 0; i < request_frames.size(); ++i)
+    {
+        socket_.send(request_frames[i],
+                     i + 1 < request_frames.size() ? zmq::send_flags::sndmore : zmq::send_flags::none);
+    }
+    std::vector<zmq::message_t> reply_frames;
+    do
+    {
+        reply_frames.emplace_back();
+        socket_.recv(reply_frames.back());
+    } while (reply_frames.back().more());
+    return reply_frames;
+}
+
+uint8_t ZMQClient::negotiate_protocol_()
+{
+    if (max_protocol_version_ == PROTOCOL_V1)
+    {
+        return PROTOCOL_V1;
+    }
+    // Sent in version 1, which servers without protocol negotiation answer with an unknown command error
+    ZMQMessage message("", CmdType::HANDSHAKE, EndType::NONE, get_timestamp(),
+                       std::string(1, static_cast<char>(max_protocol_version_)));
+    std::vector<zmq::message_t> request_frames = message.serialize_multipart();
+    std::vector<zmq::message_t> reply_frames = exchange_(request_frames);
+    ZMQMessage reply_message(reply_frames);
+    std::string data_str = reply_message.data_str();
+    if (reply_message.cmd() != CmdType::HANDSHAKE || data_str.size() != sizeof(uint8_t))
+    {
+        logger_->info("Server does not negotiate protocol versions. Using version 1.");
+        return PROTOCOL_V1;
+    }
+    uint8_t version = std::min<uint8_t>(static_cast<uint8_t>(data_str[0]), max_protocol_version_);
+    logger_->debug("Using protocol version {}", version);
+    return version;
+}
+
+uint32_t ZMQClient::topic_handle_(const std::string &topic)
+{
+    auto it = topic_handles_.find(topic);
+    if (it != topic_handles_.end())
+    {
+        return it->second;
+    }
+    ZMQMessage message(topic, CmdType::TOPIC_HANDLE, EndType::NONE, get_timestamp(), "");
+    message.set_protocol(PROTOCOL_V2);
+    std::vector<zmq::message_t> request_frames = message.serialize_multipart();
+    std::vector<zmq::message_t> reply_frames = exchange_(request_frames);
+    ZMQMessage reply_message(reply_frames);
+    std::string data_str = reply_message.data_str();
+    if (reply_message.cmd() != CmdType::TOPIC_HANDLE || data_str.size() != 2 * sizeof(uint32_t))
+    {
+        throw std::runtime_error("Invalid reply to a topic handle request for topic `" + topic + "`");
+    }
+    uint32_t session = bytes_to_uint32(data_str.substr(sizeof(uint32_t)));
+    if (session != session_)
+    {
+        // Handles of another server session are meaningless
+        topic_handles_.clear();
+        session_ = session;
+    }
+    uint32_t handle = bytes_to_uint32(data_str.substr(0, sizeof(uint32_t)));
+    topic_handles_.emplace(topic, handle);
+    return handle;
+}
+
+void ZMQClient::apply_protocol_(ZMQMessage &message)
+{
+    if (protocol_version_ == 0)
+    {
+        protocol_version_ = negotiate_protocol_();
+    }
+    if (protocol_version_ < PROTOCOL_V2)
+    {
+        return;
+    }
+    uint32_t handle = message.topic().empty() ? 0 : topic_handle_(message.topic());
+    message.set_protocol(PROTOCOL_V2, handle, session_);
+}
 
 std::vector<TimedPtr> ZMQClient::send_request_(ZMQMessage &message)
 {
-    std::vector<TimedPtr> reply_ptrs;
-    std::string serialized = message.serialize();
-    zmq::message_t request(serialized.data(), serialized.size());
-    socket_.send(request, zmq::send_flags::none);
-    zmq::message_t reply;
-    socket_.recv(reply);
-    ZMQMessage reply_message(std::string(reply.data<char>(), reply.data<char>() + reply.size()));
+    std::lock_guard<std::mutex> lock(request_mutex_);
+    apply_protocol_(message);
+    // Request blocks are sent as separate frames without copying them into one buffer
+    std::vector<zmq::message_t> request_frames = message.serialize_multipart();
+    std::vector<zmq::message_t> reply_frames = exchange_(request_frames);
+    ZMQMessage reply_message(reply_frames);
+    if (reply_message.cmd() == CmdType::ERROR && message.topic_handle() != 0 &&
+        reply_message.data_str() == STALE_TOPIC_HANDLE_ERROR)
+    {
+        // The server restarted since the handle was resolved: resolve it again and retry once
+        logger_->info("Topic handles are stale. Resolving them again.");
+        topic_handles_.clear();
+        apply_protocol_(message);
+        request_frames = message.serialize_multipart();
+        reply_frames = exchange_(request_frames);
+        reply_message = ZMQMessage(reply_frames);
+    }
+    last_retrieved_ptrs_ = reply_ptrs_(reply_message, message.cmd(), !zero_copy_);
+    return last_retrieved_ptrs_;
+}
+
+std::vector<TimedPtr> ZMQClient::reply_ptrs_(ZMQMessage &reply_message, CmdType cmd, bool copy_from_shm) const
+{
+    // Every request sets RequestFlag::ACCEPT_CODECS
+    reply_message.enable_codec_index();
+    if (shm_ring_ != nullptr)
+    {
+        reply_message.set_shm_ring(shm_ring_, copy_from_shm);
+    }
     if (reply_message.cmd() == CmdType::ERROR)
     {
         throw std::runtime_error("Server returned error: " + reply_message.data_str());
     }
-    if (reply_message.cmd() != message.cmd())
+    if (reply_message.cmd() != cmd)
     {
-        throw std::runtime_error("Command type mismatch. Sent " + std::to_string(static_cast<int>(message.cmd())) +
+        throw std::runtime_error("Command type mismatch. Sent " + std::to_string(static_cast<int>(cmd)) +
                                  " but received " + std::to_string(static_cast<int>(reply_message.cmd())));
     }
-    if (reply_message.cmd() == CmdType::PEEK_DATA || reply_message.cmd() == CmdType::POP_DATA)
+    if (reply_message.cmd() == CmdType::PEEK_DATA || reply_message.cmd() == CmdType::POP_DATA ||
+        reply_message.cmd() == CmdType::PEEK_RANGE || reply_message.cmd() == CmdType::PEEK_NEAREST ||
+        reply_message.cmd() == CmdType::PEEK_BATCH || reply_message.cmd() == CmdType::PEEK_ALIGNED ||
+        reply_message.cmd() == CmdType::PEEK_SINCE || reply_message.cmd() == CmdType::REQUEST_WITH_DATA ||
+        reply_message.cmd() == CmdType::STATS)
     {
-        last_retrieved_ptrs_ = reply_message.data_ptrs();
         return reply_message.data_ptrs();
     }
     throw std::runtime_error("Invalid command type: " + std::to_string(static_cast<int>(reply_message.cmd())));
 }
+
+std::string ZMQClient::encode_request_data_(const std::string &arguments) const
+{
+    uint8_t flag = static_cast<uint8_t>(RequestFlag::ACCEPT_CODECS);
+    if (shm_ring_ != nullptr)
+    {
+        flag |= static_cast<uint8_t>(RequestFlag::SHARED_MEMORY);
+    }
+    return arguments + static_cast<char>(flag);
+}
+
+void ZMQClient::mirror_topic(const std::string &topic, double max_remaining_time, double interval)
+{
+    if (max_remaining_time <= 0 || interval <= 0)
+    {
+        throw std::invalid_argument("Max remaining time and interval must be positive");
+    }
+    if (local_topics_ != nullptr)
+    {
+        logger_->info("Topic {} is read from the server in this process and is not mirrored", topic);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mirrors_mutex_);
+    auto it = mirrors_.find(topic);
+    if (it != mirrors_.end() && it->second->max_remaining_time == max_remaining_time)
+    {
+        it->second->interval = interval;
+    }
+    else
+    {
+        // A new copy starts from the server's stored blocks
+        std::shared_ptr<Mirror> mirror = std::make_shared<Mirror>();
+        mirror->data_topic = std::make_shared<DataTopic>(topic, max_remaining_time);
+        mirror->max_remaining_time = max_remaining_time;
+        mirror->interval = interval;
+        mirrors_[topic] = mirror;
+    }
+    if (!mirror_running_)
+    {
+        mirror_running_ = true;
+        mirror_thread_ = std::thread(&ZMQClient::mirror_loop_, this);
+    }
+    mirrors_condition_.notify_one();
+}
+
+void ZMQClient::unmirror_topic(const std::string &topic)
+{
+    std::lock_guard<std::mutex> lock(mirrors_mutex_);
+    mirrors_.erase(topic);
+}
+
+double ZMQClient::get_mirror_staleness(const std::string &topic)
+{
+    std::shared_ptr<Mirror> mirror = find_mirror_(topic);
+    if (mirror == nullptr)
+    {
+        throw std::invalid_argument("Topic " + topic + " is not mirrored");
+    }
+    int64_t refresh_time_us = mirror->refresh_time_us.load();
+    if (refresh_time_us == 0)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    return static_cast<double>(steady_clock_us() - refresh_time_us) / 1e6;
+}
+
+std::shared_ptr<ZMQClient::Mirror> ZMQClient::find_mirror_(const std::string &topic)
+{
+    std::lock_guard<std::mutex> lock(mirrors_mutex_);
+    if (mirrors_.empty())
+    {
+        return nullptr;
+    }
+    auto it = mirrors_.find(topic);
+    return it == mirrors_.end() ? nullptr : it->second;
+}
+
+std::vector<TimedPtr> ZMQClient::read_mirror_(Mirror &mirror,
+                                              const std::function<std::vector<TimedPtr>(DataTopic &)> &read)
+{
+    std::vector<TimedPtr> ptrs = read(*mirror.data_topic);
+    if (ptrs.empty())
+    {
+        logger_->debug("No data available for topic: {}", mirror.data_topic->name());
+    }
+    std::lock_guard<std::mutex> lock(request_mutex_);
+    last_retrieved_ptrs_ = ptrs;
+    return ptrs;
+}
+
+void ZMQClient::mirror_loop_()
+{
+    auto make_socket = [this]() {
+        zmq::socket_t socket(context_, zmq::socket_type::req);
+        socket.set(zmq::sockopt::linger, 0);
+        socket.connect(server_endpoint_);
+        return socket;
+    };
+    zmq::socket_t socket = make_socket();
+    mirror_protocol_version_ = 0;
+    std::unique_lock<std::mutex> lock(mirrors_mutex_);
+    while (mirror_running_)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point next_wakeup = now + std::chrono::seconds(1);
+        std::vector<std::pair<std::string, std::shared_ptr<Mirror>>> due;
+        for (auto &[topic, mirror] : mirrors_)
+        {
+            if (mirror->next_refresh <= now)
+            {
+                due.emplace_back(topic, mirror);
+            }
+            else
+            {
+                next_wakeup = std::min(next_wakeup, mirror->next_refresh);
+            }
+        }
+        if (due.empty())
+        {
+            mirrors_condition_.wait_until(lock, next_wakeup);
+            continue;
+        }
+        lock.unlock();
+        for (auto &[topic, mirror] : due)
+        {
+            try
+            {
+                if (!refresh_mirror_(socket, topic, *mirror))
+                {
+                    logger_->warn("Server did not answer the refresh of mirrored topic {}", topic);
+                    socket = make_socket();
+                    // Possibly another server by now
+                    mirror_protocol_version_ = 0;
+                }
+            }
+            catch (const std::exception &e)
+            {
+                logger_->warn("Failed to refresh mirrored topic {}: {}", topic, e.what());
+            }
+        }
+        lock.lock();
+        now = std::chrono::steady_clock::now();
+        for (auto &[topic, mirror] : due)
+        {
+            mirror->next_refresh = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                             std::chrono::duration<double>(mirror->interval));
+        }
+    }
+}
+
+bool ZMQClient::exchange_mirror_(zmq::socket_t &socket, ZMQMessage &message,
+                                 std::vector<zmq::message_t> &reply_frames)
+{
+    std::vector<zmq::message_t> request_frames = message.serialize_multipart();
+    for (size_t i = 0; i < request_frames.size(); ++i)
+    {
+        socket.send(request_frames[i],
+                    i + 1 < request_frames.size() ? zmq::send_flags::sndmore : zmq::send_flags::none);
+    }
+    zmq::pollitem_t poller_items[] = {{socket, 0, ZMQ_POLLIN, 0}};
+    int64_t waited_ms = 0;
+    while (zmq::poll(poller_items, 1, std::chrono::milliseconds(MIRROR_POLL_STEP_MS)) == 0)
+    {
+        waited_ms += MIRROR_POLL_STEP_MS;
+        std::lock_guard<std::mutex> lock(mirrors_mutex_);
+        if (waited_ms >= MIRROR_REPLY_TIMEOUT_MS || !mirror_running_)
+        {
+            return false;
+        }
+    }
+    reply_frames.clear();
+    do
+    {
+        reply_frames.emplace_back();
+        socket.recv(reply_frames.back());
+    } while (reply_frames.back().more());
+    return true;
+}
+
+bool ZMQClient::refresh_mirror_(zmq::socket_t &socket, const std::string &topic, Mirror &mirror, bool start_over)
+{
+    std::vector<zmq::message_t> reply_frames;
+    if (mirror_protocol_version_ == 0)
+    {
+        // Negotiated in version 1 like negotiate_protocol_, since the thread cannot use the client's socket
+        ZMQMessage handshake("", CmdType::HANDSHAKE, EndType::NONE, 0,
+                             std::string(1, static_cast<char>(max_protocol_version_)));
+        if (!exchange_mirror_(socket, handshake, reply_frames))
+        {
+            return false;
+        }
+        ZMQMessage reply_message(reply_frames);
+        std::string data_str = reply_message.data_str();
+        mirror_protocol_version_ =
+            reply_message.cmd() == CmdType::HANDSHAKE && data_str.size() == sizeof(uint8_t)
+                ? std::min<uint8_t>(static_cast<uint8_t>(data_str[0]), max_protocol_version_)
+                : PROTOCOL_V1;
+    }
+    if (mirror_protocol_version_ >= PROTOCOL_V2 && mirror.handle == 0)
+    {
+        ZMQMessage request(topic, CmdType::TOPIC_HANDLE, EndType::NONE, 0, "");
+        request.set_protocol(PROTOCOL_V2);
+        if (!exchange_mirror_(socket, request, reply_frames))
+        {
+            return false;
+        }
+        ZMQMessage reply_message(reply_frames);
+        std::string data_str = reply_message.data_str();
+        if (reply_message.cmd() != CmdType::TOPIC_HANDLE || data_str.size() != 2 * sizeof(uint32_t))
+        {
+            throw std::runtime_error("Invalid reply to a topic handle request for topic `" + topic + "`");
+        }
+        uint32_t handle = bytes_to_uint32(data_str.substr(0, sizeof(uint32_t)));
+        uint32_t session = bytes_to_uint32(data_str.substr(sizeof(uint32_t)));
+        if (handle == 0)
+        {
+            throw std::runtime_error("Server has no stored topic `" + topic + "`");
+        }
+        // Topics are never removed from a server, so the session identifies the topic that the copy is of
+        if (mirror.session != 0 && session != mirror.session)
+        {
+            logger_->info("Server of mirrored topic {} restarted, fetching it again", topic);
+            start_over = true;
+        }
+        mirror.handle = handle;
+        mirror.session = session;
+    }
+
+    ZMQMessage message(topic, CmdType::PEEK_SINCE, EndType::NONE, 0,
+                       encode_request_data_(uint64_to_bytes(start_over ? 0 : mirror.cursor) + int32_to_bytes(-1)));
+    if (mirror.handle != 0)
+    {
+        message.set_protocol(PROTOCOL_V2, mirror.handle, mirror.session);
+    }
+    if (!exchange_mirror_(socket, message, reply_frames))
+    {
+        return false;
+    }
+    ZMQMessage reply_message(reply_frames);
+    if (reply_message.cmd() == CmdType::ERROR && mirror.handle != 0 &&
+        reply_message.data_str() == STALE_TOPIC_HANDLE_ERROR)
+    {
+        // The server restarted: resolving the handle again tells the new session apart
+        mirror.handle = 0;
+        return refresh_mirror_(socket, topic, mirror, start_over);
+    }
+    // Blocks in the shared memory ring are copied out, since the copy keeps them after the ring wraps
+    SinceResult result = split_since_result(reply_ptrs_(reply_message, CmdType::PEEK_SINCE, true));
+    if (!start_over && (result.evicted || result.cursor < mirror.cursor))
+    {
+        // The server dropped blocks the copy never got, or its sequence numbers went back because a version 1 server
+        // recreated the topic. Either way, the copy no longer matches the server's topic.
+        logger_->info("Mirror of topic {} missed blocks of the server, fetching it again", topic);
+        return refresh_mirror_(socket, topic, mirror, true);
+    }
+    if (start_over)
+    {
+        mirror.data_topic->clear_data();
+    }
+    mirror.data_topic->add_data_ptrs(result.ptrs);
+    // Also drops blocks of a topic that receives no new ones, like the server's expiry thread
+    mirror.data_topic->expire_data();
+    mirror.cursor = result.cursor;
+    mirror.refresh_time_us.store(steady_clock_us());
+    return true;
+}
+
+void ZMQClient::stop_mirroring_()
+{
+    {
+        std::lock_guard<std::mutex> lock(mirrors_mutex_);
+        mirror_running_ = false;
+    }
+    mirrors_condition_.notify_one();
+    if (mirror_thread_.joinable())
+    {
+        mirror_thread_.join();
+    }
+}
@@ -1,4 +1,94 @@
 #include "zmq_message.h"
+#include <cassert>
+#include <cstring>
+
+static constexpr size_t V2_HEADER_SIZE = 24;
+static constexpr size_t V2_INDEX_ENTRY_SIZE = 24;
+
+static size_t align_up(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool is_v2_header(const char *data, size_t size)
+{
+    return size >= 2 && data[0] == 0 && static_cast<uint8_t>(data[1]) == PROTOCOL_V2_MARKER;
+}
+
+bool has_request_flag(RequestFlag flags, RequestFlag flag)
+{
+    return (static_cast<uint8_t>(flags) & static_cast<uint8_t>(flag)) != 0;
+}
+
+std::string cmd_type_to_str(CmdType cmd)
+{
+    switch (cmd)
+    {
+    case CmdType::PEEK_DATA:
+        return "PEEK_DATA";
+    case CmdType::POP_DATA:
+        return "POP_DATA";
+    case CmdType::REQUEST_WITH_DATA:
+        return "REQUEST_WITH_DATA";
+    case CmdType::SYNCHRONIZE_TIME:
+        return "SYNCHRONIZE_TIME";
+    case CmdType::STREAM_DATA:
+        return "STREAM_DATA";
+    case CmdType::PEEK_RANGE:
+        return "PEEK_RANGE";
+    case CmdType::PEEK_NEAREST:
+        return "PEEK_NEAREST";
+    case CmdType::PEEK_BATCH:
+        return "PEEK_BATCH";
+    case CmdType::PEEK_ALIGNED:
+        return "PEEK_ALIGNED";
+    case CmdType::PEEK_SINCE:
+        return "PEEK_SINCE";
+    case CmdType::STATS:
+        return "STATS";
+    case CmdType::HANDSHAKE:
+        return "HANDSHAKE";
+    case CmdType::TOPIC_HANDLE:
+        return "TOPIC_HANDLE";
+    case CmdType::ERROR:
+        return "ERROR";
+    default:
+        return "UNKNOWN";
+    }
+}
+
+bool peek_message_header(const char *data, size_t size, CmdType &cmd, std::string &topic, uint32_t &topic_handle)
+{
+    if (is_v2_header(data, size))
+    {
+        if (size < V2_HEADER_SIZE)
+        {
+            return false;
+        }
+        uint8_t topic_length = static_cast<uint8_t>(data[12]);
+        if (size < V2_HEADER_SIZE + topic_length)
+        {
+            return false;
+        }
+        cmd = static_cast<CmdType>(data[2]);
+        std::memcpy(&topic_handle, data + 4, sizeof(uint32_t));
+        topic.assign(data + V2_HEADER_SIZE, topic_length);
+        return true;
+    }
+    if (size < sizeof(uint8_t))
+    {
+        return false;
+    }
+    uint8_t topic_length = static_cast<uint8_t>(data[0]);
+    if (size < sizeof(uint8_t) + topic_length + sizeof(CmdType))
+    {
+        return false;
+    }
+    cmd = static_cast<CmdType>(data[sizeof(uint8_t) + topic_length]);
+    topic.assign(data + sizeof(uint8_t), topic_length);
+    topic_handle = 0;
+    return true;
+}
 
 ZMQMessage::ZMQMessage(const std::string &topic, CmdType cmd, EndType end_type, double timestamp,
                        const std::vector<TimedPtr> &data_ptrs)
@@ -16,23 +106,24 @@ ZMQMessage::ZMQMessage(const std::string &topic, CmdType cmd, EndType end_type,
 
 ZMQMessage::ZMQMessage(const std::string &serialized)
 {
-    uint8_t topic_length = static_cast<uint8_t>(serialized[0]);
-    if (serialized.size() < sizeof(uint8_t) + topic_length)
+    data_offset_ = decode_header_(serialized.data(), serialized.size());
+    data_str_ = std::string(serialized.begin() + data_offset_, serialized.end());
+}
+
+ZMQMessage::ZMQMessage(std::vector<zmq::message_t> &frames) : copy_from_shm_(true)
+{
+    if (frames.empty())
     {
-        throw std::invalid_argument("Serialized message is too short");
+        throw std::invalid_argument("Multipart message has no frames");
+    }
+    header_frame_ = std::make_shared<zmq::message_t>(std::move(frames[0]));
+    const char *header_data = header_frame_->data<char>();
+    data_offset_ = decode_header_(header_data, header_frame_->size());
+    data_str_ = std::string(header_data + data_offset_, header_data + header_frame_->size());
+    for (size_t i = 1; i < frames.size(); ++i)
+    {
+        payload_frames_.push_back(std::make_shared<zmq::message_t>(std::move(frames[i])));
     }
-    int decode_start_index = sizeof(uint8_t);
-    topic_ =
-        std::string(serialized.begin() + decode_start_index, serialized.begin() + decode_start_index + topic_length);
-    decode_start_index += topic_length;
-    cmd_ = static_cast<CmdType>(serialized[decode_start_index]);
-    decode_start_index += sizeof(CmdType);
-    end_type_ = static_cast<EndType>(serialized[decode_start_index]);
-    decode_start_index += sizeof(EndType);
-    timestamp_ = bytes_to_double(
-        std::string(serialized.begin() + decode_start_index, serialized.begin() + decode_start_index + sizeof(double)));
-    decode_start_index += sizeof(double);
-    data_str_ = std::string(serialized.begin() + decode_start_index, serialized.end());
 }
 
 std::string ZMQMessage::topic() const
@@ -40,6 +131,11 @@ std::string ZMQMessage::topic() const
     return topic_;
 }
 
+void ZMQMessage::set_topic(const std::string &topic)
+{
+    topic_ = topic;
+}
+
 CmdType ZMQMessage::cmd() const
 {
     return cmd_;
@@ -80,80 +176,342 @@ std::string ZMQMessage::data_str()
 
 std::string ZMQMessage::serialize()
 {
-    std::string serialized;
-    serialized.push_back(static_cast<char>(uint8_t(topic_.size())));
-    serialized.append(topic_);
-    serialized.push_back(static_cast<char>(cmd_));
-    serialized.push_back(static_cast<char>(end_type_));
-    serialized.append(double_to_bytes(timestamp_));
+    std::string serialized = encode_header_();
+    data_offset_ = serialized.size();
     serialized.append(data_str());
     return serialized;
 }
 
-void ZMQMessage::encode_data_blocks_()
+static void release_data_block(void * /*data*/, void *hint)
+{
+    delete static_cast<SharedBytes *>(hint);
+}
+
+std::vector<zmq::message_t> ZMQMessage::serialize_multipart(ShmRing *shm_ring)
 {
-    uint32_t data_string_length = sizeof(uint32_t); // block_num
-    uint32_t block_num = data_ptrs_.size();
-    std::vector<uint32_t> data_lengths;
-    std::vector<double> timestamps;
+    std::vector<zmq::message_t> frames;
+    if (data_ptrs_.empty())
+    {
+        std::string serialized = serialize();
+        frames.emplace_back(serialized.data(), serialized.size());
+        return frames;
+    }
+    std::string header = encode_header_();
+    header.append(encode_block_index_());
+    frames.emplace_back(header.data(), header.size());
     for (const auto &data_ptr : data_ptrs_)
     {
-        int data_length = pybind11::len(*std::get<0>(data_ptr));
-        data_string_length += data_length + sizeof(uint32_t) + sizeof(double);
-        data_lengths.push_back(data_length);
-        timestamps.push_back(std::get<1>(data_ptr));
+        const SharedBytes &block = std::get<0>(data_ptr);
+        if (shm_ring != nullptr && block.size() >= ShmRing::MIN_BLOCK_SIZE && block.size() <= shm_ring->capacity())
+        {
+            // Blocks that would overwrite views held by clients are sent through the socket instead
+            std::optional<ShmDescriptor> descriptor = shm_ring->write(block.data(), block.size());
+            if (descriptor.has_value())
+            {
+                // The descriptor frame is never as long as the block, which tells the receiver to look it up in the
+                // ring
+                std::string encoded = ShmRing::encode_descriptor(*descriptor);
+                frames.emplace_back(encoded.data(), encoded.size());
+                continue;
+            }
+        }
+        // The frame keeps a reference to the stored block until zmq has finished sending it
+        SharedBytes *hint = new SharedBytes(block);
+        frames.emplace_back(const_cast<char *>(hint->data()), hint->size(), &release_data_block, hint);
     }
-    data_str_.clear();
-    data_str_.reserve(data_string_length);
-    data_str_.append(uint32_to_bytes(block_num));
-    for (int i = 0; i < block_num; ++i)
+    return frames;
+}
+
+void ZMQMessage::set_shm_ring(std::shared_ptr<const ShmRing> shm_ring, bool copy)
+{
+    shm_ring_ = std::move(shm_ring);
+    copy_from_shm_ = copy;
+}
+
+void ZMQMessage::set_block_codecs(const std::vector<Codec> &codecs)
+{
+    block_codecs_ = codecs;
+    codec_index_ = true;
+}
+
+void ZMQMessage::enable_codec_index()
+{
+    codec_index_ = true;
+}
+
+void ZMQMessage::set_protocol(uint8_t version, uint32_t topic_handle, uint32_t session)
+{
+    if (version != PROTOCOL_V1 && version != PROTOCOL_V2)
+    {
+        throw std::invalid_argument("Unsupported protocol version " + std::to_string(version));
+    }
+    protocol_version_ = version;
+    topic_handle_ = version == PROTOCOL_V2 ? topic_handle : 0;
+    session_ = version == PROTOCOL_V2 ? session : 0;
+}
+
+uint8_t ZMQMessage::protocol_version() const
+{
+    return protocol_version_;
+}
+
+uint32_t ZMQMessage::topic_handle() const
+{
+    return topic_handle_;
+}
+
+uint32_t ZMQMessage::session() const
+{
+    return session_;
+}
+
+std::string ZMQMessage::encode_header_() const
+{
+    std::string header;
+    if (protocol_version_ == PROTOCOL_V2)
+    {
+        // Named topics only travel until they are resolved to a handle
+        uint8_t topic_length = topic_handle_ == 0 ? topic_.size() : 0;
+        header.resize(align_up(V2_HEADER_SIZE + topic_length, sizeof(uint64_t)), 0);
+        header[1] = static_cast<char>(PROTOCOL_V2_MARKER);
+        header[2] = static_cast<char>(cmd_);
+        header[3] = static_cast<char>(end_type_);
+        std::memcpy(&header[4], &topic_handle_, sizeof(uint32_t));
+        std::memcpy(&header[8], &session_, sizeof(uint32_t));
+        header[12] = static_cast<char>(topic_length);
+        std::memcpy(&header[16], &timestamp_, sizeof(double));
+        std::memcpy(&header[V2_HEADER_SIZE], topic_.data(), topic_length);
+        return header;
+    }
+    header.push_back(static_cast<char>(uint8_t(topic_.size())));
+    header.append(topic_);
+    header.push_back(static_cast<char>(cmd_));
+    header.push_back(static_cast<char>(end_type_));
+    header.append(double_to_bytes(timestamp_));
+    return header;
+}
+
+size_t ZMQMessage::decode_header_(const char *data, size_t size)
+{
+    if (is_v2_header(data, size))
+    {
+        return decode_v2_header_(data, size);
+    }
+    if (size < sizeof(uint8_t))
+    {
+        throw std::invalid_argument("Serialized message is too short");
+    }
+    uint8_t topic_length = static_cast<uint8_t>(data[0]);
+    if (size < sizeof(uint8_t) + topic_length + sizeof(CmdType) + sizeof(EndType) + sizeof(double))
+    {
+        throw std::invalid_argument("Serialized message is too short");
+    }
+    int decode_start_index = sizeof(uint8_t);
+    topic_ = std::string(data + decode_start_index, topic_length);
+    decode_start_index += topic_length;
+    cmd_ = static_cast<CmdType>(data[decode_start_index]);
+    decode_start_index += sizeof(CmdType);
+    end_type_ = static_cast<EndType>(data[decode_start_index]);
+    decode_start_index += sizeof(EndType);
+    timestamp_ = bytes_to_double(std::string(data + decode_start_index, sizeof(double)));
+    decode_start_index += sizeof(double);
+    return decode_start_index;
+}
+
+size_t ZMQMessage::decode_v2_header_(const char *data, size_t size)
+{
+    if (size < V2_HEADER_SIZE)
     {
-        data_str_.append(uint32_to_bytes(data_lengths[i]));
-        data_str_.append(double_to_bytes(timestamps[i]));
+        throw std::invalid_argument("Serialized message is too short");
+    }
+    uint8_t topic_length = static_cast<uint8_t>(data[12]);
+    size_t header_size = align_up(V2_HEADER_SIZE + topic_length, sizeof(uint64_t));
+    if (size < header_size)
+    {
+        throw std::invalid_argument("Serialized message is too short");
+    }
+    protocol_version_ = PROTOCOL_V2;
+    cmd_ = static_cast<CmdType>(data[2]);
+    end_type_ = static_cast<EndType>(data[3]);
+    std::memcpy(&topic_handle_, data + 4, sizeof(uint32_t));
+    std::memcpy(&session_, data + 8, sizeof(uint32_t));
+    std::memcpy(&timestamp_, data + 16, sizeof(double));
+    topic_ = std::string(data + V2_HEADER_SIZE, topic_length);
+    return header_size;
+}
+
+size_t ZMQMessage::block_index_entry_size_() const
+{
+    if (protocol_version_ == PROTOCOL_V2)
+    {
+        return V2_INDEX_ENTRY_SIZE;
+    }
+    return sizeof(uint32_t) + sizeof(double) + (codec_index_ ? sizeof(Codec) : 0);
+}
+
+std::string ZMQMessage::encode_block_index_() const
+{
+    size_t block_num = data_ptrs_.size();
+    if (codec_index_ && block_codecs_.size() != block_num)
+    {
+        throw std::invalid_argument("Number of block codecs does not match the number of blocks");
+    }
+    std::string block_index;
+    if (protocol_version_ == PROTOCOL_V2)
+    {
+        // Version 2 always carries the codecs, NONE unless set_block_codecs was called
+        block_index.resize(sizeof(uint64_t) + block_num * V2_INDEX_ENTRY_SIZE, 0);
+        uint64_t count = block_num;
+        std::memcpy(&block_index[0], &count, sizeof(uint64_t));
+        for (size_t i = 0; i < block_num; ++i)
+        {
+            char *entry = &block_index[sizeof(uint64_t) + i * V2_INDEX_ENTRY_SIZE];
+            uint64_t length = std::get<0>(data_ptrs_[i]).size();
+            double timestamp = std::get<1>(data_ptrs_[i]);
+            std::memcpy(entry, &length, sizeof(uint64_t));
+            std::memcpy(entry + sizeof(uint64_t), &timestamp, sizeof(double));
+            entry[2 * sizeof(uint64_t)] = static_cast<char>(codec_index_ ? block_codecs_[i] : Codec::NONE);
+        }
+        return block_index;
+    }
+    if (block_num > UINT32_MAX)
+    {
+        throw std::invalid_argument("Too many blocks for protocol version 1");
+    }
+    block_index.reserve(sizeof(uint32_t) + block_num * block_index_entry_size_());
+    block_index.append(uint32_to_bytes(block_num));
+    for (size_t i = 0; i < block_num; ++i)
+    {
+        if (std::get<0>(data_ptrs_[i]).size() > UINT32_MAX)
+        {
+            throw std::invalid_argument("Blocks of 4GB or more need protocol version 2");
+        }
+        block_index.append(uint32_to_bytes(std::get<0>(data_ptrs_[i]).size()));
+        block_index.append(double_to_bytes(std::get<1>(data_ptrs_[i])));
+        if (codec_index_)
+        {
+            block_index.push_back(static_cast<char>(block_codecs_[i]));
+        }
     }
-    int data_start_index = 1 + block_num;
+    return block_index;
+}
+
+void ZMQMessage::encode_data_blocks_()
+{
+    data_str_ = encode_block_index_();
+    bool aligned = protocol_version_ == PROTOCOL_V2;
+    size_t data_string_length = data_str_.size();
     for (const auto &data_ptr : data_ptrs_)
     {
-        std::string data_block_str = *std::get<0>(data_ptr);
-        data_str_.append(data_block_str);
+        if (aligned)
+        {
+            data_string_length = align_up(data_offset_ + data_string_length, PROTOCOL_V2_ALIGNMENT) - data_offset_;
+        }
+        data_string_length += std::get<0>(data_ptr).size();
+    }
+    data_str_.reserve(data_string_length);
+    for (const auto &data_ptr : data_ptrs_)
+    {
+        if (aligned)
+        {
+            data_str_.resize(align_up(data_offset_ + data_str_.size(), PROTOCOL_V2_ALIGNMENT) - data_offset_, 0);
+        }
+        data_str_.append(std::get<0>(data_ptr).data(), std::get<0>(data_ptr).size());
     }
     assert(data_str_.size() == data_string_length);
 }
 
 void ZMQMessage::decode_data_blocks_()
 {
-    if (data_str_.size() < sizeof(uint32_t))
+    bool v2 = protocol_version_ == PROTOCOL_V2;
+    size_t count_size = v2 ? sizeof(uint64_t) : sizeof(uint32_t);
+    if (data_str_.size() < count_size)
     {
         throw std::invalid_argument("Data string is too short");
     }
     data_ptrs_.clear();
-    uint32_t block_num = bytes_to_uint32(std::string(data_str_.data(), sizeof(uint32_t)));
-    int index_size = sizeof(uint32_t) + sizeof(double);
-    int data_start_index = (1 + block_num) * sizeof(uint32_t) + block_num * sizeof(double);
-    // printf("decode_data_blocks: %s\n", bytes_to_hex(data_str_).c_str());
-    for (int i = 0; i < block_num; ++i)
+    uint64_t block_num = 0;
+    std::memcpy(&block_num, data_str_.data(), count_size);
+    size_t index_size = block_index_entry_size_();
+    if (block_num > (data_str_.size() - count_size) / index_size)
     {
-        std::string data_length_str(data_str_.data() + sizeof(uint32_t) + i * index_size, sizeof(uint32_t));
-
-        uint32_t data_length = bytes_to_uint32(data_length_str);
-        if (data_start_index + data_length > data_str_.size())
+        throw std::invalid_argument("Block index is truncated");
+    }
+    size_t data_start_index = count_size + block_num * index_size;
+    bool multipart = !payload_frames_.empty();
+    if (multipart && (payload_frames_.size() != block_num || data_str_.size() != data_start_index))
+    {
+        throw std::invalid_argument("Payload frames do not match the block index");
+    }
+    for (size_t i = 0; i < block_num; ++i)
+    {
+        const char *entry = data_str_.data() + count_size + i * index_size;
+        uint64_t data_length = 0;
+        double timestamp;
+        Codec codec = Codec::NONE;
+        if (v2)
         {
-            throw std::invalid_argument("Data block length invalid. Please check the data string");
+            std::memcpy(&data_length, entry, sizeof(uint64_t));
+            std::memcpy(&timestamp, entry + sizeof(uint64_t), sizeof(double));
+            codec = static_cast<Codec>(entry[2 * sizeof(uint64_t)]);
+            if (!multipart)
+            {
+                data_start_index = align_up(data_offset_ + data_start_index, PROTOCOL_V2_ALIGNMENT) - data_offset_;
+            }
         }
-        if (data_length < 0)
+        else
         {
-            throw std::invalid_argument("Data block length must be non-negative");
+            data_length = bytes_to_uint32(std::string(entry, sizeof(uint32_t)));
+            timestamp = bytes_to_double(std::string(entry + sizeof(uint32_t), sizeof(double)));
+            if (codec_index_)
+            {
+                codec = static_cast<Codec>(entry[sizeof(uint32_t) + sizeof(double)]);
+            }
         }
-        std::string data_timestamp_str(data_str_.data() + 2 * sizeof(uint32_t) + i * index_size, sizeof(double));
-        double timestamp = bytes_to_double(data_timestamp_str);
+        bool in_shm = multipart && shm_ring_ != nullptr && payload_frames_[i]->size() != data_length;
+        if (multipart ? payload_frames_[i]->size() != data_length && !in_shm
+                      : data_start_index > data_str_.size() || data_length > data_str_.size() - data_start_index)
+        {
+            throw std::invalid_argument("Data block length invalid. Please check the data string");
+        }
+        SharedBytes block;
         if (data_length == 0)
         {
-            data_ptrs_.push_back(std::make_tuple(std::make_shared<PyBytes>(PyBytes("")), timestamp));
-            continue;
+            block = SharedBytes();
         }
-        data_ptrs_.push_back(std::make_tuple(
-            std::make_shared<PyBytes>(PyBytes(data_str_.data() + data_start_index, data_length)), timestamp));
-        data_start_index += data_length;
+        else if (in_shm)
+        {
+            const std::shared_ptr<zmq::message_t> &frame = payload_frames_[i];
+            ShmDescriptor descriptor = ShmRing::decode_descriptor(frame->data<char>(), frame->size());
+            if (descriptor.length != data_length)
+            {
+                throw std::invalid_argument("Shared memory descriptor does not match the block index");
+            }
+            block = shm_ring_->read(descriptor, copy_from_shm_);
+        }
+        else if (multipart)
+        {
+            // Reference the received frame directly instead of copying the block out of it
+            const std::shared_ptr<zmq::message_t> &frame = payload_frames_[i];
+            block = SharedBytes(frame, frame->data<char>(), data_length);
+        }
+        else if (header_frame_ != nullptr)
+        {
+            // Blocks stay views into the received frame, at the offsets the sender aligned them to
+            block = SharedBytes(header_frame_, header_frame_->data<char>() + data_offset_ + data_start_index,
+                                data_length);
+            data_start_index += data_length;
+        }
+        else
+        {
+            block = SharedBytes(data_str_.data() + data_start_index, data_length);
+            data_start_index += data_length;
+        }
+        if (codec != Codec::NONE)
+        {
+            block = decode_block(block);
+        }
+        data_ptrs_.push_back(std::make_tuple(block, timestamp));
     }
 }
 
@@ -163,15 +521,124 @@ void ZMQMessage::check_input_validity_()
     {
         throw std::invalid_argument("Topic size must be less than 256 characters");
     }
-    if (topic_.empty())
+    // Batch requests name their topics in the data instead, and time synchronization, stats and handshakes do not
+    // need one
+    if (topic_.empty() && cmd_ != CmdType::PEEK_BATCH && cmd_ != CmdType::PEEK_ALIGNED &&
+        cmd_ != CmdType::SYNCHRONIZE_TIME && cmd_ != CmdType::STATS && cmd_ != CmdType::HANDSHAKE)
     {
         throw std::invalid_argument("Topic cannot be empty");
     }
-    for (const auto &data_ptr : data_ptrs_)
+}
+
+static std::string encode_batch_topic(const std::string &topic)
+{
+    if (topic.size() > UINT8_MAX)
     {
-        if (std::get<0>(data_ptr) == nullptr)
+        throw std::invalid_argument("Topic name `" + topic + "` is longer than 255 bytes");
+    }
+    return std::string(1, static_cast<char>(topic.size())) + topic;
+}
+
+std::string encode_batch_request(const std::vector<BatchSpec> &specs)
+{
+    std::string data_str = uint32_to_bytes(specs.size());
+    for (const BatchSpec &spec : specs)
+    {
+        data_str += encode_batch_topic(std::get<0>(spec));
+        data_str.push_back(static_cast<char>(str_to_end_type(std::get<1>(spec))));
+        data_str += int32_to_bytes(std::get<2>(spec));
+    }
+    return data_str;
+}
+
+std::string encode_aligned_request(const std::vector<std::string> &topics, double timestamp)
+{
+    std::string data_str = double_to_bytes(timestamp) + uint32_to_bytes(topics.size());
+    for (const std::string &topic : topics)
+    {
+        data_str += encode_batch_topic(topic);
+    }
+    return data_str;
+}
+
+std::vector<TimedPtr> join_batch_results(const std::vector<std::vector<TimedPtr>> &results, double timestamp)
+{
+    std::string manifest = uint32_to_bytes(results.size());
+    size_t block_count = 0;
+    for (const std::vector<TimedPtr> &result : results)
+    {
+        manifest += uint32_to_bytes(result.size());
+        block_count += result.size();
+    }
+    std::vector<TimedPtr> ptrs;
+    ptrs.reserve(block_count + 1);
+    ptrs.emplace_back(SharedBytes(std::move(manifest)), timestamp);
+    for (const std::vector<TimedPtr> &result : results)
+    {
+        ptrs.insert(ptrs.end(), result.begin(), result.end());
+    }
+    return ptrs;
+}
+
+std::vector<std::vector<TimedPtr>> split_batch_results(const std::vector<TimedPtr> &ptrs)
+{
+    if (ptrs.empty() || std::get<0>(ptrs[0]).size() < sizeof(uint32_t))
+    {
+        throw std::runtime_error("Batch reply does not start with a manifest");
+    }
+    const SharedBytes &manifest = std::get<0>(ptrs[0]);
+    uint32_t result_count = bytes_to_uint32(std::string(manifest.data(), sizeof(uint32_t)));
+    if (manifest.size() != sizeof(uint32_t) * (result_count + 1))
+    {
+        throw std::runtime_error("Batch manifest has an invalid size");
+    }
+    std::vector<std::vector<TimedPtr>> results(result_count);
+    size_t position = 1;
+    for (uint32_t i = 0; i < result_count; i++)
+    {
+        uint32_t block_count =
+            bytes_to_uint32(std::string(manifest.data() + sizeof(uint32_t) * (i + 1), sizeof(uint32_t)));
+        if (position + block_count > ptrs.size())
         {
-            throw std::invalid_argument("Data cannot be null. To pass empty data, use a pointer to an empty string.");
+            throw std::runtime_error("Batch manifest does not match the number of received blocks");
         }
+        results[i].assign(ptrs.begin() + position, ptrs.begin() + position + block_count);
+        position += block_count;
+    }
+    return results;
+}
+
+std::vector<TimedPtr> join_since_result(const SinceResult &result, double timestamp)
+{
+    std::string header = uint64_to_bytes(result.cursor);
+    header.push_back(static_cast<char>(result.evicted));
+    for (uint64_t sequence : result.sequences)
+    {
+        header += uint64_to_bytes(sequence);
+    }
+    std::vector<TimedPtr> ptrs;
+    ptrs.reserve(result.ptrs.size() + 1);
+    ptrs.emplace_back(SharedBytes(std::move(header)), timestamp);
+    ptrs.insert(ptrs.end(), result.ptrs.begin(), result.ptrs.end());
+    return ptrs;
+}
+
+SinceResult split_since_result(const std::vector<TimedPtr> &ptrs)
+{
+    constexpr size_t fixed_size = sizeof(uint64_t) + sizeof(uint8_t);
+    if (ptrs.empty() || std::get<0>(ptrs[0]).size() != fixed_size + sizeof(uint64_t) * (ptrs.size() - 1))
+    {
+        throw std::runtime_error("Since reply does not start with a valid cursor block");
+    }
+    const char *header = std::get<0>(ptrs[0]).data();
+    SinceResult result;
+    result.cursor = bytes_to_uint64(std::string(header, sizeof(uint64_t)));
+    result.evicted = header[sizeof(uint64_t)] != 0;
+    result.ptrs.assign(ptrs.begin() + 1, ptrs.end());
+    for (size_t i = 0; i < result.ptrs.size(); i++)
+    {
+        result.sequences.push_back(
+            bytes_to_uint64(std::string(header + fixed_size + sizeof(uint64_t) * i, sizeof(uint64_t))));
     }
+    return result;
 }
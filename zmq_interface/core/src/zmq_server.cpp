@@ -1,19 +1,48 @@
 
 #include "zmq_server.h"
+#include <algorithm>
+#include <cstring>
+#include <deque>
 #include <filesystem>
+#include <iterator>
+#include <queue>
+#include <random>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
-ZMQServer::ZMQServer(const std::string &server_name, const std::string &server_endpoint)
-    : server_name_(server_name), context_(1), socket_(context_, zmq::socket_type::rep),
+// Time spent serializing the reply to the request that the current thread is processing
+static thread_local int64_t reply_serialize_time_us = 0;
+// Envelope of the client whose request the current worker is processing. A worker's REQ socket does not keep it like
+// a REP socket, so send_reply_ sends it back with the reply.
+static thread_local std::vector<zmq::message_t> reply_envelope;
+// Sent by a worker once it is connected, see frontend_loop_
+static constexpr const char *WORKER_READY = "READY";
+
+static uint32_t random_session_id()
+{
+    std::random_device random_device;
+    std::uniform_int_distribution<uint32_t> distribution(1, UINT32_MAX);
+    return distribution(random_device);
+}
+
+ZMQServer::ZMQServer(const std::string &server_name, const std::string &server_endpoint, size_t shared_memory_size,
+                     const std::string &publish_endpoint, int num_workers)
+    : server_name_(server_name), context_(1),
+      socket_(context_, num_workers > 0 ? zmq::socket_type::router : zmq::socket_type::rep),
       logger_(spdlog::stdout_color_mt(server_name)), running_(false), steady_clock_start_time_us_(steady_clock_us()),
-      poller_timeout_ms_(1000)
+      poller_timeout_ms_(1000), num_workers_(is_local_endpoint(server_endpoint) ? 0 : num_workers),
+      expiry_interval_ms_(100), memory_limit_(0), session_id_(random_session_id())
 {
     logger_->set_pattern("[%H:%M:%S %n %^%l%$] %v");
 
-    // Only accept tcp and ipc endpoints
-    if (server_endpoint.find("tcp://") != 0 && server_endpoint.find("ipc://") != 0)
+    // Only accept tcp, ipc and inproc endpoints
+    if (server_endpoint.find("tcp://") != 0 && server_endpoint.find("ipc://") != 0 &&
+        !is_local_endpoint(server_endpoint))
+    {
+        throw std::invalid_argument("Server endpoint must start with tcp://, ipc:// or inproc://");
+    }
+    if (is_local_endpoint(server_endpoint) && shared_memory_size > 0)
     {
-        throw std::invalid_argument("Server endpoint must start with tcp:// or ipc://");
+        throw std::invalid_argument("Shared memory is only available for ipc:// endpoints");
     }
     if (server_endpoint.find("ipc://") == 0)
     {
@@ -24,89 +53,470 @@ ZMQServer::ZMQServer(const std::string &server_name, const std::string &server_e
             std::filesystem::create_directories(directory);
         }
     }
+    if (shared_memory_size > 0)
+    {
+        shm_ring_ = std::make_unique<ShmRing>(ShmRing::name_from_endpoint(server_endpoint), shared_memory_size);
+        logger_->info("Serving large data blocks through shared memory ({}MB).", shared_memory_size / 1024 / 1024);
+    }
+    if (!publish_endpoint.empty())
+    {
+        publisher_ = std::make_unique<zmq::socket_t>(context_, zmq::socket_type::pub);
+        publisher_->bind(publish_endpoint);
+        logger_->info("Publishing new data on {}.", publish_endpoint);
+    }
+    topic_registry_ = std::make_shared<TopicRegistry>();
+    if (is_local_endpoint(server_endpoint))
+    {
+        // Clients in this process read the topics directly, so no socket is served
+        register_local_endpoint(server_endpoint, topic_registry_);
+        local_endpoint_ = server_endpoint;
+        running_ = true;
+        expiry_thread_ = std::thread(&ZMQServer::expiry_loop_, this);
+        logger_->info("Serving clients in this process on {}.", server_endpoint);
+        return;
+    }
     socket_.bind(server_endpoint);
     running_ = true;
-    poller_item_ = {socket_, 0, ZMQ_POLLIN, 0};
-    background_thread_ = std::thread(&ZMQServer::background_loop_, this);
-    data_topics_ = std::unordered_map<std::string, DataTopic>();
+    if (num_workers_ > 0)
+    {
+        // ROUTER frontend with a pool of REQ workers behind inproc ROUTERs. Existing REQ clients see no difference.
+        worker_backend_ = zmq::socket_t(context_, zmq::socket_type::router);
+        worker_backend_.bind("inproc://workers");
+        priority_backend_ = zmq::socket_t(context_, zmq::socket_type::router);
+        priority_backend_.bind("inproc://priority_workers");
+        for (int i = 0; i < num_workers_; ++i)
+        {
+            worker_threads_.emplace_back(&ZMQServer::worker_loop_, this, "inproc://workers");
+        }
+        worker_threads_.emplace_back(&ZMQServer::worker_loop_, this, "inproc://priority_workers");
+        background_thread_ = std::thread(&ZMQServer::frontend_loop_, this);
+        logger_->info("Serving requests with {} worker threads and a priority lane.", num_workers_);
+    }
+    else
+    {
+        background_thread_ = std::thread(&ZMQServer::serve_loop_, this, std::ref(socket_));
+    }
+    expiry_thread_ = std::thread(&ZMQServer::expiry_loop_, this);
 }
 
 ZMQServer::~ZMQServer()
 {
-    running_ = false;
-    background_thread_.join();
+    stop();
+    if (num_workers_ > 0)
+    {
+        worker_backend_.close();
+        priority_backend_.close();
+    }
+    if (publisher_ != nullptr)
+    {
+        publisher_->close();
+    }
     socket_.close();
     context_.close();
 }
 
-void ZMQServer::add_topic(const std::string &topic, double max_remaining_time)
+void ZMQServer::stop()
 {
-    std::lock_guard<std::mutex> lock(data_topic_mutex_);
-    auto it = data_topics_.find(topic);
-    if (it != data_topics_.end())
+    stop_replay();
+    stop_recording();
+    {
+        std::lock_guard<std::mutex> lock(expiry_mutex_);
+        if (!running_)
+        {
+            return;
+        }
+        running_ = false;
+    }
+    expiry_condition_.notify_all();
+    if (!local_endpoint_.empty())
+    {
+        // Attached clients keep reading the topics they already hold
+        unregister_local_endpoint(local_endpoint_);
+    }
+    expiry_thread_.join();
+    if (background_thread_.joinable())
+    {
+        background_thread_.join();
+    }
+    for (std::thread &worker_thread : worker_threads_)
+    {
+        worker_thread.join();
+    }
+}
+
+uint32_t ZMQServer::add_topic(const std::string &topic, double max_remaining_time, size_t capacity, size_t max_bytes,
+                              size_t max_count, const std::string &codec, int element_size)
+{
+    if (element_size < 1 || element_size > UINT8_MAX)
+    {
+        throw std::invalid_argument("Element size must be between 1 and 255");
+    }
+    uint32_t handle = topic_registry_->add_topic(std::make_shared<DataTopic>(
+        topic, max_remaining_time, capacity, max_bytes, max_count, str_to_codec(codec), element_size));
+    if (handle == 0)
     {
         logger_->warn("Topic `{}` already exists. Ignoring the request to add it again.", topic);
+        return topic_registry_->handle(topic);
+    }
+    if (capacity > 0)
+    {
+        logger_->info("Added topic `{}` with max remaining time {}s, codec {} and a ring buffer of {} blocks.", topic,
+                      max_remaining_time, codec, capacity);
+        return handle;
+    }
+    logger_->info("Added topic `{}` with max remaining time {}s and codec {}.", topic, max_remaining_time, codec);
+    return handle;
+}
+
+void ZMQServer::put_data(const std::string &topic, const SharedBytes &data_ptr)
+{
+    put_data_(topic, data_ptr, get_timestamp());
+}
+
+void ZMQServer::put_data(const std::string &topic, const SharedBytes &data_ptr, double timestamp)
+{
+    put_data_(topic, data_ptr, timestamp);
+}
+
+void ZMQServer::put_data_(const std::string &topic, const SharedBytes &data_ptr, double timestamp)
+{
+    std::shared_ptr<DataTopic> data_topic = find_topic_(topic, "Received data");
+    if (data_topic == nullptr)
+    {
         return;
     }
-    data_topics_.insert({topic, DataTopic(topic, max_remaining_time)});
-    logger_->info("Added topic `{}` with max remaining time {}s.", topic, max_remaining_time);
+    data_topic->add_data_ptr(data_ptr, timestamp);
+    if (recording_)
+    {
+        std::shared_ptr<Recorder> recorder = std::atomic_load(&recorder_);
+        if (recorder != nullptr)
+        {
+            recorder->record(topic, data_ptr, timestamp);
+        }
+    }
+    if (memory_limit_ > 0)
+    {
+        enforce_memory_limit_();
+    }
+    if (publisher_ != nullptr)
+    {
+        publish_data_(topic, data_ptr, timestamp);
+    }
+}
+
+void ZMQServer::put_many(const std::string &topic, const std::vector<SharedBytes> &data,
+                         const std::vector<double> &timestamps)
+{
+    put_batch_(topic, data, timestamps);
+    if (memory_limit_ > 0)
+    {
+        enforce_memory_limit_();
+    }
+}
+
+void ZMQServer::put_many(const std::vector<TopicBatch> &batches)
+{
+    for (const auto &[topic, data, timestamps] : batches)
+    {
+        put_batch_(topic, data, timestamps);
+    }
+    if (memory_limit_ > 0)
+    {
+        enforce_memory_limit_();
+    }
 }
 
-void ZMQServer::put_data(const std::string &topic, const PyBytes &data)
+void ZMQServer::put_batch_(const std::string &topic, const std::vector<SharedBytes> &data,
+                           const std::vector<double> &timestamps)
 {
-    std::lock_guard<std::mutex> lock(data_topic_mutex_);
-    auto it = data_topics_.find(topic);
-    if (it == data_topics_.end())
+    if (!timestamps.empty() && timestamps.size() != data.size())
+    {
+        throw std::invalid_argument("Got " + std::to_string(timestamps.size()) + " timestamps for " +
+                                    std::to_string(data.size()) + " blocks of topic " + topic);
+    }
+    std::shared_ptr<DataTopic> data_topic = find_topic_(topic, "Received data");
+    if (data_topic == nullptr || data.empty())
     {
-        logger_->warn(
-            "Received data for unknown topic {}. Please first call add_topic to add it into the recorded topics.",
-            topic);
         return;
     }
-    PyBytesPtr data_ptr = std::make_shared<PyBytes>(data);
+    double timestamp = timestamps.empty() ? get_timestamp() : 0;
+    std::vector<TimedPtr> ptrs;
+    ptrs.reserve(data.size());
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        ptrs.emplace_back(data[i], timestamps.empty() ? timestamp : timestamps[i]);
+    }
+    data_topic->add_data_ptrs(ptrs);
+    std::shared_ptr<Recorder> recorder = recording_ ? std::atomic_load(&recorder_) : nullptr;
+    for (const auto &[data_ptr, block_timestamp] : ptrs)
+    {
+        if (recorder != nullptr)
+        {
+            recorder->record(topic, data_ptr, block_timestamp);
+        }
+        if (publisher_ != nullptr)
+        {
+            publish_data_(topic, data_ptr, block_timestamp);
+        }
+    }
+}
 
-    it->second.add_data_ptr(data_ptr, get_timestamp());
+std::vector<TimedPtr> ZMQServer::peek_data(const std::string &topic, EndType end_type, int32_t n)
+{
+    return peek_data_ptrs_(find_topic_(topic, "Requested last k data"), end_type, n);
 }
 
-pybind11::tuple ZMQServer::peek_data(const std::string &topic, std::string end_type_str, int n)
+std::vector<TimedPtr> ZMQServer::pop_data(const std::string &topic, EndType end_type, int32_t n)
 {
-    EndType end_type = str_to_end_type(end_type_str);
-    std::vector<TimedPtr> ptrs = peek_data_ptrs_(topic, end_type, n);
-    pybind11::list data;
-    pybind11::list timestamps;
-    for (const TimedPtr ptr : ptrs)
+    return pop_data_ptrs_(find_topic_(topic, "Requested last k data"), end_type, n);
+}
+
+std::vector<TimedPtr> ZMQServer::peek_range(const std::string &topic, double start_time, double end_time)
+{
+    return peek_range_ptrs_(find_topic_(topic, "Requested a time range"), start_time, end_time);
+}
+
+std::vector<TimedPtr> ZMQServer::peek_nearest(const std::string &topic, double timestamp, int32_t k)
+{
+    return peek_nearest_ptrs_(find_topic_(topic, "Requested the nearest data"), timestamp, k);
+}
+
+SinceResult ZMQServer::peek_since(const std::string &topic, uint64_t cursor, int32_t n)
+{
+    return peek_since_ptrs_(find_topic_(topic, "Requested new data"), cursor, n);
+}
+
+void ZMQServer::set_request_handler(const std::string &topic, RequestHandler handler)
+{
+    check_request_handler_(topic);
+    std::lock_guard<std::mutex> lock(request_handlers_mutex_);
+    request_handlers_[topic] = std::make_shared<RequestHandler>(std::move(handler));
+    logger_->info("Set the request handler of topic `{}`.", topic);
+}
+
+void ZMQServer::check_request_handler_(const std::string &topic) const
+{
+    if (topic.empty() || topic.size() > UINT8_MAX)
+    {
+        throw std::invalid_argument("Topic must have between 1 and 255 characters");
+    }
+    if (num_workers_ <= 0)
     {
-        data.append(*std::get<0>(ptr));
-        timestamps.append(std::get<1>(ptr));
+        throw std::invalid_argument("Request handlers need a server with num_workers > 0, since they would otherwise "
+                                    "block the thread that receives all requests");
     }
-    return pybind11::make_tuple(data, timestamps);
 }
 
-pybind11::tuple ZMQServer::pop_data(const std::string &topic, std::string end_type_str, int n)
+void ZMQServer::remove_request_handler(const std::string &topic)
 {
-    EndType end_type = str_to_end_type(end_type_str);
-    std::vector<TimedPtr> ptrs = pop_data_ptrs_(topic, end_type, n);
-    pybind11::list data;
-    pybind11::list timestamps;
-    for (const TimedPtr ptr : ptrs)
+    std::shared_ptr<RequestHandler> handler;
     {
-        data.append(*std::get<0>(ptr));
-        timestamps.append(std::get<1>(ptr));
+        std::lock_guard<std::mutex> lock(request_handlers_mutex_);
+        auto it = request_handlers_.find(topic);
+        if (it == request_handlers_.end())
+        {
+            logger_->warn("Topic `{}` has no request handler.", topic);
+            return;
+        }
+        handler = std::move(it->second);
+        request_handlers_.erase(it);
     }
-    return pybind11::make_tuple(data, timestamps);
 }
 
 std::unordered_map<std::string, int> ZMQServer::get_topic_status()
 {
     std::unordered_map<std::string, int> result;
-    std::lock_guard<std::mutex> lock(data_topic_mutex_);
-    for (auto &pair : data_topics_)
+    for (const auto &pair : *topic_registry_->snapshot())
+    {
+        result[pair.first] = pair.second->size();
+    }
+    return result;
+}
+
+std::unordered_map<std::string, size_t> ZMQServer::get_topic_bytes()
+{
+    std::unordered_map<std::string, size_t> result;
+    for (const auto &pair : *topic_registry_->snapshot())
     {
-        result[pair.first] = pair.second.size();
+        result[pair.first] = pair.second->bytes();
     }
     return result;
 }
 
+std::string ZMQServer::stats_json()
+{
+    std::string json = "{\"uptime_s\": " + std::to_string((steady_clock_us() - stats_start_time_us_) / 1e6) +
+                       ", \"requests\": {";
+    bool first = true;
+    for (size_t i = 0; i < CMD_TYPE_NUM; i++)
+    {
+        uint64_t count = request_counts_[i].load(std::memory_order_relaxed);
+        if (count == 0)
+        {
+            continue;
+        }
+        json += (first ? "" : ", ") + json_escape(cmd_type_to_str(static_cast<CmdType>(i))) + ": " +
+                std::to_string(count);
+        first = false;
+    }
+    json += "}, \"errors\": " + std::to_string(error_count_.load(std::memory_order_relaxed)) +
+            ", \"latency_us\": {\"queue\": " + queue_latency_.to_json() +
+            ", \"processing\": " + process_latency_.to_json() +
+            ", \"serialization\": " + serialize_latency_.to_json() + "}, \"topics\": {";
+    first = true;
+    for (const auto &pair : *topic_registry_->snapshot())
+    {
+        json += (first ? "" : ", ") + json_escape(pair.first) + ": " + pair.second->stats_json();
+        first = false;
+    }
+    return json + "}}";
+}
+
+void ZMQServer::start_recording(const std::string &directory, const std::vector<std::string> &topics)
+{
+    std::shared_ptr<Recorder> recorder = std::make_shared<Recorder>(directory, topics);
+    std::shared_ptr<Recorder> previous = std::atomic_exchange(&recorder_, recorder);
+    recording_ = true;
+    logger_->info("Recording {} topics into {}.", topics.size(), directory);
+    if (previous != nullptr)
+    {
+        logger_->info("Closed the recording in {}.", previous->directory());
+    }
+}
+
+void ZMQServer::stop_recording()
+{
+    recording_ = false;
+    std::shared_ptr<Recorder> recorder = std::atomic_exchange(&recorder_, std::shared_ptr<Recorder>());
+    if (recorder != nullptr)
+    {
+        // A put_data that loaded the recorder before the exchange may still hold it; the last owner closes it
+        recorder->flush();
+        logger_->info("Closed the recording in {}.", recorder->directory());
+    }
+}
+
+void ZMQServer::replay(const std::string &directory, double speed, double start_time, double end_time)
+{
+    stop_replay();
+    std::shared_ptr<const RecordingReader> reader = std::make_shared<RecordingReader>(directory);
+    for (const std::string &topic : reader->topics())
+    {
+        if (topic_registry_->find(topic) == nullptr)
+        {
+            throw std::invalid_argument("Topic `" + topic + "` of the recording must be added before replaying it");
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(replay_mutex_);
+        replay_stopping_ = false;
+    }
+    replaying_ = true;
+    replay_thread_ = std::thread(&ZMQServer::replay_loop_, this, reader, speed, start_time, end_time);
+}
+
+void ZMQServer::stop_replay()
+{
+    {
+        std::lock_guard<std::mutex> lock(replay_mutex_);
+        replay_stopping_ = true;
+    }
+    replay_condition_.notify_all();
+    if (replay_thread_.joinable())
+    {
+        replay_thread_.join();
+    }
+}
+
+bool ZMQServer::is_replaying()
+{
+    return replaying_;
+}
+
+void ZMQServer::replay_loop_(std::shared_ptr<const RecordingReader> reader, double speed, double start_time,
+                             double end_time)
+{
+    // Merges the topics by timestamp, holding the next block of every topic
+    struct Cursor
+    {
+        double timestamp;
+        size_t topic;
+        size_t index;
+    };
+    auto later = [](const Cursor &a, const Cursor &b) { return a.timestamp > b.timestamp; };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> cursors(later);
+    std::vector<std::string> topics = reader->topics();
+    for (size_t i = 0; i < topics.size(); i++)
+    {
+        size_t index = reader->lower_bound(topics[i], start_time);
+        if (index < reader->count(topics[i]))
+        {
+            cursors.push(Cursor{std::get<1>(reader->at(topics[i], index)), i, index});
+        }
+    }
+
+    logger_->info("Replaying {} topics at {}x speed.", topics.size(), speed);
+    const std::chrono::steady_clock::time_point replay_start_time = std::chrono::steady_clock::now();
+    const double first_timestamp = cursors.empty() ? 0 : cursors.top().timestamp;
+    size_t replayed_count = 0;
+    while (!cursors.empty() && cursors.top().timestamp <= end_time)
+    {
+        Cursor cursor = cursors.top();
+        cursors.pop();
+        {
+            std::unique_lock<std::mutex> lock(replay_mutex_);
+            if (speed > 0)
+            {
+                std::chrono::duration<double> delay((cursor.timestamp - first_timestamp) / speed);
+                replay_condition_.wait_until(
+                    lock, replay_start_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay),
+                    [this] { return replay_stopping_; });
+            }
+            if (replay_stopping_)
+            {
+                break;
+            }
+        }
+        const std::string &topic = topics[cursor.topic];
+        TimedPtr block = reader->at(topic, cursor.index);
+        // The stored blocks stay views into the mapped recording
+        put_data_(topic, std::get<0>(block), cursor.timestamp);
+        replayed_count++;
+        if (cursor.index + 1 < reader->count(topic))
+        {
+            cursors.push(Cursor{std::get<1>(reader->at(topic, cursor.index + 1)), cursor.topic, cursor.index + 1});
+        }
+    }
+    logger_->info("Replayed {} blocks.", replayed_count);
+    replaying_ = false;
+}
+
+void ZMQServer::set_memory_limit(size_t max_bytes)
+{
+    memory_limit_ = max_bytes;
+    if (max_bytes > 0)
+    {
+        enforce_memory_limit_();
+    }
+}
+
+void ZMQServer::set_topic_priority(const std::string &topic, bool priority)
+{
+    if (num_workers_ <= 0)
+    {
+        logger_->warn("Topic priorities only take effect when the server is created with worker threads.");
+    }
+    std::lock_guard<std::mutex> lock(priority_topics_mutex_);
+    if (priority)
+    {
+        priority_topics_.insert(topic);
+    }
+    else
+    {
+        priority_topics_.erase(topic);
+    }
+}
+
 double ZMQServer::get_timestamp()
 {
     return static_cast<double>(steady_clock_us() - steady_clock_start_time_us_) / 1e6;
@@ -114,126 +524,677 @@ double ZMQServer::get_timestamp()
 
 void ZMQServer::reset_start_time(int64_t system_time_us)
 {
-    std::lock_guard<std::mutex> lock(data_topic_mutex_);
     logger_->info("Resetting start time. Will clear all data stored before this time");
-    for (auto &pair : data_topics_)
+    for (const auto &pair : *topic_registry_->snapshot())
     {
-        pair.second.clear_data();
+        pair.second->clear_data();
     }
     // Use system time to make sure different servers and clients are synchronized
     steady_clock_start_time_us_ = steady_clock_us() + (system_time_us - system_clock_us());
 }
 
-std::vector<TimedPtr> ZMQServer::peek_data_ptrs_(const std::string &topic, EndType end_type, int32_t n)
+std::shared_ptr<DataTopic> ZMQServer::find_topic_(const std::string &topic, const std::string &action)
+{
+    std::shared_ptr<DataTopic> data_topic = topic_registry_->find(topic);
+    if (data_topic == nullptr)
+    {
+        logger_->warn("{} for unknown topic {}. Please first call add_topic to add it into the recorded topics.",
+                      action, topic);
+    }
+    return data_topic;
+}
+
+std::vector<TimedPtr> ZMQServer::peek_data_ptrs_(const std::shared_ptr<DataTopic> &data_topic, EndType end_type,
+                                                 int32_t n, std::vector<Codec> *codecs)
+{
+    if (data_topic == nullptr)
+    {
+        return {};
+    }
+    std::vector<TimedPtr> ptrs = data_topic->peek_data_ptrs(end_type, n);
+    data_topic->decode_blocks(ptrs, codecs);
+    return ptrs;
+}
+
+std::vector<TimedPtr> ZMQServer::pop_data_ptrs_(const std::shared_ptr<DataTopic> &data_topic, EndType end_type,
+                                                int32_t n, std::vector<Codec> *codecs)
+{
+    if (data_topic == nullptr)
+    {
+        return {};
+    }
+    std::vector<TimedPtr> ptrs = data_topic->pop_data_ptrs(end_type, n);
+    data_topic->decode_blocks(ptrs, codecs);
+    return ptrs;
+}
+
+std::vector<TimedPtr> ZMQServer::peek_range_ptrs_(const std::shared_ptr<DataTopic> &data_topic, double start_time,
+                                                  double end_time, std::vector<Codec> *codecs)
+{
+    if (data_topic == nullptr)
+    {
+        return {};
+    }
+    std::vector<TimedPtr> ptrs = data_topic->peek_range_ptrs(start_time, end_time);
+    data_topic->decode_blocks(ptrs, codecs);
+    return ptrs;
+}
+
+std::vector<TimedPtr> ZMQServer::peek_nearest_ptrs_(const std::shared_ptr<DataTopic> &data_topic, double timestamp,
+                                                    int32_t k, std::vector<Codec> *codecs)
 {
-    std::lock_guard<std::mutex> lock(data_topic_mutex_);
-    auto it = data_topics_.find(topic);
-    if (it == data_topics_.end())
+    if (data_topic == nullptr)
     {
-        logger_->warn("Requested last k data for unknown topic {}. Please first call add_topic to add it into the "
-                      "recorded topics.",
-                      topic);
         return {};
     }
-    return it->second.peek_data_ptrs(end_type, n);
+    std::vector<TimedPtr> ptrs = data_topic->peek_nearest_ptrs(timestamp, k);
+    data_topic->decode_blocks(ptrs, codecs);
+    return ptrs;
 }
 
-std::vector<TimedPtr> ZMQServer::pop_data_ptrs_(const std::string &topic, EndType end_type, int32_t n)
+SinceResult ZMQServer::peek_since_ptrs_(const std::shared_ptr<DataTopic> &data_topic, uint64_t cursor, int32_t n,
+                                        std::vector<Codec> *codecs)
 {
-    std::lock_guard<std::mutex> lock(data_topic_mutex_);
-    auto it = data_topics_.find(topic);
-    if (it == data_topics_.end())
+    if (data_topic == nullptr)
     {
-        logger_->warn("Requested last k data for unknown topic {}. Please first call add_topic to add it into the "
-                      "recorded topics.",
-                      topic);
         return {};
     }
-    return it->second.pop_data_ptrs(end_type, n);
+    SinceResult result = data_topic->peek_since_ptrs(cursor, n);
+    data_topic->decode_blocks(result.ptrs, codecs);
+    return result;
 }
 
-void ZMQServer::process_request_(ZMQMessage &message)
+void ZMQServer::process_request_with_data_(ZMQMessage &message, zmq::socket_t &socket)
 {
+    std::shared_ptr<RequestHandler> handler;
+    {
+        std::lock_guard<std::mutex> lock(request_handlers_mutex_);
+        auto it = request_handlers_.find(message.topic());
+        if (it != request_handlers_.end())
+        {
+            handler = it->second;
+        }
+    }
+    if (handler == nullptr)
+    {
+        send_error_(socket, message, "Topic `" + message.topic() + "` has no request handler");
+        return;
+    }
+    SharedBytes result;
+    try
+    {
+        std::vector<TimedPtr> request_ptrs = message.data_ptrs();
+        if (request_ptrs.size() != 1)
+        {
+            throw std::invalid_argument("Request should have 1 data block, but got " +
+                                        std::to_string(request_ptrs.size()));
+        }
+        result = (*handler)(std::get<0>(request_ptrs[0]));
+    }
+    catch (const std::exception &e)
+    {
+        send_error_(socket, message, "Request handler of topic `" + message.topic() + "` failed: " + e.what());
+        return;
+    }
+    // Nothing is compressed, but clients always expect a codec index in replies to this command
+    double timestamp = get_timestamp();
+    send_data_reply_(socket, message, {TimedPtr(result, timestamp)}, RequestFlag::ACCEPT_CODECS, {Codec::NONE});
+}
+
+void ZMQServer::process_request_(ZMQMessage &message, zmq::socket_t &socket, int64_t received_time_us)
+{
+    // Version 2 requests for stored topics name them by handle, which is resolved without hashing the name
+    std::shared_ptr<DataTopic> data_topic;
+    if (message.topic_handle() != 0)
+    {
+        data_topic = message.session() == session_id_ ? topic_registry_->find(message.topic_handle()) : nullptr;
+        if (data_topic == nullptr)
+        {
+            send_error_(socket, message, STALE_TOPIC_HANDLE_ERROR);
+            return;
+        }
+        message.set_topic(data_topic->name());
+    }
+
     switch (message.cmd())
     {
     case CmdType::PEEK_DATA:
-    case CmdType::POP_DATA: {
+    case CmdType::POP_DATA:
+    case CmdType::PEEK_RANGE:
+    case CmdType::PEEK_NEAREST:
+    case CmdType::PEEK_SINCE: {
+        std::string data_str = message.data_str();
+        size_t arguments_size = message.cmd() == CmdType::PEEK_RANGE     ? 2 * sizeof(double)
+                                : message.cmd() == CmdType::PEEK_NEAREST ? sizeof(double) + sizeof(int32_t)
+                                : message.cmd() == CmdType::PEEK_SINCE   ? sizeof(uint64_t) + sizeof(int32_t)
+                                                                         : sizeof(int32_t);
         std::string error_message = "";
-        if (message.end_type() == EndType::NONE)
+        if ((message.cmd() == CmdType::PEEK_DATA || message.cmd() == CmdType::POP_DATA) &&
+            message.end_type() == EndType::NONE)
         {
             error_message.append("End type cannot be NONE for PEEK_DATA command. ");
         }
-        if (message.data_str().length() != sizeof(int32_t))
+        if (data_str.length() != arguments_size && data_str.length() != arguments_size + sizeof(RequestFlag))
         {
-            error_message.append("Data length should be the same as an integer, but got ");
-            error_message.append(std::to_string(message.data_str().length()));
+            error_message.append("Data length should be " + std::to_string(arguments_size) +
+                                 " bytes (plus an optional flag byte), but got ");
+            error_message.append(std::to_string(data_str.length()));
             error_message.append(" bytes.");
         }
         if (!error_message.empty())
         {
-            logger_->error(error_message);
-            ZMQMessage reply(message.topic(), CmdType::ERROR, EndType::NONE, get_timestamp(), error_message);
-            std::string reply_data = reply.serialize();
-            socket_.send(zmq::message_t(reply_data.data(), reply_data.size()), zmq::send_flags::none);
+            send_error_(socket, message, error_message);
+            break;
+        }
+        if (data_topic == nullptr)
+        {
+            data_topic = find_topic_(message.topic(), "Requested " + cmd_type_to_str(message.cmd()));
+        }
+
+        RequestFlag flag = data_str.length() > arguments_size ? static_cast<RequestFlag>(data_str[arguments_size])
+                                                              : RequestFlag::NONE;
+        // Clients that accept codecs get compressed blocks as they are stored
+        std::vector<Codec> codecs;
+        std::vector<Codec> *codecs_ptr = has_request_flag(flag, RequestFlag::ACCEPT_CODECS) ? &codecs : nullptr;
+        std::vector<TimedPtr> ptrs;
+        if (message.cmd() == CmdType::PEEK_DATA)
+        {
+            ptrs = peek_data_ptrs_(data_topic, message.end_type(), bytes_to_int32(data_str.substr(0, 4)), codecs_ptr);
+        }
+        else if (message.cmd() == CmdType::POP_DATA)
+        {
+            ptrs = pop_data_ptrs_(data_topic, message.end_type(), bytes_to_int32(data_str.substr(0, 4)), codecs_ptr);
+        }
+        else if (message.cmd() == CmdType::PEEK_RANGE)
+        {
+            ptrs = peek_range_ptrs_(data_topic, bytes_to_double(data_str.substr(0, 8)),
+                                    bytes_to_double(data_str.substr(8, 8)), codecs_ptr);
+        }
+        else if (message.cmd() == CmdType::PEEK_SINCE)
+        {
+            SinceResult result = peek_since_ptrs_(data_topic, bytes_to_uint64(data_str.substr(0, 8)),
+                                                  bytes_to_int32(data_str.substr(8, 4)), codecs_ptr);
+            ptrs = join_since_result(result, get_timestamp());
+            if (codecs_ptr != nullptr)
+            {
+                codecs.insert(codecs.begin(), Codec::NONE);
+            }
+        }
+        else
+        {
+            ptrs = peek_nearest_ptrs_(data_topic, bytes_to_double(data_str.substr(0, 8)),
+                                      bytes_to_int32(data_str.substr(8, 4)), codecs_ptr);
+        }
+        send_data_reply_(socket, message, ptrs, flag, codecs);
+        break;
+    }
+
+    case CmdType::PEEK_BATCH:
+    case CmdType::PEEK_ALIGNED: {
+        std::vector<std::vector<TimedPtr>> results;
+        RequestFlag flag = RequestFlag::NONE;
+        // Starts with the codec of the manifest block
+        std::vector<Codec> codecs = {Codec::NONE};
+        try
+        {
+            results = peek_batch_ptrs_(message.cmd(), message.data_str(), flag, codecs);
+        }
+        catch (const std::invalid_argument &e)
+        {
+            send_error_(socket, message, e.what());
             break;
         }
+        send_data_reply_(socket, message, join_batch_results(results, get_timestamp()), flag, codecs);
+        break;
+    }
+
+    case CmdType::REQUEST_WITH_DATA: {
+        process_request_with_data_(message, socket);
+        break;
+    }
+
+    case CmdType::STATS: {
+        double timestamp = get_timestamp();
+        send_data_reply_(socket, message, {TimedPtr(SharedBytes(stats_json()), timestamp)}, RequestFlag::ACCEPT_CODECS,
+                         {Codec::NONE});
+        break;
+    }
 
-        int32_t n = bytes_to_int32(message.data_str());
-        std::vector<TimedPtr> ptrs = message.cmd() == CmdType::PEEK_DATA
-                                         ? peek_data_ptrs_(message.topic(), message.end_type(), n)
-                                         : pop_data_ptrs_(message.topic(), message.end_type(), n);
-        ZMQMessage reply(message.topic(), message.cmd(), message.end_type(), get_timestamp(), ptrs);
-        std::string reply_data = reply.serialize();
-        socket_.send(zmq::message_t(reply_data.data(), reply_data.size()), zmq::send_flags::none);
+    case CmdType::SYNCHRONIZE_TIME: {
+        // The time the frontend received the request, so that time spent waiting for a worker counts as server time
+        // instead of biasing the request leg of the round trip
+        double receive_time = static_cast<double>(received_time_us - steady_clock_start_time_us_) / 1e6;
+        std::string data_str = double_to_bytes(receive_time);
+        double send_time = get_timestamp();
+        ZMQMessage reply(message.topic(), CmdType::SYNCHRONIZE_TIME, EndType::NONE, send_time,
+                         data_str + double_to_bytes(send_time));
+        reply.set_protocol(message.protocol_version());
+        send_reply_(socket, reply.serialize());
         break;
     }
 
-        // case CmdType::REQUEST_WITH_DATA: {
-        //     if (!request_with_data_handler_initialized_)
-        //     {
-        //         std::string error_message = "Request with data handler not initialized";
-        //         logger_->error(error_message);
-        //         ZMQMessage reply(message.topic(), CmdType::ERROR, error_message, get_timestamp());
-        //         std::string reply_data = reply.serialize();
-        //         socket_.send(zmq::message_t(reply_data.data(), reply_data.size()), zmq::send_flags::none);
-        //         break;
-        //     }
-        //     else
-        //     {
-        //         ZMQMessage reply(message.topic(), CmdType::REQUEST_WITH_DATA,
-        //                          request_with_data_handler_(message.data_ptr()));
-        //         std::string reply_data = reply.serialize();
-        //         socket_.send(zmq::message_t(reply_data.data(), reply_data.size()), zmq::send_flags::none);
-        //         break;
-        //     }
-        // }
-
-        // case CmdType::SYNCHRONIZE_TIME
+    case CmdType::HANDSHAKE: {
+        // Handshakes are sent in version 1, which every server understands; older servers reply with an error
+        std::string data_str = message.data_str();
+        if (data_str.size() != sizeof(uint8_t))
+        {
+            send_error_(socket, message, "Handshake should have 1 byte of data");
+            break;
+        }
+        if (static_cast<uint8_t>(data_str[0]) < PROTOCOL_V1)
+        {
+            send_error_(socket, message, "Unsupported protocol version " + std::to_string(data_str[0]));
+            break;
+        }
+        uint8_t version = std::min<uint8_t>(static_cast<uint8_t>(data_str[0]), PROTOCOL_V2);
+        ZMQMessage reply("", CmdType::HANDSHAKE, EndType::NONE, get_timestamp(), std::string(1, version));
+        send_reply_(socket, reply.serialize());
+        break;
+    }
+
+    case CmdType::TOPIC_HANDLE: {
+        // Topics that only have a request handler have no handle, so clients keep naming them
+        uint32_t handle = topic_registry_->handle(message.topic());
+        ZMQMessage reply(message.topic(), CmdType::TOPIC_HANDLE, EndType::NONE, get_timestamp(),
+                         uint32_to_bytes(handle) + uint32_to_bytes(session_id_));
+        reply.set_protocol(message.protocol_version());
+        send_reply_(socket, reply.serialize());
+        break;
+    }
 
     default: {
-        std::string error_message = "Received unknown command: " + std::to_string(static_cast<int>(message.cmd()));
-        logger_->error(error_message);
-        ZMQMessage reply(message.topic(), CmdType::ERROR, EndType::NONE, get_timestamp(), error_message);
-        std::string reply_data = reply.serialize();
-        socket_.send(zmq::message_t(reply_data.data(), reply_data.size()), zmq::send_flags::none);
+        send_error_(socket, message,
+                    "Received unknown command: " + std::to_string(static_cast<int>(message.cmd())));
         break;
     }
     }
 }
 
-void ZMQServer::background_loop_()
+std::vector<std::vector<TimedPtr>> ZMQServer::peek_batch_ptrs_(CmdType cmd, const std::string &data_str,
+                                                               RequestFlag &flag, std::vector<Codec> &codecs)
+{
+    size_t position = 0;
+    auto read = [&data_str, &position](size_t size) {
+        if (position + size > data_str.size())
+        {
+            throw std::invalid_argument("Batch request is truncated at byte " + std::to_string(position));
+        }
+        std::string bytes = data_str.substr(position, size);
+        position += size;
+        return bytes;
+    };
+    double timestamp = cmd == CmdType::PEEK_ALIGNED ? bytes_to_double(read(sizeof(double))) : 0;
+    uint32_t count = bytes_to_uint32(read(sizeof(uint32_t)));
+    std::vector<std::string> topics;
+    std::vector<std::pair<EndType, int32_t>> selectors;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        topics.push_back(read(static_cast<uint8_t>(read(sizeof(uint8_t))[0])));
+        if (cmd == CmdType::PEEK_BATCH)
+        {
+            EndType end_type = static_cast<EndType>(read(sizeof(EndType))[0]);
+            if (end_type != EndType::EARLIEST && end_type != EndType::LATEST)
+            {
+                throw std::invalid_argument("Invalid end type for topic `" + topics.back() + "` in batch request");
+            }
+            selectors.emplace_back(end_type, bytes_to_int32(read(sizeof(int32_t))));
+        }
+    }
+    flag = position < data_str.size() ? static_cast<RequestFlag>(read(sizeof(RequestFlag))[0]) : RequestFlag::NONE;
+    if (position != data_str.size())
+    {
+        throw std::invalid_argument("Batch request has " + std::to_string(data_str.size() - position) +
+                                    " unexpected trailing bytes");
+    }
+
+    std::vector<Codec> *codecs_ptr = has_request_flag(flag, RequestFlag::ACCEPT_CODECS) ? &codecs : nullptr;
+    if (cmd == CmdType::PEEK_ALIGNED)
+    {
+        std::vector<std::shared_ptr<DataTopic>> data_topics;
+        for (const std::string &topic : topics)
+        {
+            data_topics.push_back(find_topic_(topic, "Requested aligned data"));
+        }
+        std::vector<std::vector<TimedPtr>> results = DataTopic::peek_nearest_aligned(data_topics, timestamp);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (data_topics[i] != nullptr)
+            {
+                data_topics[i]->decode_blocks(results[i], codecs_ptr);
+            }
+        }
+        return results;
+    }
+    std::vector<std::vector<TimedPtr>> results;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        results.push_back(peek_data_ptrs_(find_topic_(topics[i], "Requested last k data"), selectors[i].first,
+                                          selectors[i].second, codecs_ptr));
+    }
+    return results;
+}
+
+void ZMQServer::send_data_reply_(zmq::socket_t &socket, ZMQMessage &message, const std::vector<TimedPtr> &ptrs,
+                                 RequestFlag flag, const std::vector<Codec> &codecs)
 {
+    ZMQMessage reply(message.topic(), message.cmd(), message.end_type(), get_timestamp(), ptrs);
+    reply.set_protocol(message.protocol_version(), message.topic_handle(), message.session());
+    if (has_request_flag(flag, RequestFlag::ACCEPT_CODECS))
+    {
+        reply.set_block_codecs(codecs);
+    }
+    bool use_shm = shm_ring_ != nullptr && has_request_flag(flag, RequestFlag::SHARED_MEMORY);
+    int64_t start_time_us = steady_clock_us();
+    std::vector<zmq::message_t> reply_frames = reply.serialize_multipart(use_shm ? shm_ring_.get() : nullptr);
+    reply_serialize_time_us += steady_clock_us() - start_time_us;
+    send_reply_(socket, reply_frames);
+}
+
+void ZMQServer::send_error_(zmq::socket_t &socket, const ZMQMessage &request, const std::string &error_message)
+{
+    logger_->error(error_message);
+    error_count_.fetch_add(1, std::memory_order_relaxed);
+    ZMQMessage reply(request.topic(), CmdType::ERROR, EndType::NONE, get_timestamp(), error_message);
+    reply.set_protocol(request.protocol_version(), request.topic_handle(), request.session());
+    send_reply_(socket, reply.serialize());
+}
+
+void ZMQServer::send_reply_(zmq::socket_t &socket, std::vector<zmq::message_t> &frames)
+{
+    for (zmq::message_t &frame : reply_envelope)
+    {
+        socket.send(frame, zmq::send_flags::sndmore);
+    }
+    reply_envelope.clear();
+    send_multipart_(socket, frames);
+}
+
+void ZMQServer::send_reply_(zmq::socket_t &socket, const std::string &reply_data)
+{
+    std::vector<zmq::message_t> frames;
+    frames.emplace_back(reply_data.data(), reply_data.size());
+    send_reply_(socket, frames);
+}
+
+void ZMQServer::send_multipart_(zmq::socket_t &socket, std::vector<zmq::message_t> &frames)
+{
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        socket.send(frames[i], i + 1 < frames.size() ? zmq::send_flags::sndmore : zmq::send_flags::none);
+    }
+}
+
+std::vector<zmq::message_t> ZMQServer::recv_multipart_(zmq::socket_t &socket)
+{
+    std::vector<zmq::message_t> frames;
+    do
+    {
+        frames.emplace_back();
+        socket.recv(frames.back());
+    } while (frames.back().more());
+    return frames;
+}
+
+void ZMQServer::enforce_memory_limit_()
+{
+    // Producers that find another one evicting leave the request behind instead of waiting. The evicting producer
+    // checks for it after releasing the lock, so a put that raced with the end of its scan is not missed.
+    eviction_requested_.store(true);
+    while (eviction_requested_.load())
+    {
+        std::unique_lock<std::mutex> lock(eviction_mutex_, std::try_to_lock);
+        if (!lock.owns_lock())
+        {
+            return;
+        }
+        eviction_requested_.store(false);
+        evict_to_memory_limit_();
+    }
+}
+
+void ZMQServer::evict_to_memory_limit_()
+{
+    std::shared_ptr<const TopicRegistry::TopicMap> topics = topic_registry_->snapshot();
+    while (true)
+    {
+        size_t total_bytes = 0;
+        size_t total_count = 0;
+        std::shared_ptr<DataTopic> oldest_topic;
+        double oldest_timestamp = 0;
+        for (const auto &pair : *topics)
+        {
+            total_bytes += pair.second->bytes();
+            double timestamp;
+            if (pair.second->oldest_timestamp(timestamp))
+            {
+                total_count += pair.second->size();
+                if (oldest_topic == nullptr || timestamp < oldest_timestamp)
+                {
+                    oldest_topic = pair.second;
+                    oldest_timestamp = timestamp;
+                }
+            }
+        }
+        // The newest block is always kept, even if it alone exceeds the limit
+        if (total_bytes <= memory_limit_ || total_count <= 1)
+        {
+            return;
+        }
+        oldest_topic->evict_oldest(oldest_timestamp);
+    }
+}
+
+void ZMQServer::expiry_loop_()
+{
+    std::unique_lock<std::mutex> lock(expiry_mutex_);
     while (running_)
     {
+        expiry_condition_.wait_for(lock, expiry_interval_ms_, [this] { return !running_; });
+        for (const auto &pair : *topic_registry_->snapshot())
+        {
+            pair.second->expire_data();
+        }
+    }
+}
 
-        zmq::poll(&poller_item_, 1, poller_timeout_ms_.count());
+void ZMQServer::publish_data_(const std::string &topic, const SharedBytes &data_ptr, double timestamp)
+{
+    // The first frame starts with the length-prefixed topic, which subscribers use as their exact-match filter
+    ZMQMessage message(topic, CmdType::STREAM_DATA, EndType::LATEST, timestamp,
+                       {std::make_tuple(data_ptr, timestamp)});
+    std::vector<zmq::message_t> frames = message.serialize_multipart();
+    std::lock_guard<std::mutex> lock(publisher_mutex_);
+    send_multipart_(*publisher_, frames);
+}
 
-        zmq::message_t request;
-        if (poller_item_.revents & ZMQ_POLLIN)
+void ZMQServer::serve_loop_(zmq::socket_t &socket)
+{
+    zmq::pollitem_t poller_item = {socket, 0, ZMQ_POLLIN, 0};
+    while (running_)
+    {
+        zmq::poll(&poller_item, 1, poller_timeout_ms_.count());
+        if (poller_item.revents & ZMQ_POLLIN)
+        {
+            std::vector<zmq::message_t> request_frames = recv_multipart_(socket);
+            handle_request_(request_frames, socket, false);
+        }
+    }
+}
+
+void ZMQServer::handle_request_(std::vector<zmq::message_t> &frames, zmq::socket_t &socket, bool stamped)
+{
+    int64_t start_time_us = steady_clock_us();
+    int64_t received_time_us = start_time_us;
+    if (stamped && !frames.empty() && frames[0].size() == sizeof(int64_t))
+    {
+        std::memcpy(&received_time_us, frames[0].data(), sizeof(int64_t));
+        queue_latency_.record(start_time_us - received_time_us);
+        frames.erase(frames.begin());
+    }
+    reply_serialize_time_us = 0;
+    std::unique_ptr<ZMQMessage> message;
+    try
+    {
+        message = std::make_unique<ZMQMessage>(frames);
+        int cmd = static_cast<int>(message->cmd());
+        request_counts_[cmd > 0 && cmd < static_cast<int>(CMD_TYPE_NUM) ? cmd : 0].fetch_add(
+            1, std::memory_order_relaxed);
+        process_request_(*message, socket, received_time_us);
+    }
+    catch (const std::exception &e)
+    {
+        // A malformed request only fails itself, not the server. Requests that could not be parsed get a version 1
+        // error reply.
+        send_error_(socket, message != nullptr ? *message : ZMQMessage("", CmdType::ERROR, EndType::NONE, 0, ""),
+                    std::string("Invalid request: ") + e.what());
+    }
+    process_latency_.record(steady_clock_us() - start_time_us - reply_serialize_time_us);
+    serialize_latency_.record(reply_serialize_time_us);
+}
+
+void ZMQServer::worker_loop_(const std::string &backend_endpoint)
+{
+    zmq::socket_t socket(context_, zmq::socket_type::req);
+    socket.connect(backend_endpoint);
+    socket.send(zmq::message_t(WORKER_READY, std::strlen(WORKER_READY)), zmq::send_flags::none);
+    zmq::pollitem_t poller_item = {socket, 0, ZMQ_POLLIN, 0};
+    while (running_)
+    {
+        zmq::poll(&poller_item, 1, poller_timeout_ms_.count());
+        if (poller_item.revents & ZMQ_POLLIN)
+        {
+            // [client envelope, empty delimiter, stamp, request]
+            std::vector<zmq::message_t> request_frames = recv_multipart_(socket);
+            auto delimiter = std::find_if(request_frames.begin(), request_frames.end(),
+                                          [](const zmq::message_t &frame) { return frame.size() == 0; });
+            reply_envelope.assign(std::make_move_iterator(request_frames.begin()),
+                                  std::make_move_iterator(delimiter + 1));
+            request_frames.erase(request_frames.begin(), delimiter + 1);
+            handle_request_(request_frames, socket, true);
+        }
+    }
+    socket.close();
+}
+
+void ZMQServer::frontend_loop_()
+{
+    // Every request goes to an idle worker of its lane, so a small request never waits behind a large reply while
+    // another worker is free. Requests are only read while a worker of either lane is idle; one whose lane is busy
+    // waits in the lane's queue for its next free worker. A REQ client has at most one request in flight, so the
+    // queues stay as short as the number of clients.
+    struct Lane
+    {
+        zmq::socket_t &backend;
+        std::deque<zmq::message_t> idle_workers;
+        std::deque<std::vector<zmq::message_t>> pending;
+    };
+    Lane lanes[] = {{priority_backend_, {}, {}}, {worker_backend_, {}, {}}};
+    auto dispatch = [](Lane &lane, std::vector<zmq::message_t> &request) {
+        // [worker id, empty delimiter, client envelope, empty delimiter, stamp, request]
+        std::vector<zmq::message_t> frames;
+        frames.reserve(request.size() + 2);
+        frames.push_back(std::move(lane.idle_workers.front()));
+        lane.idle_workers.pop_front();
+        frames.emplace_back();
+        for (zmq::message_t &frame : request)
+        {
+            frames.push_back(std::move(frame));
+        }
+        send_multipart_(lane.backend, frames);
+    };
+    while (running_)
+    {
+        // Replies are forwarded before new requests are dispatched, so finished work leaves the server first
+        zmq::pollitem_t poller_items[] = {{lanes[0].backend, 0, ZMQ_POLLIN, 0},
+                                          {lanes[1].backend, 0, ZMQ_POLLIN, 0},
+                                          {socket_, 0, ZMQ_POLLIN, 0}};
+        bool worker_idle = !lanes[0].idle_workers.empty() || !lanes[1].idle_workers.empty();
+        zmq::poll(poller_items, worker_idle ? 3 : 2, poller_timeout_ms_.count());
+        for (size_t i = 0; i < 2; ++i)
+        {
+            if (!(poller_items[i].revents & ZMQ_POLLIN))
+            {
+                continue;
+            }
+            // [worker id, empty delimiter, READY] or [worker id, empty delimiter, client envelope, reply]
+            std::vector<zmq::message_t> frames = recv_multipart_(lanes[i].backend);
+            if (frames.size() < 3)
+            {
+                continue;
+            }
+            if (frames.size() > 3)
+            {
+                std::vector<zmq::message_t> reply(std::make_move_iterator(frames.begin() + 2),
+                                                  std::make_move_iterator(frames.end()));
+                send_multipart_(socket_, reply);
+            }
+            lanes[i].idle_workers.push_back(std::move(frames[0]));
+            if (!lanes[i].pending.empty())
+            {
+                dispatch(lanes[i], lanes[i].pending.front());
+                lanes[i].pending.pop_front();
+            }
+        }
+        if (worker_idle && (poller_items[2].revents & ZMQ_POLLIN))
+        {
+            std::vector<zmq::message_t> frames = recv_multipart_(socket_);
+            auto delimiter = std::find_if(frames.begin(), frames.end(),
+                                          [](const zmq::message_t &frame) { return frame.size() == 0; });
+            if (delimiter == frames.end())
+            {
+                // Without an envelope there is no way to send a reply
+                logger_->warn("Dropped a request without an envelope delimiter.");
+                continue;
+            }
+            // Classified before the stamp is inserted, which is read as the request by is_priority_request_
+            Lane &lane = lanes[is_priority_request_(frames) ? 0 : 1];
+            // The worker strips the envelope up to the empty delimiter, so the stamp becomes the first frame it
+            // handles
+            int64_t received_time_us = steady_clock_us();
+            frames.insert(delimiter + 1, zmq::message_t(&received_time_us, sizeof(received_time_us)));
+            if (lane.idle_workers.empty())
+            {
+                lane.pending.push_back(std::move(frames));
+            }
+            else
+            {
+                dispatch(lane, frames);
+            }
+        }
+    }
+}
+
+bool ZMQServer::is_priority_request_(const std::vector<zmq::message_t> &frames)
+{
+    // ROUTER envelope: [routing id(s), empty delimiter, request]
+    size_t i = 0;
+    while (i < frames.size() && frames[i].size() > 0)
+    {
+        ++i;
+    }
+    CmdType cmd;
+    std::string topic;
+    uint32_t topic_handle;
+    if (i + 1 >= frames.size() ||
+        !peek_message_header(frames[i + 1].data<char>(), frames[i + 1].size(), cmd, topic, topic_handle))
+    {
+        return false;
+    }
+    // Time synchronization measures round trips, which must not wait behind large replies, and stats should stay
+    // readable when the workers are saturated
+    if (cmd == CmdType::SYNCHRONIZE_TIME || cmd == CmdType::STATS)
+    {
+        return true;
+    }
+    if (topic_handle != 0)
+    {
+        std::shared_ptr<DataTopic> data_topic = topic_registry_->find(topic_handle);
+        if (data_topic == nullptr)
         {
-            socket_.recv(request);
-            ZMQMessage message(std::string(request.data<char>(), request.data<char>() + request.size()));
-            process_request_(message);
+            return false;
         }
+        topic = data_topic->name();
     }
+    std::lock_guard<std::mutex> lock(priority_topics_mutex_);
+    return priority_topics_.count(topic) > 0;
 }
@@ -0,0 +1,201 @@
+#include "zmq_subscriber.h"
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+ZMQSubscriber::ZMQSubscriber(const std::string &subscriber_name, const std::string &publisher_endpoint,
+                             bool zero_copy)
+    : subscriber_name_(subscriber_name), zero_copy_(zero_copy), logger_(spdlog::stdout_color_mt(subscriber_name)),
+      context_(1), socket_(context_, zmq::socket_type::sub), poller_timeout_ms_(10), running_(false)
+{
+    logger_->set_pattern("[%H:%M:%S %n %^%l%$] %v");
+    socket_.connect(publisher_endpoint);
+    running_ = true;
+    background_thread_ = std::thread(&ZMQSubscriber::background_loop_, this);
+}
+
+ZMQSubscriber::~ZMQSubscriber()
+{
+    close();
+    socket_.close();
+    context_.close();
+}
+
+void ZMQSubscriber::close()
+{
+    running_ = false;
+    if (background_thread_.joinable())
+    {
+        background_thread_.join();
+    }
+}
+
+void ZMQSubscriber::subscribe(const std::string &topic, int32_t queue_size, bool conflate)
+{
+    if (!conflate && queue_size <= 0)
+    {
+        throw std::invalid_argument("Queue size must be positive");
+    }
+    std::lock_guard<std::mutex> lock(subscription_mutex_);
+    if (subscriptions_.find(topic) != subscriptions_.end())
+    {
+        logger_->warn("Already subscribed to topic `{}`. Ignoring the request to subscribe again.", topic);
+        return;
+    }
+    subscriptions_[topic] = Subscription{conflate ? 1 : static_cast<size_t>(queue_size), {}, nullptr};
+    pending_filters_.emplace_back(topic_filter_(topic), true);
+}
+
+void ZMQSubscriber::unsubscribe(const std::string &topic)
+{
+    std::lock_guard<std::mutex> lock(subscription_mutex_);
+    if (subscriptions_.erase(topic) == 0)
+    {
+        logger_->warn("Not subscribed to topic `{}`.", topic);
+        return;
+    }
+    pending_filters_.emplace_back(topic_filter_(topic), false);
+}
+
+void ZMQSubscriber::set_callback(const std::string &topic, std::function<void(const SharedBytes &, double)> callback)
+{
+    std::lock_guard<std::mutex> lock(subscription_mutex_);
+    auto it = subscriptions_.find(topic);
+    if (it == subscriptions_.end())
+    {
+        throw std::invalid_argument("Please subscribe to topic `" + topic + "` before setting its callback");
+    }
+    it->second.callback = std::make_shared<std::function<void(const SharedBytes &, double)>>(callback);
+}
+
+std::vector<TimedPtr> ZMQSubscriber::pop_data(const std::string &topic, int32_t n, double timeout)
+{
+    std::unique_lock<std::mutex> lock(subscription_mutex_);
+    auto it = subscriptions_.find(topic);
+    if (it == subscriptions_.end())
+    {
+        throw std::invalid_argument("Not subscribed to topic `" + topic + "`");
+    }
+    if (timeout > 0)
+    {
+        // Look the topic up again after waiting, since it may have been unsubscribed in the meantime
+        data_condition_.wait_for(lock, std::chrono::duration<double>(timeout), [this, &topic] {
+            auto found = subscriptions_.find(topic);
+            return found == subscriptions_.end() || !found->second.queue.empty();
+        });
+        it = subscriptions_.find(topic);
+        if (it == subscriptions_.end())
+        {
+            return {};
+        }
+    }
+    std::deque<TimedPtr> &queue = it->second.queue;
+    if (n < 0 || static_cast<size_t>(n) > queue.size())
+    {
+        n = queue.size();
+    }
+    std::vector<TimedPtr> ret(queue.begin(), queue.begin() + n);
+    queue.erase(queue.begin(), queue.begin() + n);
+    return ret;
+}
+
+bool ZMQSubscriber::zero_copy() const
+{
+    return zero_copy_;
+}
+
+void ZMQSubscriber::apply_pending_subscriptions_()
+{
+    std::lock_guard<std::mutex> lock(subscription_mutex_);
+    for (const auto &filter : pending_filters_)
+    {
+        if (filter.second)
+        {
+            socket_.set(zmq::sockopt::subscribe, filter.first);
+        }
+        else
+        {
+            socket_.set(zmq::sockopt::unsubscribe, filter.first);
+        }
+    }
+    pending_filters_.clear();
+}
+
+std::string ZMQSubscriber::topic_filter_(const std::string &topic)
+{
+    // Published messages start with the length-prefixed topic, so this prefix only matches the exact topic
+    return std::string(1, static_cast<char>(uint8_t(topic.size()))) + topic;
+}
+
+void ZMQSubscriber::background_loop_()
+{
+    while (running_)
+    {
+        apply_pending_subscriptions_();
+        zmq::pollitem_t poller_item = {socket_, 0, ZMQ_POLLIN, 0};
+        zmq::poll(&poller_item, 1, poller_timeout_ms_.count());
+        if (!(poller_item.revents & ZMQ_POLLIN))
+        {
+            continue;
+        }
+
+        std::vector<zmq::message_t> frames;
+        do
+        {
+            frames.emplace_back();
+            socket_.recv(frames.back());
+        } while (frames.back().more());
+        std::string topic;
+        std::vector<TimedPtr> ptrs;
+        try
+        {
+            ZMQMessage message(frames);
+            if (message.cmd() != CmdType::STREAM_DATA)
+            {
+                logger_->warn("Received unexpected command {} from the publisher.", static_cast<int>(message.cmd()));
+                continue;
+            }
+            topic = message.topic();
+            ptrs = message.data_ptrs();
+        }
+        catch (const std::exception &e)
+        {
+            logger_->error("Dropped a malformed message from the publisher: {}", e.what());
+            continue;
+        }
+        // Only the shared_ptr is copied under the lock, so a Python callback never needs the GIL while it is held
+        std::shared_ptr<std::function<void(const SharedBytes &, double)>> callback;
+        {
+            std::lock_guard<std::mutex> lock(subscription_mutex_);
+            auto it = subscriptions_.find(topic);
+            if (it == subscriptions_.end())
+            {
+                continue;
+            }
+            Subscription &subscription = it->second;
+            for (const TimedPtr &ptr : ptrs)
+            {
+                subscription.queue.push_back(ptr);
+                if (subscription.queue.size() > subscription.queue_size)
+                {
+                    subscription.queue.pop_front();
+                }
+            }
+            callback = subscription.callback;
+        }
+        data_condition_.notify_all();
+        if (callback == nullptr)
+        {
+            continue;
+        }
+        for (const TimedPtr &ptr : ptrs)
+        {
+            try
+            {
+                (*callback)(std::get<0>(ptr), std::get<1>(ptr));
+            }
+            catch (const std::exception &e)
+            {
+                logger_->error("Callback for topic `{}` raised an exception: {}", topic, e.what());
+            }
+        }
+    }
+}
@@ -1,28 +1,212 @@
+import asyncio
+from concurrent.futures import Future
+from typing import Any, Callable
+
+import numpy.typing as npt
+from typing_extensions import Buffer
+
 def steady_clock_us() -> int: ...
 def system_clock_us() -> int: ...
 
 class ZMQServer:
-    def __init__(self, server_name: str, server_endpoint: str) -> None: ...
-    def add_topic(self, topic: str, max_remaining_time: float) -> None: ...
+    def __init__(
+        self,
+        server_name: str,
+        server_endpoint: str,
+        shared_memory_size: int = 0,
+        publish_endpoint: str = "",
+        num_workers: int = 0,
+    ) -> None: ...
+    def add_topic(
+        self,
+        topic: str,
+        max_remaining_time: float,
+        capacity: int = 0,
+        max_bytes: int = 0,
+        max_count: int = 0,
+        codec: str = "none",
+        element_size: int = 4,
+    ) -> int: ...
     def put_data(self, topic: str, data: bytes) -> None: ...
+    def put_many(
+        self, topic: str, data: list[bytes], timestamps: list[float] | None = None
+    ) -> None: ...
+    def put_many_topics(
+        self, batches: list[tuple[str, list[bytes], list[float] | None]]
+    ) -> None: ...
+    def put_array(self, topic: str, array: Buffer) -> None: ...
     def peek_data(
         self, topic: str, end_type: str, n: int
     ) -> tuple[list[bytes], list[float]]: ...
+    def peek_arrays(
+        self, topic: str, end_type: str, n: int
+    ) -> tuple[list[npt.NDArray[Any]], list[float]]: ...
     def pop_data(
         self, topic: str, end_type: str, n: int
     ) -> tuple[list[bytes], list[float]]: ...
+    def peek_range(
+        self, topic: str, start_time: float, end_time: float
+    ) -> tuple[list[bytes], list[float]]: ...
+    def peek_nearest(
+        self, topic: str, timestamp: float, k: int = 1
+    ) -> tuple[list[bytes], list[float]]: ...
+    def peek_since(
+        self, topic: str, cursor: int, n: int = -1
+    ) -> tuple[list[bytes], list[float], list[int], int, bool]: ...
     def get_topic_status(self) -> dict[str, int]: ...
+    def get_topic_bytes(self) -> dict[str, int]: ...
+    def get_stats(self) -> dict[str, Any]: ...
+    def set_memory_limit(self, max_bytes: int) -> None: ...
+    def set_request_handler(
+        self, topic: str, handler: Callable[[bytes], Buffer | None]
+    ) -> None: ...
+    def remove_request_handler(self, topic: str) -> None: ...
     def get_timestamp(self) -> float: ...
     def reset_start_time(self, system_time_us: int) -> None: ...
+    def set_topic_priority(self, topic: str, priority: bool = True) -> None: ...
+    def start_recording(self, directory: str, topics: list[str]) -> None: ...
+    def stop_recording(self) -> None: ...
+    def replay(
+        self,
+        directory: str,
+        speed: float = 1.0,
+        start_time: float = ...,
+        end_time: float = ...,
+    ) -> None: ...
+    def stop_replay(self) -> None: ...
+    def is_replaying(self) -> bool: ...
+
+class RecordingReader:
+    """Read-only view of a directory written by ZMQServer.start_recording."""
+
+    def __init__(self, directory: str) -> None: ...
+    def topics(self) -> list[str]: ...
+    def count(self, topic: str) -> int: ...
+    def start_time(self) -> float: ...
+    def end_time(self) -> float: ...
+    def at(self, topic: str, i: int) -> tuple[bytes, float]: ...
+    def lower_bound(self, topic: str, timestamp: float) -> int: ...
+    def peek_range(
+        self, topic: str, start_time: float, end_time: float
+    ) -> tuple[list[bytes], list[float]]: ...
+
+class SharedBytes:
+    """Read-only buffer that references data received by a ZMQClient without copying it."""
+
+    def __len__(self) -> int: ...
+    def __bytes__(self) -> bytes: ...
 
 class ZMQClient:
-    def __init__(self, client_name: str, server_endpoint: str) -> None: ...
+    def __init__(
+        self,
+        client_name: str,
+        server_endpoint: str,
+        zero_copy: bool = False,
+        shared_memory: bool = False,
+        max_protocol_version: int = 2,
+    ) -> None: ...
     def peek_data(
         self, topic: str, end_type: str, n: int
-    ) -> tuple[list[bytes], list[float]]: ...
+    ) -> tuple[list[bytes | memoryview], list[float]]: ...
     def pop_data(
         self, topic: str, end_type: str, n: int
-    ) -> tuple[list[bytes], list[float]]: ...
-    def get_last_retrieved_data(self) -> tuple[list[bytes], list[float]]: ...
+    ) -> tuple[list[bytes | memoryview], list[float]]: ...
+    def peek_arrays(
+        self, topic: str, end_type: str, n: int
+    ) -> tuple[list[npt.NDArray[Any]], list[float]]: ...
+    def peek_range(
+        self, topic: str, start_time: float, end_time: float
+    ) -> tuple[list[bytes | memoryview], list[float]]: ...
+    def peek_nearest(
+        self, topic: str, timestamp: float, k: int = 1
+    ) -> tuple[list[bytes | memoryview], list[float]]: ...
+    def peek_since(
+        self, topic: str, cursor: int, n: int = -1
+    ) -> tuple[list[bytes | memoryview], list[float], list[int], int, bool]: ...
+    def peek_batch(
+        self, specs: list[tuple[str, str, int]]
+    ) -> list[tuple[list[bytes | memoryview], list[float]]]: ...
+    def peek_aligned(
+        self, topics: list[str], timestamp: float
+    ) -> list[tuple[list[bytes | memoryview], list[float]]]: ...
+    def request_with_data(self, topic: str, data: bytes) -> bytes | memoryview: ...
+    def synchronize_time(self, samples: int = 16) -> tuple[float, float]: ...
+    def get_clock_offset(self) -> tuple[float, float]: ...
+    def get_server_stats(self) -> dict[str, Any]: ...
+    def protocol_version(self) -> int: ...
+    def mirror_topic(
+        self, topic: str, max_remaining_time: float, interval: float = 0.01
+    ) -> None: ...
+    def unmirror_topic(self, topic: str) -> None: ...
+    def get_mirror_staleness(self, topic: str) -> float: ...
+    def get_last_retrieved_data(
+        self,
+    ) -> tuple[list[bytes | memoryview], list[float]]: ...
+    def get_timestamp(self) -> float: ...
+    def reset_start_time(self, system_time_us: int) -> None: ...
+
+class ZMQAsyncClient:
+    def __init__(
+        self, client_name: str, server_endpoint: str, zero_copy: bool = False
+    ) -> None: ...
+    def peek_data(
+        self, topic: str, end_type: str, n: int, timeout: float = 0.0
+    ) -> Future[tuple[list[bytes | memoryview], list[float]]]: ...
+    def pop_data(
+        self, topic: str, end_type: str, n: int, timeout: float = 0.0
+    ) -> Future[tuple[list[bytes | memoryview], list[float]]]: ...
+    def peek_range(
+        self, topic: str, start_time: float, end_time: float, timeout: float = 0.0
+    ) -> Future[tuple[list[bytes | memoryview], list[float]]]: ...
+    def peek_nearest(
+        self, topic: str, timestamp: float, k: int = 1, timeout: float = 0.0
+    ) -> Future[tuple[list[bytes | memoryview], list[float]]]: ...
+    def peek_since(
+        self, topic: str, cursor: int, n: int = -1, timeout: float = 0.0
+    ) -> Future[tuple[list[bytes | memoryview], list[float], list[int], int, bool]]: ...
+    def peek_batch(
+        self, specs: list[tuple[str, str, int]], timeout: float = 0.0
+    ) -> Future[list[tuple[list[bytes | memoryview], list[float]]]]: ...
+    def peek_aligned(
+        self, topics: list[str], timestamp: float, timeout: float = 0.0
+    ) -> Future[list[tuple[list[bytes | memoryview], list[float]]]]: ...
+    def apeek_data(
+        self, topic: str, end_type: str, n: int, timeout: float = 0.0
+    ) -> asyncio.Future[tuple[list[bytes | memoryview], list[float]]]: ...
+    def apop_data(
+        self, topic: str, end_type: str, n: int, timeout: float = 0.0
+    ) -> asyncio.Future[tuple[list[bytes | memoryview], list[float]]]: ...
+    def apeek_range(
+        self, topic: str, start_time: float, end_time: float, timeout: float = 0.0
+    ) -> asyncio.Future[tuple[list[bytes | memoryview], list[float]]]: ...
+    def apeek_nearest(
+        self, topic: str, timestamp: float, k: int = 1, timeout: float = 0.0
+    ) -> asyncio.Future[tuple[list[bytes | memoryview], list[float]]]: ...
+    def apeek_since(
+        self, topic: str, cursor: int, n: int = -1, timeout: float = 0.0
+    ) -> asyncio.Future[
+        tuple[list[bytes | memoryview], list[float], list[int], int, bool]
+    ]: ...
+    def apeek_batch(
+        self, specs: list[tuple[str, str, int]], timeout: float = 0.0
+    ) -> asyncio.Future[list[tuple[list[bytes | memoryview], list[float]]]]: ...
+    def apeek_aligned(
+        self, topics: list[str], timestamp: float, timeout: float = 0.0
+    ) -> asyncio.Future[list[tuple[list[bytes | memoryview], list[float]]]]: ...
     def get_timestamp(self) -> float: ...
     def reset_start_time(self, system_time_us: int) -> None: ...
+
+class ZMQSubscriber:
+    def __init__(
+        self, subscriber_name: str, publisher_endpoint: str, zero_copy: bool = False
+    ) -> None: ...
+    def subscribe(
+        self, topic: str, queue_size: int = 100, conflate: bool = False
+    ) -> None: ...
+    def unsubscribe(self, topic: str) -> None: ...
+    def set_callback(
+        self, topic: str, callback: Callable[[SharedBytes, float], None]
+    ) -> None: ...
+    def pop_data(
+        self, topic: str, n: int = -1, timeout: float = 0.0
+    ) -> tuple[list[bytes | memoryview], list[float]]: ...